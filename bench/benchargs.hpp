@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+// Argument parsing shared by the benchmarks, which take --key=value like mpcsim.
+
+namespace csim
+{
+    // Splits every argument into its key and value and hands them to set, which returns
+    // false for a key the benchmark does not take.
+    template <typename Set>
+    void parseBenchArgs(int argc, char *argv[], Set set)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg(argv[i]);
+            size_t equal_pos = arg.find('=');
+            if (arg.substr(0, 2) != "--" || equal_pos == std::string::npos)
+            {
+                std::cerr << "Invalid argument format: " << arg << std::endl;
+                exit(1);
+            }
+
+            std::string key = arg.substr(2, equal_pos - 2);
+            std::string value = arg.substr(equal_pos + 1);
+            if (!set(key, value))
+            {
+                std::cerr << "Unknown key: " << key << std::endl;
+                exit(1);
+            }
+        }
+    }
+
+    // The arguments of the benchmarks that read a trace directory.
+    struct TraceBenchConfig
+    {
+        std::string directory;
+        size_t num_procs = 0; // 0 = every consecutive <proc>.txt found in directory
+        size_t repeat = 200;
+    };
+
+    inline void parseTraceBenchArgs(int argc, char *argv[], TraceBenchConfig &config, const std::string &name)
+    {
+        auto set = [&](const std::string &key, const std::string &value)
+        {
+            if (key == "directory")
+            {
+                config.directory = value;
+            }
+            else if (key == "num_procs")
+            {
+                config.num_procs = std::stoi(value);
+            }
+            else if (key == "repeat")
+            {
+                config.repeat = std::stoi(value);
+            }
+            else
+            {
+                return false;
+            }
+            return true;
+        };
+        parseBenchArgs(argc, argv, set);
+
+        if (config.directory.empty())
+        {
+            std::cerr << "usage: " << name << " --directory=<dir> [--num_procs=<n>] [--repeat=<n>]" << std::endl;
+            exit(1);
+        }
+    }
+
+    // Processors with a text trace in dir, numbered from 0.
+    inline size_t countProcs(const std::filesystem::path &dir)
+    {
+        size_t procs = 0;
+        while (std::filesystem::exists(dir / (std::to_string(procs) + ".txt")))
+        {
+            procs++;
+        }
+        return procs;
+    }
+}
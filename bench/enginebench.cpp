@@ -0,0 +1,153 @@
+#include "benchargs.hpp"
+#include "bus.hpp"
+#include "cache.hpp"
+#include "cpu.hpp"
+#include "globals.hpp"
+#include "protocol.hpp"
+#include "synthetic.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Simulated accesses per second of the snooping engine for every protocol. Each protocol
+// runs on its compile-time specialized engine (BuiltinProtocol) and on the engine that
+// looks the same spec up at run time (SpecProtocol), over pre-generated synthetic traces
+// so that trace generation stays out of the timing.
+// Usage: enginebench [--num_procs=8] [--num_accesses=200000] [--cache_size=8192] [--repeat=3]
+// Build with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+
+using namespace csim;
+
+namespace
+{
+    struct BenchConfig
+    {
+        size_t num_procs = 8;
+        size_t num_accesses = 200000;
+        size_t cache_size = 8192; // bytes per 8-way cache, 0 = unbounded
+        size_t repeat = 3;
+    };
+
+    // Replays traces generated up front.
+    class ReplayTrace : public TraceSource
+    {
+    public:
+        explicit ReplayTrace(const std::vector<std::vector<Instruction>> &traces) : traces_(traces), cursors_(traces.size(), 0) {}
+
+        std::optional<Instruction> readNextLine(size_t proc) override
+        {
+            if (cursors_[proc] == traces_[proc].size())
+            {
+                return std::nullopt;
+            }
+            return traces_[proc][cursors_[proc]++];
+        }
+
+    private:
+        const std::vector<std::vector<Instruction>> &traces_;
+        std::vector<size_t> cursors_;
+    };
+
+    std::vector<std::vector<Instruction>> generate(Workload workload, const BenchConfig &config)
+    {
+        SyntheticTrace trace(workload, config.num_procs, config.num_accesses, 64, 42);
+        std::vector<std::vector<Instruction>> traces(config.num_procs);
+        for (size_t proc = 0; proc < config.num_procs; proc++)
+        {
+            while (std::optional<Instruction> ins = trace.readNextLine(proc))
+            {
+                traces[proc].push_back(*ins);
+            }
+        }
+        return traces;
+    }
+
+    // Seconds to simulate traces once, the bus traffic goes to checksum.
+    template <typename Protocol>
+    double simulate(Protocol protocol, const std::vector<std::vector<Instruction>> &traces, const BenchConfig &config, size_t &checksum)
+    {
+        CacheGeometry geometry = CacheGeometry{.num_sets = config.cache_size / 64 / 8, .assoc = 8, .line_size = 64, .replacement = ReplacementPolicy::LRU};
+        ReplayTrace source(traces);
+        Stats stats(config.num_procs);
+        CPUS<SnoopCaches<Protocol, LRUPolicy>> cpus(&source, config.num_procs, nullptr);
+        SnoopCaches<Protocol, LRUPolicy> caches(config.num_procs, nullptr, &cpus, protocol, &stats, geometry);
+        SnoopBus<Protocol, LRUPolicy> bus(config.num_procs, &caches, &stats);
+        caches.setBus(&bus);
+        cpus.setCaches(&caches);
+        cycles = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        while (cpus.cycle())
+        {
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        checksum += stats.interconstats.traffic;
+        return elapsed.count();
+    }
+
+    template <CoherenceProtocol P>
+    void bench(const std::vector<std::vector<Instruction>> &traces, const BenchConfig &config)
+    {
+        double accesses = static_cast<double>(config.num_procs * config.num_accesses * config.repeat);
+        size_t builtin_checksum = 0;
+        size_t spec_checksum = 0;
+        double builtin_seconds = 0;
+        double spec_seconds = 0;
+        for (size_t rep = 0; rep < config.repeat; rep++)
+        {
+            builtin_seconds += simulate(BuiltinProtocol<P>(), traces, config, builtin_checksum);
+            spec_seconds += simulate(SpecProtocol{.loaded = BuiltinProtocol<P>::table()}, traces, config, spec_checksum);
+        }
+        if (builtin_checksum != spec_checksum)
+        {
+            std::cerr << P << " engines disagree" << std::endl;
+            exit(1);
+        }
+        std::cout << P << "\t"
+                  << "builtin Maccesses/s: " << accesses / builtin_seconds / 1e6 << "\t"
+                  << "spec Maccesses/s: " << accesses / spec_seconds / 1e6 << "\t"
+                  << "(traffic " << builtin_checksum / config.repeat << ")" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig config;
+    auto set = [&](const std::string &key, const std::string &value)
+    {
+        if (key == "num_procs")
+        {
+            config.num_procs = std::stoi(value);
+        }
+        else if (key == "num_accesses")
+        {
+            config.num_accesses = std::stoi(value);
+        }
+        else if (key == "cache_size")
+        {
+            config.cache_size = std::stoi(value);
+        }
+        else if (key == "repeat")
+        {
+            config.repeat = std::stoi(value);
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    };
+    parseBenchArgs(argc, argv, set);
+
+    for (Workload workload : {Workload::RANDOM, Workload::PRODUCER_CONSUMER, Workload::FALSE_SHARING})
+    {
+        std::cout << "== " << workload << std::endl;
+        std::vector<std::vector<Instruction>> traces = generate(workload, config);
+        bench<CoherenceProtocol::MI>(traces, config);
+        bench<CoherenceProtocol::MSI>(traces, config);
+        bench<CoherenceProtocol::MESI>(traces, config);
+        bench<CoherenceProtocol::MOESI>(traces, config);
+        bench<CoherenceProtocol::MESIF>(traces, config);
+    }
+}
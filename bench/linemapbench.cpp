@@ -0,0 +1,139 @@
+#include "trace.hpp"
+#include "benchargs.hpp"
+#include "flatmap.hpp"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compares per-cache line state tables on the access pattern of a snooping simulation:
+// every access probes the state of the line in every cache, then updates the requester
+// and invalidates the other copies on stores.
+// Usage: linemapbench --directory=our_traces/random [--num_procs=8] [--repeat=200]
+// Build with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+
+using namespace csim;
+
+namespace
+{
+    enum class State : uint8_t
+    {
+        INVALID,
+        SHARED,
+        MODIFIED
+    };
+
+    // The previous representation: find() to read, operator[] to write.
+    class NodeMap
+    {
+    public:
+        State get(size_t line) const
+        {
+            auto it = map_.find(line);
+            return it == map_.end() ? State::INVALID : it->second;
+        }
+
+        void set(size_t line, State state)
+        {
+            if (get(line) != state)
+            {
+                map_[line] = state;
+            }
+        }
+
+    private:
+        std::unordered_map<size_t, State> map_;
+    };
+
+    class FlatMap
+    {
+    public:
+        State get(size_t line) const
+        {
+            return map_.get(line);
+        }
+
+        void set(size_t line, State state)
+        {
+            map_[line] = state;
+        }
+
+    private:
+        FlatLineMap<State> map_ = FlatLineMap<State>(State::INVALID);
+    };
+
+    // round-robin interleaving of every processor's trace, like the simulator issues it.
+    std::vector<std::pair<size_t, Instruction>> loadTrace(const TraceBenchConfig &config, size_t num_procs)
+    {
+        TraceReader reader(config.directory, num_procs, 64, TraceFormat::TEXT);
+        std::vector<std::pair<size_t, Instruction>> accesses;
+        bool progress = true;
+        while (progress)
+        {
+            progress = false;
+            for (size_t proc = 0; proc < num_procs; proc++)
+            {
+                if (std::optional<Instruction> ins = reader.readNextLine(proc))
+                {
+                    accesses.emplace_back(proc, *ins);
+                    progress = true;
+                }
+            }
+        }
+        return accesses;
+    }
+
+    template <typename Map>
+    void bench(const char *name, const std::vector<std::pair<size_t, Instruction>> &accesses, size_t num_procs, size_t repeat)
+    {
+        size_t probes = 0;
+        size_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t rep = 0; rep < repeat; rep++)
+        {
+            std::vector<Map> caches(num_procs);
+            for (const auto &[proc, ins] : accesses)
+            {
+                bool store = ins.command == OperationType::MEM_STORE;
+                for (size_t other = 0; other < num_procs; other++)
+                {
+                    State state = caches[other].get(ins.address);
+                    checksum += static_cast<size_t>(state);
+                    probes++;
+                    if (other != proc && store && state != State::INVALID)
+                    {
+                        caches[other].set(ins.address, State::INVALID);
+                    }
+                }
+                caches[proc].set(ins.address, store ? State::MODIFIED : State::SHARED);
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        double seconds = elapsed.count();
+        std::cout << name << "\t"
+                  << "Mprobes/s: " << probes / seconds / 1e6 << "\t"
+                  << "ns/access: " << seconds * 1e9 / (accesses.size() * repeat) << "\t"
+                  << "(checksum " << checksum << ")" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    TraceBenchConfig config;
+    parseTraceBenchArgs(argc, argv, config, "linemapbench");
+
+    size_t num_procs = config.num_procs ? config.num_procs : countProcs(config.directory);
+    if (num_procs == 0)
+    {
+        std::cerr << "no traces found in " << config.directory << std::endl;
+        return 255;
+    }
+
+    std::vector<std::pair<size_t, Instruction>> accesses = loadTrace(config, num_procs);
+    bench<NodeMap>("unordered_map", accesses, num_procs, config.repeat);
+    bench<FlatMap>("flat", accesses, num_procs, config.repeat);
+}
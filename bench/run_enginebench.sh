@@ -0,0 +1,32 @@
+#!/bin/bash
+# Simulated accesses/s of the snooping engines, see bench/enginebench.cpp.
+# Usage: bench/run_enginebench.sh <build dir> [baseline build dir] [num_accesses]
+# A baseline build dir holding an mpcsim of an earlier revision also times both
+# simulators end to end on the same generated workloads.
+# Use Release build dirs (cmake -S . -B build -DCMAKE_BUILD_TYPE=Release) for meaningful numbers.
+
+set -e
+
+BUILD_DIR=${1:-build}
+BASELINE_DIR=$2
+ACCESSES=${3:-500000}
+PROCS=8
+
+"$BUILD_DIR/enginebench" --num_procs=$PROCS --num_accesses=$ACCESSES
+
+if [ -z "$BASELINE_DIR" ]; then
+    exit 0
+fi
+
+TIMEFORMAT=%R
+for workload in random producer_consumer false_sharing; do
+    for proto in MI MSI MESI MOESI MESIF; do
+        line="$workload $proto"
+        for build in baseline current; do
+            dir=$([ $build = baseline ] && echo "$BASELINE_DIR" || echo "$BUILD_DIR")
+            seconds=$( { time "$dir/mpcsim" --num_procs=$PROCS --workload=$workload --num_accesses=$ACCESSES --cohertype=snoop --coherproto=$proto --diropt=0 >/dev/null; } 2>&1 )
+            line="$line\t$build Maccesses/s: $(awk "BEGIN { print $PROCS * $ACCESSES / $seconds / 1e6 }")"
+        done
+        echo -e "$line"
+    done
+done
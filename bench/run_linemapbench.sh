@@ -0,0 +1,15 @@
+#!/bin/bash
+# Compares the node based and open addressing line state tables on the bundled our_traces patterns.
+# Usage: bench/run_linemapbench.sh <build dir> [repeat]
+# Use a Release build dir (cmake -S . -B build -DCMAKE_BUILD_TYPE=Release) for meaningful numbers.
+
+set -e
+
+BUILD_DIR=${1:-build}
+REPEAT=${2:-200}
+ROOT_DIR=$(cd "$(dirname "$0")/.." && pwd)
+
+for pattern in false_sharing multiple_readers multiple_writers no_sharing producer_consumer producer_consumer_high_sharers random; do
+    echo "== $pattern"
+    "$BUILD_DIR/linemapbench" --directory="$ROOT_DIR/our_traces/$pattern" --repeat="$REPEAT"
+done
@@ -0,0 +1,23 @@
+#!/bin/bash
+# Compares bytes/access and decode speed of every trace format on the bundled our_traces patterns.
+# Usage: bench/run_tracebench.sh <build dir> [repeat]
+# Use a Release build dir (cmake -S . -B build -DCMAKE_BUILD_TYPE=Release) for meaningful numbers.
+
+set -e
+
+BUILD_DIR=${1:-build}
+REPEAT=${2:-200}
+ROOT_DIR=$(cd "$(dirname "$0")/.." && pwd)
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+for pattern in false_sharing multiple_readers multiple_writers no_sharing producer_consumer producer_consumer_high_sharers random; do
+    dir="$WORK_DIR/$pattern"
+    mkdir -p "$dir"
+    cp "$ROOT_DIR/our_traces/$pattern"/*.txt "$dir"
+    "$BUILD_DIR/tracecvt" --input="$dir" --output="$dir" --format=binary > /dev/null
+    "$BUILD_DIR/tracecvt" --input="$dir" --output="$dir" --format=compressed > /dev/null
+    "$BUILD_DIR/tracecvt" --input="$dir" --output="$dir" --format=container > /dev/null
+    echo "== $pattern"
+    "$BUILD_DIR/tracebench" --directory="$dir" --repeat="$REPEAT"
+done
@@ -0,0 +1,90 @@
+#include "trace.hpp"
+#include "benchargs.hpp"
+#include "tracecodec.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+// Measures trace decode throughput of every TraceReader format available for a trace directory.
+// Usage: tracebench --directory=our_traces/random [--num_procs=8] [--repeat=200]
+// Build with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+
+using namespace csim;
+
+namespace
+{
+    size_t traceBytes(const std::filesystem::path &dir, size_t num_procs, const std::string &ext)
+    {
+        if (ext.empty())
+        {
+            // single file holding every processor
+            std::filesystem::path file = dir / CONTAINER_TRACE_FILE;
+            return std::filesystem::exists(file) ? std::filesystem::file_size(file) : 0;
+        }
+
+        size_t bytes = 0;
+        for (size_t proc = 0; proc < num_procs; proc++)
+        {
+            std::filesystem::path file = dir / (std::to_string(proc) + ext);
+            if (!std::filesystem::exists(file))
+            {
+                return 0;
+            }
+            bytes += std::filesystem::file_size(file);
+        }
+        return bytes;
+    }
+
+    void bench(const TraceBenchConfig &config, size_t num_procs, TraceFormat format, const std::string &ext)
+    {
+        size_t bytes = traceBytes(config.directory, num_procs, ext);
+        if (bytes == 0)
+        {
+            return;
+        }
+
+        size_t accesses = 0;
+        size_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t rep = 0; rep < config.repeat; rep++)
+        {
+            TraceReader reader(config.directory, num_procs, 64, format);
+            for (size_t proc = 0; proc < num_procs; proc++)
+            {
+                while (std::optional<Instruction> ins = reader.readNextLine(proc))
+                {
+                    checksum += ins->address;
+                    accesses++;
+                }
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        double seconds = elapsed.count();
+        std::cout << format << "\t"
+                  << "bytes/access: " << (double)bytes / (accesses / config.repeat) << "\t"
+                  << "MB/s: " << (double)bytes * config.repeat / seconds / 1e6 << "\t"
+                  << "Maccesses/s: " << accesses / seconds / 1e6 << "\t"
+                  << "(checksum " << checksum << ")" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    TraceBenchConfig config;
+    parseTraceBenchArgs(argc, argv, config, "tracebench");
+
+    size_t num_procs = config.num_procs ? config.num_procs : countProcs(config.directory);
+    if (num_procs == 0)
+    {
+        std::cerr << "no traces found in " << config.directory << std::endl;
+        return 255;
+    }
+
+    bench(config, num_procs, TraceFormat::TEXT_STREAM, ".txt");
+    bench(config, num_procs, TraceFormat::TEXT, ".txt");
+    bench(config, num_procs, TraceFormat::BINARY, ".bin");
+    bench(config, num_procs, TraceFormat::COMPRESSED, ".ctr");
+    bench(config, num_procs, TraceFormat::CONTAINER, "");
+}
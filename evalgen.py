@@ -39,6 +39,8 @@ ACCESS_PATTERNS = ["false_sharing", "producer_consumer", "multiple_writers",
                   "multiple_readers", "random", "no_sharing"]
 PROCESSOR_COUNTS = [4, 8, 16, 32, 64, 128]
 NUM_ACCESSES = 50
+SYNTHETIC = False
+SEED = 42
 
 RESULTS_DIR = "evaluation_results"
 
@@ -59,7 +61,7 @@ def generate_traces(pattern, num_procs, num_accesses, cache_line_size=64):
     print(f"Generating traces: {' '.join(cmd)}")
     subprocess.run(cmd, check=True)
 
-def run_mpcsim(protocol, coherence_type, num_procs, directory="traces_temp", diropt=False):
+def run_mpcsim(protocol, coherence_type, num_procs, directory="traces_temp", diropt=False, pattern=None):
     cmd = [
         "./mpcsim",
         f"--num_procs={num_procs}",
@@ -68,6 +70,9 @@ def run_mpcsim(protocol, coherence_type, num_procs, directory="traces_temp", dir
         f"--cohertype={coherence_type}",
         f"--diropt={str(diropt).lower()}",
     ]
+    # mpcsim generates the pattern itself instead of reading traces_temp
+    if pattern is not None:
+        cmd += [f"--workload={pattern}", f"--num_accesses={NUM_ACCESSES}", f"--seed={SEED}"]
     
     print(f"Running: {' '.join(cmd)}")
     try:
@@ -84,16 +89,18 @@ def parse_mpcsim_output(output):
         "interconnect": {}
     }
     
-    proc_pattern = r"PROCESSOR (\d+)\nHITS:\s+(\d+)\nMISSES:\s+(\d+)\nCOHERENCE:\s+(\d+)"
+    proc_pattern = r"PROCESSOR (\d+)\nHITS:\s+(\d+)\nMISSES:\s+(\d+)\nCOHERENCE:\s+(\d+)(?:\nCAPACITY:\s+(\d+)\nWRITEBACKS:\s+(\d+))?"
     matches = re.finditer(proc_pattern, output)
     
     for match in matches:
-        proc, hits, misses, evictions = match.groups()
+        proc, hits, misses, evictions, capacity, writebacks = match.groups()
         results["processors"].append({
             "id": int(proc),
             "hits": int(hits),
             "misses": int(misses),
-            "evictions": int(evictions)
+            "evictions": int(evictions),
+            "capacity_evictions": int(capacity or 0),
+            "writebacks": int(writebacks or 0)
         })
     
     interconnect_pattern = r"INTERCONNECT\nTRAFFIC:\s+(\d+)\nCACHE CONTROL TRAFFIC:\s+(\d+)\nCACHE DATA TRAFFIC:\s+(\d+)\nMEMORY DATA TRAFFIC:\s+(\d+)"
@@ -110,6 +117,16 @@ def parse_mpcsim_output(output):
 
         # print(match)
     
+    directory_pattern = r"FORWARDED REQUESTS:\s+(\d+)\nAVERAGE HOPS:\s+([\d.]+)"
+    match = re.search(directory_pattern, output)
+    
+    if match:
+        forwards, average_hops = match.groups()
+        results["directory"] = {
+            "forwarded_requests": int(forwards),
+            "average_hops": float(average_hops)
+        }
+    
     config_pattern = r"No of Processors: (\d+)\nDirectory: (.*)\nCoherence Type: (.*)\nCoherence Protocol: (.*)\nCache Line Size: (\d+)\nCache Size: (\d+)"
     match = re.search(config_pattern, output)
     
@@ -132,16 +149,18 @@ def run_full_evaluation(output_dir=RESULTS_DIR):
     results = []
     for pattern in ACCESS_PATTERNS:
         for num_procs in PROCESSOR_COUNTS:
-            try:
-                generate_traces(pattern, num_procs, NUM_ACCESSES)
-            except Exception as e:
-                print(f"Failed to generate traces for {pattern} with {num_procs} processors: {e}")
-                continue
+            workload = pattern if SYNTHETIC else None
+            if not SYNTHETIC:
+                try:
+                    generate_traces(pattern, num_procs, NUM_ACCESSES)
+                except Exception as e:
+                    print(f"Failed to generate traces for {pattern} with {num_procs} processors: {e}")
+                    continue
                 
             coherence_type = "SNOOP"
             for protocol in PROTOCOLS:
                 try:
-                    sim_results = run_mpcsim(protocol, coherence_type, num_procs)
+                    sim_results = run_mpcsim(protocol, coherence_type, num_procs, pattern=workload)
                     sim_results["access_pattern"] = pattern
                     sim_results["diropt"] = False
                     results.append(sim_results)
@@ -163,7 +182,7 @@ def run_full_evaluation(output_dir=RESULTS_DIR):
             
             for diropt in [False, True]:
                 try:
-                    sim_results = run_mpcsim(protocol, coherence_type, num_procs, diropt=diropt)
+                    sim_results = run_mpcsim(protocol, coherence_type, num_procs, diropt=diropt, pattern=workload)
                     sim_results["access_pattern"] = pattern
                     sim_results["diropt"] = diropt
                     results.append(sim_results)
@@ -211,6 +230,8 @@ def process_results(results):
         cache_data_traffic = interconnect.get("cache_data_traffic", 0)
         memory_data_traffic = interconnect.get("memory_data_traffic", 0)
         
+        directory = result.get("directory", {})
+        
         traffic_per_op = total_traffic / total_memory_ops if total_memory_ops > 0 else 0
         data_ratio = cache_data_traffic / total_traffic if total_traffic > 0 else 0
         
@@ -231,7 +252,9 @@ def process_results(results):
             "cache_data_traffic": int(cache_data_traffic),
             "memory_data_traffic": int(memory_data_traffic),
             "traffic_per_memory_op": float(traffic_per_op),
-            "data_to_total_traffic_ratio": float(data_ratio)
+            "data_to_total_traffic_ratio": float(data_ratio),
+            "forwarded_requests": int(directory.get("forwarded_requests", 0)),
+            "average_hops": float(directory.get("average_hops", 0))
         }
         
         processed_data.append(row)
@@ -241,7 +264,8 @@ def process_results(results):
     numeric_cols = ["num_procs", "total_hits", "total_misses", "total_evictions", 
                     "hit_rate", "miss_rate", "eviction_rate", "total_traffic", 
                     "cache_control_traffic", "cache_data_traffic", "memory_data_traffic", 
-                    "traffic_per_memory_op", "data_to_total_traffic_ratio"]
+                    "traffic_per_memory_op", "data_to_total_traffic_ratio",
+                    "forwarded_requests", "average_hops"]
     
     for col in numeric_cols:
         if col in df.columns:
@@ -455,6 +479,22 @@ def create_plots(df, output_dir=RESULTS_DIR):
         
         safe_plot(plot_dir_optimization, "directory_optimization_impact.png",
                  "Impact of Directory Optimization on Traffic (False Sharing Pattern)")
+        
+        # forwarding moves data off the home, the win is a shorter critical path
+        def plot_dir_optimization_hops():
+            pattern = "false_sharing"
+            pattern_dir_df = dir_df[dir_df["access_pattern"] == pattern]
+            
+            procs_df = pattern_dir_df[pattern_dir_df["num_procs"] == 8]
+            
+            sns.barplot(x="diropt", y="average_hops", data=procs_df)
+            plt.xlabel("Directory Optimization", fontsize=16, weight='bold')
+            plt.ylabel("Average Hops per Request", fontsize=16, weight='bold')
+            plt.xticks([0, 1], ["Off", "On"], fontsize=14)
+            plt.yticks(fontsize=14)
+        
+        safe_plot(plot_dir_optimization_hops, "directory_optimization_hops.png",
+                 "Impact of Directory Optimization on Latency (False Sharing Pattern)")
     
     compare_df = df[(df["coherence_protocol"].isin(["MESI", "MSI"])) & 
                    (df["coherence_type"] == "SNOOP")]
@@ -684,7 +724,7 @@ def analyze_protocol_metrics(df, output_dir=RESULTS_DIR):
     return analysis
 
 def main():
-    global PROCESSOR_COUNTS, ACCESS_PATTERNS, PROTOCOLS, COHERENCE_TYPES
+    global PROCESSOR_COUNTS, ACCESS_PATTERNS, PROTOCOLS, COHERENCE_TYPES, NUM_ACCESSES, SYNTHETIC, SEED
     
     parser = argparse.ArgumentParser(description="Cache Coherence Protocol Evaluation")
     parser.add_argument("--skip-run", action="store_true", help="Skip running simulations and use existing results")
@@ -696,6 +736,9 @@ def main():
                       help="Specific protocols to test (default: all)")
     parser.add_argument("--coherence-types", nargs='+', choices=COHERENCE_TYPES, 
                       help="Specific coherence types to test (default: all)")
+    parser.add_argument("--synthetic", action="store_true", help="Generate workloads inside mpcsim instead of calling tracegen.py")
+    parser.add_argument("--num-accesses", type=int, default=NUM_ACCESSES, help="Accesses per processor")
+    parser.add_argument("--seed", type=int, default=SEED, help="Seed for --synthetic workloads")
     args = parser.parse_args()
     
     output_dir = args.output_dir
@@ -720,6 +763,9 @@ def main():
             return
     else:
         ACCESS_PATTERNS = patterns_to_test
+        NUM_ACCESSES = args.num_accesses
+        SYNTHETIC = args.synthetic
+        SEED = args.seed
         PROTOCOLS = protocols_to_test
         COHERENCE_TYPES = coherence_types_to_test
         
@@ -3,6 +3,9 @@
 #include <string>
 #include <vector>
 #include "cache.hpp"
+#include "synthetic.hpp"
+#include "hierarchy.hpp"
+#include "sharers.hpp"
 
 namespace csim
 {
@@ -12,9 +15,55 @@ namespace csim
         std::string directory;
         CoherenceType cohertype;
         CoherenceProtocol coherproto;
+        std::string protocol_spec; // snoop protocol transitions read from this file instead of the built-in coherproto
         size_t cache_line_size = 64;
-        size_t cache_size = 8192;
-        bool diropt;
+        size_t cache_size = 8192; // bytes per private cache, 0 = unbounded
+        size_t cache_assoc = 8;   // ways per set, 0 = fully associative
+        ReplacementPolicy replacement = ReplacementPolicy::LRU;
+        size_t cache_latency = 10;
+        size_t l1_size = 0; // bytes of private L1 in front of every cache, 0 = none
+        size_t l1_assoc = 8;
+        size_t l1_latency = 2;
+        size_t llc_size = 0; // bytes of last-level cache shared by all processors, 0 = none
+        size_t llc_assoc = 16;
+        size_t llc_latency = 40; // also charged for cache to cache transfers
+        InclusionPolicy llc_inclusion = InclusionPolicy::INCLUSIVE;
+        size_t mem_latency = 200;
+        bool line_states = false; // unbounded snoop caches share one line-major state table
+        SnoopFilterType snoop_filter = SnoopFilterType::NONE;
+        size_t snoop_filter_entries = 16384; // lines tracked by a bounded snoop filter
+        size_t snoop_filter_assoc = 8;
+        size_t victim_entries = 0;    // victim cache lines per finite cache, 0 = none
+        size_t wb_buffer_entries = 0; // writeback buffer lines per finite snoop cache, 0 = none
+        size_t mshrs = 1;        // misses each cache keeps in flight, 1 = blocking
+        size_t miss_latency = 0; // cycles from a miss's coherence transaction to its data
+        size_t max_outstanding = 0; // requests each processor keeps in flight, 0 = one per MSHR
+        SchedulerType scheduler = SchedulerType::EVENT;
+        PrefetcherType prefetcher = PrefetcherType::NONE;
+        size_t prefetch_degree = 1; // lines predicted per trigger by NEXT_LINE and STRIDE
+        bool diropt = false; // forwarded caches answer the requestor directly (3 hops instead of 4)
+        size_t hop_latency = 0; // cycles per message on a directory miss's critical path
+        DirEncoding dir_encoding = DirEncoding::FULL; // how directory entries record their sharers
+        size_t dir_pointers = 4; // sharer pointers per entry of a limited-pointer directory
+        size_t dir_group = 4;    // processors per presence bit of a coarse-vector directory
+        size_t dir_entries = 0;  // lines a sparse directory tracks at once, 0 = every line ever cached
+        size_t dir_assoc = 8;
+        ReplacementPolicy dir_replacement = ReplacementPolicy::LRU;
+        size_t dir_banks = 1;       // home banks the directory is split into
+        size_t dir_interleave = 0;  // bytes of consecutive lines per bank, 0 = one line
+        size_t dir_bank_cycles = 0; // cycles a bank spends on each request, 0 = unlimited
+        TraceFormat trace_format = TraceFormat::TEXT;
+        size_t trace_offset = 0; // instructions skipped at the start of every processor's trace
+        size_t trace_limit = 0;  // instructions simulated per processor, 0 = until the end
+        Workload workload = Workload::NONE; // generate this pattern instead of reading traces from directory
+        size_t num_accesses = 10;           // generated accesses per processor
+        uint64_t seed = 42;
+        std::string stream;         // read one interleaved "<proc> L|S <addr>" trace from this FIFO, "-" for stdin
+        size_t stream_depth = 4096; // instructions buffered per processor while streaming
+        bool remap_lines = false;   // number the trace's lines densely and keep per line state in flat arrays
+        size_t trace_threads = 0; // background trace decoder threads, 0 decodes on the simulation thread
+        size_t trace_depth = 8;   // batches buffered per processor
+        size_t trace_batch = 1024; // instructions per batch
     };
 
     std::vector<std::string> split(const std::string &s, char delimiter);
@@ -8,6 +8,11 @@
 
 namespace csim
 {
+    template <typename Policy>
+    class Hierarchy;
+    template <typename Protocol, typename Policy>
+    class SnoopCaches;
+
     enum class BusState
     {
         PROCESSING,
@@ -21,22 +26,32 @@ namespace csim
         BusState state;
     };
 
+    template <typename Protocol, typename Policy>
     class SnoopBus
     {
     public:
-        SnoopBus(size_t num_proc, SnoopCaches *caches, Stats *stats);
+        SnoopBus(size_t num_proc, SnoopCaches<Protocol, Policy> *caches, Stats *stats);
         void cycle();
         void requestFromCache(BusMsg busmsg);
         void replyFromCache(BusMsg busmsg);
-        void setCaches(SnoopCaches *caches);
+        void writebackFromCache(BusMsg busmsg);
+        void setCaches(SnoopCaches<Protocol, Policy> *caches);
+        void setHierarchy(Hierarchy<Policy> *hierarchy);
         bool isCacheTurn(size_t proc);
+        bool idle() const { return !curr_msg_; }
+        // proc's first turn from cycle from on.
+        size_t nextTurn(size_t proc, size_t from) const;
+        // proc's turns in cycles [from, to).
+        size_t turns(size_t proc, size_t from, size_t to) const;
 
     private:
         size_t num_proc_;
-        size_t turn_;
+        size_t turn_ = 0;
+        size_t turn_cycle_ = 0; // the cycle turn_ is for
         std::optional<CurrMsg> curr_msg_;
-        SnoopCaches *caches_;
+        SnoopCaches<Protocol, Policy> *caches_;
         Stats *stats_;
+        Hierarchy<Policy> *hierarchy_ = nullptr;
     };
 
 }
\ No newline at end of file
@@ -4,10 +4,8 @@
 
 namespace csim
 {
-    class SnoopCaches;
-
-
     const size_t BROADCAST = 1000;
+    const size_t MEMORY = 2000;
 
     enum class BusMsgType
     {
@@ -16,7 +14,9 @@ namespace csim
         UPGRADE,
         DATA,
         SHARED,
-        MEMDATA
+        MEMDATA,
+        MEMSHARED, // memory provided the data, but another cache holds a clean copy
+        WRITEBACK  // a dirty line evicted to memory
     };
 
     struct BusMsg
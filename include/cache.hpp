@@ -8,47 +8,145 @@
 #include "cpumsg.hpp"
 #include "dirmsg.hpp"
 #include "statistics.hpp"
-#include <unordered_map>
 #include <list>
+#include <deque>
+#include "cachearray.hpp"
+#include "linemap.hpp"
+#include "replacement.hpp"
+#include "prefetcher.hpp"
+#include "protocol.hpp"
+#include "scheduler.hpp"
+#include "snoopfilter.hpp"
 
 namespace csim
 {
+    template <typename Protocol, typename Policy>
     class SnoopBus;
+    template <typename Protocol, typename Policy>
     class Directory;
+    template <typename Policy>
+    class Hierarchy;
 
-    enum class CoherenceState
+    enum class CoherenceType 
     {
-        MODIFIED,
-        INVALID,
-        SHARED,
-        EXCLUSIVE,
-        OWNED,
-        FORWARDER
+        SNOOP,
+        DIRECTORY
     };
+    std::ostream &operator<<(std::ostream &os, const CoherenceType &type);
+
+    // Small fully associative buffer of lines replaced from a cache's sets. Its lines are
+    // still in the cache as far as coherence is concerned, they only leave for real
+    // (evictLine) when pushed out of the buffer. Kept most recently used first.
+    class VictimCache
+    {
+    public:
+        explicit VictimCache(size_t num_entries);
+
+        CoherenceState get(size_t address) const;
+        // Changes the state of a buffered line, INVALID drops it. Returns false if the
+        // line is not buffered.
+        bool update(size_t address, CoherenceState state);
+        // Removes a buffered line to move it back into the sets.
+        std::optional<CacheLine> take(size_t address);
+        // Buffers a replaced line. Returns the least recently replaced line if full.
+        std::optional<CacheLine> insert(const CacheLine &line);
 
-    std::ostream &operator<<(std::ostream &os, const CoherenceState &state);
+    private:
+        size_t num_entries_;
+        std::vector<CacheLine> lines_;
+    };
 
-    enum class CoherenceProtocol
+    // Dirty lines waiting for an idle interconnect to be written back, oldest first.
+    // Writebacks take no bus cycles, so the buffer changes which copy answers snoops and
+    // which writebacks reach memory, not timing.
+    class WritebackBuffer
     {
-        MI,
-        MSI,
-        MESI,
-        MOESI,
-        MESIF
+    public:
+        explicit WritebackBuffer(size_t num_entries);
+
+        bool holds(size_t address) const;
+        bool empty() const { return lines_.empty(); }
+        bool full() const { return lines_.size() == num_entries_; }
+        void push(size_t address);
+        size_t pop();
+        void erase(size_t address);
+
+    private:
+        size_t num_entries_;
+        std::deque<size_t> lines_;
     };
-    std::ostream &operator<<(std::ostream &os, const CoherenceProtocol &state);
 
-    enum class CoherenceType 
+    // A miss in flight: the access that allocated it and the later accesses to the same
+    // line merged into it, oldest first.
+    struct MSHR
     {
-        SNOOP,
-        DIRECTORY
+        size_t address;
+        std::vector<CPUMsg> targets;
+        bool issued;        // the interconnect has the request
+        bool answered;      // the coherence transaction is done, the data is on its way
+        size_t ready_cycle; // the data has arrived, once answered
     };
-    std::ostream &operator<<(std::ostream &os, const CoherenceType &type);
 
+    // Miss status holding registers of a non-blocking cache, in allocation order.
+    class MSHRFile
+    {
+    public:
+        explicit MSHRFile(size_t num_entries);
+
+        MSHR *find(size_t address);
+        bool full() const { return entries_.size() == num_entries_; }
+        size_t size() const { return entries_.size(); }
+        MSHR &allocate(const CPUMsg &cpureq);
+        void release(size_t address);
+        // The oldest miss not sent to the interconnect yet.
+        MSHR *nextToIssue();
+        // The oldest miss whose data has arrived by cycle now.
+        MSHR *nextReady(size_t now);
+        // The cycle the data of the first answered miss arrives, if any.
+        std::optional<size_t> readyCycle() const;
+
+    private:
+        size_t num_entries_;
+        std::vector<MSHR> entries_;
+    };
+
+    // Coherence state of every unbounded cache stored line-major: one record of num_procs
+    // states per line. A snoop broadcast reads and updates a single contiguous record
+    // instead of probing every cache's own table, and the record of the line under
+    // snoop is remembered, so only the first processor pays for the lookup.
+    class LineStates
+    {
+    public:
+        explicit LineStates(size_t num_procs);
+
+        // Addresses are dense line IDs from now on, drops every record.
+        void makeDense(size_t num_lines);
+        CoherenceState get(size_t address, size_t proc);
+        // creates the line's record if needed.
+        CoherenceState &at(size_t address, size_t proc);
+
+    private:
+        size_t num_procs_;
+        LineMap<uint32_t> records_; // line -> record index
+        std::vector<CoherenceState> states_;
+        size_t last_address_;
+        uint32_t last_record_;
+
+        uint32_t findRecord(size_t address);
+    };
+
+    template <typename Policy>
     struct Cache
     {
-        std::unordered_map<size_t, CoherenceState> lines;
-        std::optional<CPUMsg> pending_cpu_req;
+        LineMap<CoherenceState> lines;          // unbounded caches
+        std::optional<CacheArray<Policy>> sets; // finite caches
+        std::optional<VictimCache> victims;
+        std::optional<WritebackBuffer> writebacks;
+        std::deque<CPUMsg> cpu_reqs; // processor requests not looked up yet
+        MSHRFile mshrs;
+        std::optional<size_t> pending_prefetch; // line being prefetched in an idle slot
+        size_t stepped;                         // cycles whose per cycle statistics are in
+        bool stalled;                           // the oldest request waits for a free MSHR
     };
 
     class Caches
@@ -56,73 +154,154 @@ namespace csim
     public:
         virtual void cycle() = 0;
         virtual void requestFromProcessor(CPUMsg cpumsg) = 0;
+        // Removes every private copy of address, writing dirty ones back. Returns the
+        // number of copies removed.
+        virtual size_t backInvalidate(size_t address) = 0;
     };
 
-    class SnoopCaches : public Caches
+    // Snooping caches running Protocol, a BuiltinProtocol or a SpecProtocol, whose finite
+    // sets replace lines by Policy. Each protocol and policy gets its own engine, so the
+    // processors, caches and bus call each other directly and the protocol's transitions
+    // and the policy's updates can be folded into them.
+    template <typename Protocol, typename Policy>
+    class SnoopCaches final : public Caches
     {
     public:
-        SnoopCaches(size_t num_procs, SnoopBus *snoopbus, CPUS *cpus, CoherenceProtocol coherproto, Stats *stats);
+        SnoopCaches(size_t num_procs, SnoopBus<Protocol, Policy> *snoopbus, CPUS<SnoopCaches> *cpus, Protocol protocol, Stats *stats, const CacheGeometry &geometry);
         void cycle();
+        // proc's part of a cycle: it completes the misses whose data has arrived and, in
+        // its bus turn, looks up the processor's requests and sends a miss or a prefetch.
+        void step(size_t proc);
+        // The bus' part of a cycle, after every cache's.
+        void stepInterconnect();
         void requestFromProcessor(CPUMsg cpumsg);
         void requestFromBus(BusMsg busmsg);
         void replyFromBus(BusMsg busmsg);
-        void setBus(SnoopBus *snoopbus);
-        void setCPUs(CPUS *cpus);
+        void setBus(SnoopBus<Protocol, Policy> *snoopbus);
+        void setCPUs(CPUS<SnoopCaches> *cpus);
+        void setHierarchy(Hierarchy<Policy> *hierarchy);
+        void setLineAddresses(const std::vector<size_t> &addresses);
+        size_t backInvalidate(size_t address);
+        // Moves unbounded caches' states into one line-major table, call before simulating.
+        void useLineStates();
+        // Tracks which caches hold each line so the bus can skip the others, call before simulating.
+        void useSnoopFilter(SnoopFilterType type, size_t num_sets, size_t assoc, size_t line_size);
+        const SnoopFilter *snoopFilter() const;
+        // Buffers for finite caches, call before simulating.
+        void useVictimCache(size_t num_entries);
+        void useWritebackBuffer(size_t num_entries);
+        // Writes back one buffered line while the bus is idle.
+        void drainWriteback();
+        // Writes back every buffered line, at the end of the simulation.
+        void flushWritebacks();
+        // Prefetches into every cache in bus turns it leaves unused, call before simulating.
+        void usePrefetcher(PrefetcherType type, size_t degree, size_t line_size);
+        // Lets every cache keep num_entries misses in flight, each answered miss_latency
+        // cycles after its bus transaction. Call before simulating.
+        void useMSHRs(size_t num_entries, size_t miss_latency);
+        // Steps caches only in the cycles they have work in and the bus only while it
+        // carries a request or drains writebacks. Call before simulating.
+        void useScheduler(EventScheduler *events);
+        // Adds the statistics sampled every cycle for the cycles up to now each cache sat
+        // out, at the end of the simulation.
+        void sampleSkipped();
+        // Whether a bus request for address has to be forwarded to proc.
+        bool deliverSnoop(size_t address, size_t proc);
+        bool hasCopy(size_t address, size_t except_proc);
 
     private:
         size_t num_procs_;
-        SnoopBus *snoopbus_;
-        CPUS *cpus_;
-        std::vector<Cache> caches_;
-        CoherenceProtocol coherproto_;
+        SnoopBus<Protocol, Policy> *snoopbus_;
+        CPUS<SnoopCaches> *cpus_;
+        std::vector<Cache<Policy>> caches_;
+        std::optional<LineStates> line_states_;
+        std::optional<SnoopFilter> snoop_filter_;
+        Hierarchy<Policy> *hierarchy_ = nullptr;
+        size_t drain_proc_ = 0; // next writeback buffer to drain
+        std::vector<Prefetcher> prefetchers_;
+        size_t miss_latency_ = 0;
+        EventScheduler *events_ = nullptr;
+        Protocol protocol_;
         Stats *stats_;
 
         bool isAHit(CPUMsg &cpureq, size_t proc);
+        bool accessLine(CPUMsg &cpureq, size_t proc);
         CoherenceState getCoherenceState(size_t address, size_t proc);
         void setCoherenceState(size_t address, CoherenceState newstate, size_t proc);
-
-        std::optional<BusMsg> requestFromBusMI(BusMsg &busreq, size_t proc);
-        CPUMsg replyFromBusMI(BusMsg &busresp, size_t proc);
-        bool isAHitMI(CPUMsg &cpureq, size_t proc);
-
-        std::optional<BusMsg> requestFromBusMSI(BusMsg &busreq, size_t proc);
-        CPUMsg replyFromBusMSI(BusMsg &busresp, size_t proc);
-        bool isAHitMSI(CPUMsg &cpureq, size_t proc);
-
-        std::optional<BusMsg> requestFromBusMESI(BusMsg &busreq, size_t proc);
-        CPUMsg replyFromBusMESI(BusMsg &busresp, size_t proc);
-        bool isAHitMESI(CPUMsg &cpureq, size_t proc);
-
-        std::optional<BusMsg> requestFromBusMOESI(BusMsg &busreq, size_t proc);
-        CPUMsg replyFromBusMOESI(BusMsg &busresp, size_t proc);
-        bool isAHitMOESI(CPUMsg &cpureq, size_t proc);
-
-        std::optional<BusMsg> requestFromBusMESIF(BusMsg &busreq, size_t proc);
-        CPUMsg replyFromBusMESIF(BusMsg &busresp, size_t proc);
-        bool isAHitMESIF(CPUMsg &cpureq, size_t proc);
+        void touchLine(size_t address, size_t proc);
+        void evictLine(const CacheLine &victim, size_t proc);
+        void sendWriteback(size_t address, size_t proc);
+        void issuePrefetch(size_t proc);
+        void flushWriteback(size_t address, size_t proc);
+        void issueMiss(MSHR &mshr, size_t proc);
+        void completeMisses(size_t proc);
+        void schedule(size_t proc, size_t from);
+        void sampleSkipped(size_t proc);
+        bool buffersWritebacks() const;
+        void updateSnoopFilter(size_t address, CoherenceState oldstate, CoherenceState newstate, size_t proc);
     };
 
-    class DirectoryCaches : public Caches
+    // Caches kept coherent by a Directory running the same built-in Protocol, one engine
+    // per protocol and replacement policy like SnoopCaches.
+    template <typename Protocol, typename Policy>
+    class DirectoryCaches final : public Caches
     {
     public:
-        DirectoryCaches(size_t num_procs, Directory *directory, CPUS *cpus, Stats *stats);
+        DirectoryCaches(size_t num_procs, Directory<Protocol, Policy> *directory, CPUS<DirectoryCaches> *cpus, Protocol protocol, Stats *stats, const CacheGeometry &geometry);
         void cycle();
+        // proc's part of a cycle: it completes the misses whose data has arrived, looks up
+        // the processor's requests and sends a miss or a prefetch.
+        void step(size_t proc);
+        // The directory answers every request as it is made, it has no cycle of its own.
+        void stepInterconnect() {}
         void requestFromProcessor(CPUMsg cpureq);
-        void requestFromDirectory(DirMsg dirreq);
+        // Returns whether proc held the line dirty, its data then also has to reach memory.
+        bool requestFromDirectory(DirMsg dirreq);
         void replyFromDirectory(DirMsg dirresp);
-        void setDirectory(Directory *directory);
-        void setCPUs(CPUS *cpus);
+        void setDirectory(Directory<Protocol, Policy> *directory);
+        void setCPUs(CPUS<DirectoryCaches> *cpus);
+        void setHierarchy(Hierarchy<Policy> *hierarchy);
+        void setLineAddresses(const std::vector<size_t> &addresses);
+        size_t backInvalidate(size_t address);
+        // Buffers lines replaced from finite caches, call before simulating.
+        void useVictimCache(size_t num_entries);
+        // Prefetches into every cache in cycles it does not use the directory, call before simulating.
+        void usePrefetcher(PrefetcherType type, size_t degree, size_t line_size);
+        // Lets every cache keep num_entries misses in flight, each answered miss_latency
+        // cycles after the directory's reply arrives. Call before simulating.
+        void useMSHRs(size_t num_entries, size_t miss_latency);
+        // Steps caches only in the cycles they have work in, call before simulating.
+        void useScheduler(EventScheduler *events);
+        // Adds the statistics sampled every cycle for the cycles up to now each cache sat
+        // out, at the end of the simulation.
+        void sampleSkipped();
+        // Whether a cache in [first_proc, last_proc) other than except_proc holds address.
+        bool hasCopy(size_t address, size_t first_proc, size_t last_proc, size_t except_proc);
 
     private:
         size_t num_procs_;
-        CPUS *cpus_;
-        Directory *directory_;
-        std::vector<Cache> caches_;
+        CPUS<DirectoryCaches> *cpus_;
+        Directory<Protocol, Policy> *directory_;
+        Protocol protocol_; // hits, fills and the answers to directory requests
+        std::vector<Cache<Policy>> caches_;
         Stats *stats_;
+        Hierarchy<Policy> *hierarchy_ = nullptr;
+        std::vector<Prefetcher> prefetchers_;
+        size_t miss_latency_ = 0;
+        EventScheduler *events_ = nullptr;
 
         bool isAHit(CPUMsg &cpureq, size_t proc);
+        bool accessLine(CPUMsg &cpureq, size_t proc);
         CoherenceState getCoherenceState(size_t address, size_t proc);
         void setCoherenceState(size_t address, CoherenceState newstate, size_t proc);
+        void touchLine(size_t address, size_t proc);
+        void evictLine(const CacheLine &victim, size_t proc);
+        void notifyDirectory(size_t address, CoherenceState state, size_t proc);
+        void issuePrefetch(size_t proc);
+        void issueMiss(MSHR &mshr, size_t proc);
+        void completeMisses(size_t proc);
+        void schedule(size_t proc, size_t from);
+        void sampleSkipped(size_t proc);
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cassert>
+#include <optional>
+#include <vector>
+#include "protocol.hpp"
+#include "replacement.hpp"
+
+namespace csim
+{
+    // Shape of every private cache. num_sets == 0 keeps every line ever touched, so there
+    // are no capacity misses.
+    struct CacheGeometry
+    {
+        size_t num_sets;
+        size_t assoc;
+        size_t line_size;
+        ReplacementPolicy replacement;
+    };
+
+    struct CacheLine
+    {
+        size_t address;
+        CoherenceState state;
+    };
+
+    // A finite set-associative cache: num_sets x assoc ways of tags and states in flat
+    // arrays. Invalid ways are free, Policy picks the victim once a set is full. The
+    // policy is a template parameter of the whole engine, picked once at startup, so
+    // every lookup compiles down to the search of one set.
+    template <typename Policy>
+    class CacheArray
+    {
+    public:
+        explicit CacheArray(const CacheGeometry &geometry)
+            : num_sets_(geometry.num_sets), assoc_(geometry.assoc), line_size_(geometry.line_size),
+              tags_(geometry.num_sets * geometry.assoc, 0),
+              states_(geometry.num_sets * geometry.assoc, CoherenceState::INVALID),
+              policy_(geometry.num_sets, geometry.assoc)
+        {
+            assert(num_sets_ > 0 && assoc_ > 0);
+        }
+
+        CoherenceState get(size_t address) const
+        {
+            size_t way = find(address);
+            return way == NO_WAY ? CoherenceState::INVALID : states_[way];
+        }
+
+        // Looks up an access to address. hit maps the state of a resident line to the one
+        // the access leaves it in, INVALID if the access misses. A hit is recorded and its
+        // state stored in the same search. Returns the state the access left the line in,
+        // INVALID on a miss.
+        template <typename Hit>
+        CoherenceState access(size_t address, Hit hit)
+        {
+            size_t way = find(address);
+            if (way == NO_WAY)
+            {
+                return CoherenceState::INVALID;
+            }
+            CoherenceState next = hit(states_[way]);
+            if (next != CoherenceState::INVALID)
+            {
+                states_[way] = next;
+                policy_.onHit(way / assoc_, way % assoc_);
+            }
+            return next;
+        }
+
+        // Records a hit on address if it is resident. Returns its state, INVALID if not.
+        CoherenceState touch(size_t address)
+        {
+            return access(address, [](CoherenceState state)
+                          { return state; });
+        }
+
+        // Changes the state of a resident line, or allocates a way for it. Returns the
+        // valid line it replaced, if any.
+        std::optional<CacheLine> set(size_t address, CoherenceState state)
+        {
+            size_t way = find(address);
+            if (way != NO_WAY)
+            {
+                states_[way] = state;
+                return std::nullopt;
+            }
+            if (state == CoherenceState::INVALID)
+            {
+                return std::nullopt;
+            }
+
+            // take a free way, otherwise let the policy choose.
+            size_t set = setOf(address);
+            size_t base = set * assoc_;
+            size_t victim = NO_WAY;
+            for (size_t w = 0; w < assoc_; w++)
+            {
+                if (states_[base + w] == CoherenceState::INVALID)
+                {
+                    victim = w;
+                    break;
+                }
+            }
+
+            std::optional<CacheLine> evicted;
+            if (victim == NO_WAY)
+            {
+                victim = policy_.victim(set);
+                evicted = CacheLine{.address = tags_[base + victim], .state = states_[base + victim]};
+            }
+            tags_[base + victim] = address;
+            states_[base + victim] = state;
+            policy_.onFill(set, victim);
+            return evicted;
+        }
+
+        // Addresses are line IDs of a remapped trace, index sets by the original addresses.
+        void setLineAddresses(const std::vector<size_t> *addresses)
+        {
+            line_addresses_ = addresses;
+        }
+
+    private:
+        static const size_t NO_WAY = static_cast<size_t>(-1);
+
+        size_t num_sets_;
+        size_t assoc_;
+        size_t line_size_;
+        std::vector<size_t> tags_;
+        std::vector<CoherenceState> states_;
+        Policy policy_;
+        const std::vector<size_t> *line_addresses_ = nullptr;
+
+        size_t setOf(size_t address) const
+        {
+            size_t line = line_addresses_ ? (*line_addresses_)[address] : address;
+            return (line / line_size_) % num_sets_;
+        }
+
+        // way index, or NO_WAY
+        size_t find(size_t address) const
+        {
+            size_t base = setOf(address) * assoc_;
+            for (size_t way = base; way < base + assoc_; way++)
+            {
+                if (tags_[way] == address && states_[way] != CoherenceState::INVALID)
+                {
+                    return way;
+                }
+            }
+            return NO_WAY;
+        }
+    };
+}
@@ -4,31 +4,44 @@
 #include <vector>
 #include <optional>
 #include "busmsg.hpp"
+#include "scheduler.hpp"
 
 namespace csim
 {
-    class Caches;
-    struct TraceReader;
+    class TraceSource;
 
     struct CPU
     {
         size_t seq_;                        // Strictly Increasing sequence number per processor.
-        std::optional<CPUMsg> pending_req_; // current request being processed.
+        std::vector<CPUMsg> pending_reqs_;  // requests being processed, oldest first.
+        bool done_;                         // the trace has ended, nothing more to issue.
     };
 
+    // The processors, issuing their traces to the private caches of Interconnect, a
+    // SnoopCaches or DirectoryCaches.
+    template <typename Interconnect>
     class CPUS
     {
     public:
-        CPUS(TraceReader *trace_reader, size_t num_procs, Caches *cache);
+        CPUS(TraceSource *trace_source, size_t num_procs, Interconnect *caches);
         bool cycle();
+        // Lets proc issue its next request, if it can. Returns whether it has anything
+        // left to do, requests in flight or a trace to read.
+        bool step(size_t proc);
 
         void replyFromCache(CPUMsg cpumsg);
-        void setCaches(Caches *caches);
+        void setCaches(Interconnect *caches);
+        // Lets every processor keep up to max_outstanding requests in flight.
+        void setMaxOutstanding(size_t max_outstanding);
+        // Steps processors only when they can issue, call before simulating.
+        void useScheduler(EventScheduler *events);
 
     private:
-        TraceReader *trace_reader_; // Trace reader to read traces
+        TraceSource *trace_source_; // Source of the instructions of every processor
         size_t num_procs_;          // Number of processes.
-        Caches *caches_;            // The snoop caches in the system.
+        Interconnect *caches_;      // The private caches in the system.
+        size_t max_outstanding_ = 1;
+        EventScheduler *events_ = nullptr;
         std::vector<CPU> cpus;
     };
 
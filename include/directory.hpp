@@ -1,42 +1,179 @@
 #pragma once
 
-#include <unordered_map>
-#include <unordered_set>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <variant>
+#include <vector>
 #include "dirmsg.hpp"
+#include "linemap.hpp"
+#include "protocol.hpp"
+#include "replacement.hpp"
+#include "sharers.hpp"
 #include "statistics.hpp"
 
 namespace csim
 {
 
+    template <typename Protocol, typename Policy>
     class DirectoryCaches;
+    template <typename Policy>
+    class Hierarchy;
 
-    enum class DirState
+    // owner and forwarder of an entry that has none.
+    const uint16_t NO_PROC = UINT16_MAX;
+
+    enum class DirState : uint8_t
     {
         UNCACHED,
         SHARED,
-        EXCLUSIVE
+        EXCLUSIVE,
+        OWNED // MOESI: owner holds the dirty line, sharers hold clean copies
     };
 
+    // 16 bytes per line, the address is the key it is stored under.
     struct DirEntry
     {
         DirState state;
-        size_t address;
-        std::optional<size_t> owner;
-        std::unordered_set<size_t> sharers;
+        uint16_t owner;
+        uint16_t forwarder; // MESIF: the sharer that supplies the line
+        uint64_t sharers;   // read through the directory's SharerEncoding
+    };
+
+    // Deals lines out to num_banks home banks, granularity consecutive lines at a time.
+    struct Interleave
+    {
+        size_t num_banks;
+        size_t granularity;
+
+        size_t bank(size_t line) const { return (line / granularity) % num_banks; }
+        // line's index among the lines of its bank.
+        size_t local(size_t line) const { return (line / granularity / num_banks) * granularity + line % granularity; }
     };
 
+    // Entries of a sparse directory: num_sets x assoc of them, their tags in a flat array
+    // next to them. Free ways are tagged NO_ADDRESS, the policy picks the victim once a
+    // set is full. Sets are indexed by a line's index within its bank.
+    class DirectoryArray
+    {
+    public:
+        DirectoryArray(size_t num_sets, size_t assoc, size_t line_size, const Interleave &interleave, ReplacementPolicy replacement);
+
+        // The entry of address, nullptr if it has none.
+        DirEntry *find(size_t address);
+        // Records a request to a line with an entry.
+        void touch(size_t address);
+        // The line whose entry address would replace, if its set is full.
+        std::optional<size_t> victim(size_t address);
+        // Gives address a free way of its set.
+        DirEntry &allocate(size_t address, const DirEntry &entry);
+        void release(size_t address);
+        // Addresses are line IDs of a remapped trace, index sets by the original addresses.
+        void setLineAddresses(const std::vector<size_t> *addresses);
+
+    private:
+        using Policies = std::variant<LRUPolicy, PLRUPolicy, SRRIPPolicy, BRRIPPolicy, RandomPolicy, FIFOPolicy>;
+
+        size_t num_sets_;
+        size_t assoc_;
+        size_t line_size_;
+        Interleave interleave_;
+        std::vector<size_t> tags_;
+        std::vector<DirEntry> entries_;
+        Policies policy_;
+        const std::vector<size_t> *line_addresses_ = nullptr;
+
+        static Policies makePolicy(size_t num_sets, size_t assoc, ReplacementPolicy replacement);
+        size_t setOf(size_t address) const;
+        size_t way(size_t address) const; // entry index, or npos
+    };
+
+    // A home node: the entries of the lines interleaved to it and the requests waiting
+    // for it.
+    struct DirBank
+    {
+        LineMap<DirEntry> lines;              // one entry per line ever cached
+        std::optional<DirectoryArray> sparse; // or a bounded set of them
+        size_t tracked;                       // lines with an entry
+        std::deque<size_t> queue;             // cycles its queued requests finish
+    };
+
+    // The home nodes of the lines, answering misses as the built-in Protocol does. What
+    // the protocol's states ask of them is read off its table at compile time. Policy is
+    // the replacement policy of the caches it keeps coherent.
+    template <typename Protocol, typename Policy>
     class Directory
     {
     public:
-        Directory(size_t num_procs, DirectoryCaches *caches, Stats *stats, bool dir_opt);
+        Directory(size_t num_procs, DirectoryCaches<Protocol, Policy> *caches, const SharerEncoding &encoding, Stats *stats, bool dir_opt);
         void requestFromCache(DirMsg dirreq);
+        // Only valid for traces remapped to dense line IDs, addresses maps them back.
+        void setLineAddresses(const std::vector<size_t> &addresses);
+        void setHierarchy(Hierarchy<Policy> *hierarchy);
+        // Tracks lines in num_entries entries of assoc ways instead of one entry per line
+        // ever cached. Replacing an entry invalidates every copy of its line. Call before
+        // simulating.
+        void useSparse(size_t num_entries, size_t assoc, size_t line_size, ReplacementPolicy replacement);
+        // Splits the directory into num_banks banks, interleave bytes of consecutive lines
+        // each, that serve a request every bank_cycles cycles. Call before useSparse.
+        void useBanks(size_t num_banks, size_t interleave, size_t line_size, size_t bank_cycles);
+        // Delays every reply by hop_latency cycles per message on its critical path. Call
+        // before simulating.
+        void useHopLatency(size_t hop_latency);
 
     private:
-        [[maybe_unused]] size_t num_procs_;
-        std::unordered_map<size_t, DirEntry> directory_;
-        DirectoryCaches *caches_;
+        static constexpr const ProtocolTable &TABLE = Protocol::TABLE;
+        // a read of an uncached line gets it exclusively, MSI's readers always share.
+        static constexpr bool EXCLUSIVE_READS = TABLE.fill(BusMsgType::DATA, OperationType::MEM_LOAD) != CoherenceState::SHARED;
+        static constexpr bool SHARES = TABLE.has(CoherenceState::SHARED);      // MI hands the line to every reader
+        static constexpr bool OWNS = TABLE.has(CoherenceState::OWNED);         // an owner keeps a dirty line others share
+        static constexpr bool FORWARDS = TABLE.has(CoherenceState::FORWARDER); // a sharer supplies a shared line
+
+        // What a message carries, each is counted in its own traffic class.
+        enum class Payload
+        {
+            CONTROL,
+            CACHE_DATA,
+            MEMORY_DATA
+        };
+
+        // Where the line a request asked for comes from.
+        enum class DataSource
+        {
+            MEMORY,
+            CACHE, // one of the forwarded or invalidated copies
+            NONE   // an upgrade, the requestor has the line
+        };
+
+        size_t num_procs_;
+        std::vector<DirBank> banks_;
+        Interleave interleave_;
+        size_t line_size_;
+        size_t bank_cycles_ = 0; // 0 = a bank serves any number of requests at once
+        const std::vector<size_t> *line_addresses_ = nullptr;
+        DirectoryCaches<Protocol, Policy> *caches_;
+        SharerEncoding encoding_;
         Stats *stats_;
-        bool dir_opt_;
+        bool dir_opt_; // forwarded caches reply to the requestor, not through the home
+        size_t hop_latency_ = 0;
+        Hierarchy<Policy> *hierarchy_ = nullptr;
+        size_t tracked_ = 0;                              // lines with an entry, in every bank
+        size_t recalling_;                                // line whose entry is being replaced
+        std::vector<LineMap<uint8_t>> recalled_;             // per processor, lines lost to entry replacements and not missed on since
+
+        size_t bankOf(size_t address) const;
+        size_t enqueue(size_t bank, size_t arrival);
         DirState GetState(size_t address);
+        DirEntry lookup(size_t address);
+        DirEntry &entry(size_t address);
+        void track(size_t address, const DirEntry &entry);
+        void untrack(size_t address);
+        void recall(size_t address);
+        bool fromMemory(const DirEntry &entry) const;
+        size_t invalidateCopies(const DirMsg &req);
+        void addSharer(const DirMsg &req, size_t proc);
+        void send(Payload payload, size_t count = 1);
+        size_t sendTransaction(DataSource source, size_t copies, bool writeback);
+        void respond(const DirMsg &req, DirMsgType type, DataSource source, size_t copies, bool writeback = false);
     };
 }
\ No newline at end of file
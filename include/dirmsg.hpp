@@ -16,6 +16,8 @@ namespace csim
         DATA,
         SHARED,
         INVALIDATE,
+        EVICT,     // a cache dropped a clean line
+        WRITEBACK, // a cache dropped a dirty line, data goes to memory
     };
 
     struct DirMsg
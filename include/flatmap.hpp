@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace csim
+{
+    // Open addressing hash table from line address to T. Keys and values share one slot
+    // array probed linearly, so a lookup is one hash and usually one cache line, with no
+    // per entry allocation. Entries are never erased, callers store the missing value
+    // instead, which is also what absent lines read as.
+    template <typename T>
+    class FlatLineMap
+    {
+    public:
+        explicit FlatLineMap(T missing = T{}) : missing_(missing) {}
+
+        // the value stored for line, or nullptr.
+        const T *find(size_t line) const
+        {
+            if (slots_.empty())
+            {
+                return nullptr;
+            }
+            for (size_t i = slotOf(line);; i = (i + 1) & mask_)
+            {
+                const Slot &slot = slots_[i];
+                if (slot.line == line)
+                {
+                    return &slot.value;
+                }
+                if (slot.line == EMPTY)
+                {
+                    return nullptr;
+                }
+            }
+        }
+
+        const T &get(size_t line) const
+        {
+            const T *value = find(line);
+            return value ? *value : missing_;
+        }
+
+        // the value stored for line, inserting the missing value if absent. The reference
+        // is valid until the next insertion.
+        T &operator[](size_t line)
+        {
+            assert(line != EMPTY);
+            if ((size_ + 1) * MAX_LOAD_DEN > slots_.size() * MAX_LOAD_NUM)
+            {
+                grow();
+            }
+            for (size_t i = slotOf(line);; i = (i + 1) & mask_)
+            {
+                Slot &slot = slots_[i];
+                if (slot.line == line)
+                {
+                    return slot.value;
+                }
+                if (slot.line == EMPTY)
+                {
+                    slot.line = line;
+                    slot.value = missing_;
+                    size_++;
+                    return slot.value;
+                }
+            }
+        }
+
+        size_t size() const { return size_; }
+
+        void clear()
+        {
+            slots_.clear();
+            size_ = 0;
+            mask_ = 0;
+            shift_ = 64;
+        }
+
+    private:
+        static constexpr size_t EMPTY = static_cast<size_t>(-1);
+        static constexpr size_t MIN_SLOTS = 16;
+        // grow past 3/4 full, linear probing degrades quickly beyond that.
+        static constexpr size_t MAX_LOAD_NUM = 3;
+        static constexpr size_t MAX_LOAD_DEN = 4;
+
+        struct Slot
+        {
+            size_t line;
+            T value;
+        };
+
+        std::vector<Slot> slots_;
+        size_t size_ = 0;
+        size_t mask_ = 0;
+        unsigned shift_ = 64;
+        T missing_;
+
+        // Fibonacci hashing: line addresses are multiples of the line size and line IDs
+        // are dense, the multiply spreads both over the high bits.
+        size_t slotOf(size_t line) const
+        {
+            return static_cast<size_t>((static_cast<uint64_t>(line) * 0x9E3779B97F4A7C15ull) >> shift_);
+        }
+
+        void grow()
+        {
+            std::vector<Slot> old = std::move(slots_);
+            size_t num_slots = old.empty() ? MIN_SLOTS : old.size() * 2;
+            slots_ = std::vector<Slot>(num_slots, Slot{.line = EMPTY, .value = missing_});
+            mask_ = num_slots - 1;
+            shift_ = 64;
+            while ((size_t(1) << (64 - shift_)) < num_slots)
+            {
+                shift_--;
+            }
+
+            for (Slot &slot : old)
+            {
+                if (slot.line == EMPTY)
+                {
+                    continue;
+                }
+                size_t i = slotOf(slot.line);
+                while (slots_[i].line != EMPTY)
+                {
+                    i = (i + 1) & mask_;
+                }
+                slots_[i].line = slot.line;
+                slots_[i].value = std::move(slot.value);
+            }
+        }
+    };
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <iostream>
+#include <optional>
+#include <vector>
+#include "cache.hpp"
+
+namespace csim
+{
+    enum class InclusionPolicy
+    {
+        INCLUSIVE,    // evicting a line from the LLC removes every private copy
+        NON_INCLUSIVE // the LLC keeps memory fills and writebacks, private copies are independent
+    };
+
+    std::ostream &operator<<(std::ostream &os, const InclusionPolicy &policy);
+
+    struct LevelStats
+    {
+        size_t hits;
+        size_t misses;
+    };
+
+    struct HierarchyConfig
+    {
+        CacheGeometry l1;  // num_sets == 0 means no L1
+        CacheGeometry llc; // num_sets == 0 means no LLC
+        InclusionPolicy llc_inclusion;
+        size_t l1_latency;
+        size_t l2_latency;  // the coherent private cache
+        size_t llc_latency; // leaving the private levels: an LLC lookup or a cache to cache transfer
+        size_t mem_latency;
+    };
+
+    // What the levels around the coherent caches saw. l1 and llc tell whether those
+    // levels exist.
+    struct HierarchyStats
+    {
+        bool l1;
+        bool llc;
+        LevelStats l1_stats;
+        LevelStats l2_stats;
+        LevelStats llc_stats;
+        size_t llc_writebacks;     // dirty lines the LLC sent to memory
+        size_t back_invalidations; // private copies removed by LLC evictions
+        size_t memory_reads;
+        size_t memory_writes;
+        size_t accesses;
+        size_t latency;
+    };
+
+    std::ostream &operator<<(std::ostream &os, const HierarchyStats &stats);
+
+    // Cache levels around the coherent private caches, which are the L2 here. A private
+    // L1 in front of each L2 only holds lines its L2 holds, so whatever the L2 loses to
+    // coherence or capacity leaves the L1 too. An LLC shared by every processor sits
+    // between the interconnect and memory, serving the data memory would have sent and
+    // absorbing writebacks. Each access is charged the latency of the levels it reached.
+    // A miss also completes that many cycles later, hit latencies are only accounted.
+    // The levels replace lines by Policy, like the private caches of the engine.
+    template <typename Policy>
+    class Hierarchy
+    {
+    public:
+        Hierarchy(const HierarchyConfig &config, size_t num_procs, HierarchyStats *stats);
+        void setCaches(Caches *caches);
+        void setLineAddresses(const std::vector<size_t> &addresses);
+
+        // The private caches answered an access without the interconnect.
+        void privateHit(size_t address, size_t proc);
+        // The access has to leave the private caches.
+        void privateMiss(size_t address, size_t proc);
+        // Cycles a miss spends looking up the private levels.
+        size_t missLatency() const;
+        // The L2 of proc received address.
+        void fill(size_t address, size_t proc);
+        // The L2 of proc no longer holds address.
+        void invalidate(size_t address, size_t proc);
+
+        // The interconnect served a private miss, from memory or from another cache.
+        // Returns the cycles it took below the private levels.
+        size_t sharedAccess(size_t address, size_t proc, bool from_memory);
+        // A dirty line left a private cache.
+        void writeback(size_t address);
+
+    private:
+        HierarchyConfig config_;
+        Caches *caches_ = nullptr;
+        std::vector<CacheArray<Policy>> l1s_;
+        std::optional<CacheArray<Policy>> llc_;
+        HierarchyStats *stats_;
+
+        void evictFromLLC(const CacheLine &victim);
+    };
+}
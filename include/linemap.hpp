@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+#include "flatmap.hpp"
+
+namespace csim
+{
+    // Per line state keyed by line address. An open addressing table by default, or a flat vector
+    // indexed by line ID once the trace has been remapped to dense IDs (see RemappedTrace).
+    // Lines that were never written read as the missing value in both modes.
+    template <typename T>
+    class LineMap
+    {
+    public:
+        explicit LineMap(T missing = T{}) : map_(missing), missing_(missing) {}
+
+        // switches to dense storage for line IDs 0 .. num_lines - 1, dropping any state.
+        void makeDense(size_t num_lines)
+        {
+            dense_ = true;
+            map_.clear();
+            values_.assign(num_lines, missing_);
+        }
+
+        const T &get(size_t line) const
+        {
+            if (dense_)
+            {
+                assert(line < values_.size());
+                return values_[line];
+            }
+            return map_.get(line);
+        }
+
+        T &operator[](size_t line)
+        {
+            if (dense_)
+            {
+                assert(line < values_.size());
+                return values_[line];
+            }
+            return map_[line];
+        }
+
+    private:
+        bool dense_ = false;
+        std::vector<T> values_;
+        FlatLineMap<T> map_;
+        T missing_;
+    };
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "trace.hpp"
+
+namespace csim
+{
+    // Preprocessing pass for finite traces: decodes the whole source once, numbers every
+    // distinct line address 0, 1, 2, ... in order of first use, and serves the trace
+    // with each address replaced by its line ID. Per line state can then live in flat
+    // vectors of numLines() entries, address() maps IDs back for reporting.
+    class RemappedTrace : public TraceSource
+    {
+    public:
+        RemappedTrace(TraceSource *trace_source, size_t num_procs);
+        std::optional<Instruction> readNextLine(size_t proc) override;
+
+        size_t numLines() const { return addresses_.size(); }
+        size_t address(uint32_t line_id) const { return addresses_[line_id]; }
+        const std::vector<size_t> &addresses() const { return addresses_; }
+        size_t numRecords() const;
+
+    private:
+        // one (line ID << 1 | store) word per instruction
+        std::vector<std::vector<uint32_t>> records_;
+        std::vector<size_t> cursors_;
+        std::vector<size_t> addresses_;
+    };
+
+    std::ostream &operator<<(std::ostream &os, const RemappedTrace &trace);
+}
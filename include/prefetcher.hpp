@@ -0,0 +1,65 @@
+#pragma once
+
+#include <deque>
+#include <iostream>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "statistics.hpp"
+
+namespace csim
+{
+    enum class PrefetcherType
+    {
+        NONE,
+        NEXT_LINE, // the lines following a miss
+        STRIDE,    // a constant line stride detected within a page, streams are stride 1
+        ADJACENT   // the other line of the aligned pair holding a miss
+    };
+
+    std::ostream &operator<<(std::ostream &os, const PrefetcherType &type);
+
+    // Per processor prefetcher. Demand misses and first hits on prefetched lines train it,
+    // the lines it predicts wait in a small queue until the cache has an idle slot to
+    // fetch one with a coherent read. It also follows every prefetched line until its
+    // first use or its loss, which is what the accuracy, coverage and timeliness in
+    // PrefetchStats are made of.
+    class Prefetcher
+    {
+    public:
+        Prefetcher(PrefetcherType type, size_t degree, size_t line_size, PrefetchStats *stats);
+
+        // A demand access by the owning processor, miss if it left the private cache.
+        void access(size_t address, bool miss);
+        // The next predicted line, the caller drops it if already cached.
+        std::optional<size_t> next();
+        bool idle() const { return queue_.empty(); }
+        // A prefetch of address filled the cache.
+        void filled(size_t address);
+        // The cache lost address, to another processor's request if invalidated.
+        void lost(size_t address, bool invalidated);
+
+    private:
+        struct Stream
+        {
+            size_t page;
+            size_t last_line;
+            long stride;
+            size_t confidence;
+            size_t last_use;
+        };
+
+        PrefetcherType type_;
+        size_t degree_;
+        size_t line_size_;
+        PrefetchStats *stats_;
+        std::deque<size_t> queue_;                  // predicted lines, oldest first
+        std::vector<Stream> streams_;               // STRIDE: recently missed pages
+        std::unordered_map<size_t, size_t> unused_; // prefetched line -> fill cycle
+        size_t accesses_ = 0;
+
+        void train(size_t address);
+        void enqueue(size_t address);
+        Stream &stream(size_t page);
+    };
+}
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "busmsg.hpp"
+#include "protocolspecs.hpp"
+
+namespace csim
+{
+    enum class CoherenceState : uint8_t
+    {
+        MODIFIED,
+        INVALID,
+        SHARED,
+        EXCLUSIVE,
+        OWNED,
+        FORWARDER
+    };
+
+    std::ostream &operator<<(std::ostream &os, const CoherenceState &state);
+
+    enum class CoherenceProtocol
+    {
+        MI,
+        MSI,
+        MESI,
+        MOESI,
+        MESIF
+    };
+    std::ostream &operator<<(std::ostream &os, const CoherenceProtocol &state);
+
+    // What a snooping cache does with a request another processor put on the bus.
+    struct SnoopTransition
+    {
+        CoherenceState next;
+        BusMsgType reply;
+        bool replies;
+        bool defined; // undefined rows are requests the protocol never sees in that state
+    };
+
+    // Ends the program on a malformed spec, source names the spec and word the culprit.
+    [[noreturn]] void specError(std::string_view source, size_t line, std::string_view message, std::string_view word = {});
+
+    // The transitions of a snooping coherence protocol, read from a small text spec.
+    // Every decision the caches make about a line is one lookup in these tables:
+    //
+    //   protocol <name>
+    //   states <state>...                        out of M O E S I F, I required
+    //   snoop <state> <request> -> <next> [<reply>]
+    //   fill <response> <access> -> <next>
+    //   hit <state> <access> [-> <next>]
+    //   upgrade <state>...
+    //
+    // requests are READ, WRITE and UPGRADE, replies DATA and SHARED, responses DATA,
+    // SHARED, MEMDATA and MEMSHARED, accesses LOAD and STORE. Accesses without a hit
+    // row miss, a store missing in an upgrade state sends UPGRADE instead of WRITE.
+    // Lines starting with # are comments. Parsing is constexpr, so the built-in specs
+    // become constant tables at compile time.
+    class ProtocolTable
+    {
+    public:
+        // Parses a spec, a malformed one ends the program. source names it in errors.
+        static constexpr ProtocolTable parse(std::string_view text, std::string_view source);
+        static ProtocolTable load(const std::string &path);
+
+        constexpr std::string_view name() const { return std::string_view(name_.data(), name_length_); }
+        constexpr bool has(CoherenceState state) const { return states_[index(state)]; }
+
+        constexpr const SnoopTransition &snoop(CoherenceState state, BusMsgType request) const
+        {
+            return snoops_[index(state) * NUM_REQUESTS + static_cast<size_t>(request)];
+        }
+        // The state a response fills the line in, INVALID if the protocol never sends it.
+        constexpr CoherenceState fill(BusMsgType response, OperationType access) const
+        {
+            return fills_[(static_cast<size_t>(response) - static_cast<size_t>(BusMsgType::DATA)) * NUM_ACCESSES + static_cast<size_t>(access)];
+        }
+        // The state a hit leaves the line in, INVALID if the access misses.
+        constexpr CoherenceState hit(CoherenceState state, OperationType access) const
+        {
+            return hits_[index(state) * NUM_ACCESSES + static_cast<size_t>(access)];
+        }
+        constexpr bool upgrades(CoherenceState state) const { return upgrades_[index(state)]; }
+
+    private:
+        static const size_t NUM_STATES = 6;    // CoherenceState
+        static const size_t NUM_REQUESTS = 3;  // READ, WRITE, UPGRADE
+        static const size_t NUM_RESPONSES = 4; // DATA, SHARED, MEMDATA, MEMSHARED
+        static const size_t NUM_ACCESSES = 2;  // OperationType
+        static const size_t MAX_NAME = 31;
+        static const size_t MAX_WORDS = 8;
+
+        constexpr ProtocolTable()
+        {
+            states_.fill(false);
+            snoops_.fill(SnoopTransition{.next = CoherenceState::INVALID, .reply = BusMsgType::DATA, .replies = false, .defined = false});
+            fills_.fill(CoherenceState::INVALID);
+            hits_.fill(CoherenceState::INVALID);
+            upgrades_.fill(false);
+        }
+        static constexpr size_t index(CoherenceState state) { return static_cast<size_t>(state); }
+
+        static constexpr std::optional<CoherenceState> parseState(std::string_view word);
+        static constexpr std::optional<BusMsgType> parseMessage(std::string_view word);
+        static constexpr std::optional<OperationType> parseAccess(std::string_view word);
+
+        std::array<char, MAX_NAME> name_{};
+        size_t name_length_ = 0;
+        std::array<bool, NUM_STATES> states_{};
+        std::array<SnoopTransition, NUM_STATES * NUM_REQUESTS> snoops_{};
+        std::array<CoherenceState, NUM_RESPONSES * NUM_ACCESSES> fills_{};
+        std::array<CoherenceState, NUM_STATES * NUM_ACCESSES> hits_{};
+        std::array<bool, NUM_STATES> upgrades_{};
+    };
+
+    std::ostream &operator<<(std::ostream &os, const ProtocolTable &protocol);
+
+    constexpr std::string_view builtinSpec(CoherenceProtocol protocol)
+    {
+        switch (protocol)
+        {
+        case CoherenceProtocol::MI:
+            return MI_SPEC;
+        case CoherenceProtocol::MSI:
+            return MSI_SPEC;
+        case CoherenceProtocol::MESI:
+            return MESI_SPEC;
+        case CoherenceProtocol::MOESI:
+            return MOESI_SPEC;
+        case CoherenceProtocol::MESIF:
+            return MESIF_SPEC;
+        }
+        return MESI_SPEC;
+    }
+
+    // A protocol shipped in protocols/, its table is a compile-time constant so the
+    // engine instantiated for it can fold the lookups.
+    template <CoherenceProtocol P>
+    struct BuiltinProtocol
+    {
+        static constexpr ProtocolTable TABLE = ProtocolTable::parse(builtinSpec(P), "built-in spec");
+        static constexpr const ProtocolTable &table() { return TABLE; }
+    };
+
+    // A protocol loaded from a spec file at startup.
+    struct SpecProtocol
+    {
+        ProtocolTable loaded;
+        const ProtocolTable &table() const { return loaded; }
+    };
+
+    constexpr std::optional<CoherenceState> ProtocolTable::parseState(std::string_view word)
+    {
+        constexpr std::string_view NAMES[] = {"M", "I", "S", "E", "O", "F"};
+        for (size_t i = 0; i < NUM_STATES; i++)
+        {
+            if (word == NAMES[i])
+            {
+                return static_cast<CoherenceState>(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+    constexpr std::optional<BusMsgType> ProtocolTable::parseMessage(std::string_view word)
+    {
+        constexpr std::string_view NAMES[] = {"READ", "WRITE", "UPGRADE", "DATA", "SHARED", "MEMDATA", "MEMSHARED"};
+        for (size_t i = 0; i < std::size(NAMES); i++)
+        {
+            if (word == NAMES[i])
+            {
+                return static_cast<BusMsgType>(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+    constexpr std::optional<OperationType> ProtocolTable::parseAccess(std::string_view word)
+    {
+        if (word == "LOAD")
+        {
+            return OperationType::MEM_LOAD;
+        }
+        if (word == "STORE")
+        {
+            return OperationType::MEM_STORE;
+        }
+        return std::nullopt;
+    }
+
+    constexpr ProtocolTable ProtocolTable::parse(std::string_view text, std::string_view source)
+    {
+        ProtocolTable table;
+        size_t line_no = 0;
+
+        // a state named in a row must have been declared.
+        auto state = [&](std::string_view word)
+        {
+            std::optional<CoherenceState> parsed = parseState(word);
+            if (!parsed)
+            {
+                specError(source, line_no, "unknown state ", word);
+            }
+            if (!table.states_[index(*parsed)])
+            {
+                specError(source, line_no, "state missing from states: ", word);
+            }
+            return *parsed;
+        };
+
+        while (!text.empty())
+        {
+            line_no++;
+            size_t end = text.find('\n');
+            std::string_view line = text.substr(0, end);
+            text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+            line = line.substr(0, line.find('#'));
+
+            std::array<std::string_view, MAX_WORDS> words{};
+            size_t num_words = 0;
+            while (true)
+            {
+                size_t start = line.find_first_not_of(" \t\r");
+                if (start == std::string_view::npos)
+                {
+                    break;
+                }
+                line = line.substr(start);
+                size_t length = std::min(line.find_first_of(" \t\r"), line.size());
+                if (num_words == MAX_WORDS)
+                {
+                    specError(source, line_no, "too many words");
+                }
+                words[num_words++] = line.substr(0, length);
+                line = line.substr(length);
+            }
+            if (num_words == 0)
+            {
+                continue;
+            }
+
+            std::string_view keyword = words[0];
+            if (keyword == "protocol" && num_words == 2)
+            {
+                if (words[1].size() > MAX_NAME)
+                {
+                    specError(source, line_no, "protocol name too long: ", words[1]);
+                }
+                words[1].copy(table.name_.data(), words[1].size());
+                table.name_length_ = words[1].size();
+            }
+            else if (keyword == "states" && num_words > 1)
+            {
+                for (size_t i = 1; i < num_words; i++)
+                {
+                    std::optional<CoherenceState> parsed = parseState(words[i]);
+                    if (!parsed)
+                    {
+                        specError(source, line_no, "unknown state ", words[i]);
+                    }
+                    table.states_[index(*parsed)] = true;
+                }
+            }
+            else if (keyword == "snoop" && (num_words == 5 || num_words == 6) && words[3] == "->")
+            {
+                CoherenceState from = state(words[1]);
+                std::optional<BusMsgType> request = parseMessage(words[2]);
+                if (!request || static_cast<size_t>(*request) >= NUM_REQUESTS)
+                {
+                    specError(source, line_no, "unknown request ", words[2]);
+                }
+                SnoopTransition &row = table.snoops_[index(from) * NUM_REQUESTS + static_cast<size_t>(*request)];
+                if (row.defined)
+                {
+                    specError(source, line_no, "duplicate snoop row");
+                }
+                row = SnoopTransition{.next = state(words[4]), .reply = BusMsgType::DATA, .replies = num_words == 6, .defined = true};
+                if (row.replies)
+                {
+                    std::optional<BusMsgType> reply = parseMessage(words[5]);
+                    if (reply != BusMsgType::DATA && reply != BusMsgType::SHARED)
+                    {
+                        specError(source, line_no, "a cache replies DATA or SHARED, not ", words[5]);
+                    }
+                    row.reply = *reply;
+                }
+            }
+            else if (keyword == "fill" && num_words == 5 && words[3] == "->")
+            {
+                std::optional<BusMsgType> response = parseMessage(words[1]);
+                std::optional<OperationType> access = parseAccess(words[2]);
+                if (!response || static_cast<size_t>(*response) < NUM_REQUESTS)
+                {
+                    specError(source, line_no, "unknown response ", words[1]);
+                }
+                if (!access)
+                {
+                    specError(source, line_no, "unknown access ", words[2]);
+                }
+                CoherenceState next = state(words[4]);
+                if (next == CoherenceState::INVALID)
+                {
+                    specError(source, line_no, "a fill must leave the line valid");
+                }
+                table.fills_[(static_cast<size_t>(*response) - NUM_REQUESTS) * NUM_ACCESSES + static_cast<size_t>(*access)] = next;
+            }
+            else if (keyword == "hit" && (num_words == 3 || (num_words == 5 && words[3] == "->")))
+            {
+                CoherenceState from = state(words[1]);
+                std::optional<OperationType> access = parseAccess(words[2]);
+                if (!access)
+                {
+                    specError(source, line_no, "unknown access ", words[2]);
+                }
+                CoherenceState next = num_words == 5 ? state(words[4]) : from;
+                if (from == CoherenceState::INVALID || next == CoherenceState::INVALID)
+                {
+                    specError(source, line_no, "an invalid line cannot hit");
+                }
+                table.hits_[index(from) * NUM_ACCESSES + static_cast<size_t>(*access)] = next;
+            }
+            else if (keyword == "upgrade" && num_words > 1)
+            {
+                for (size_t i = 1; i < num_words; i++)
+                {
+                    table.upgrades_[index(state(words[i]))] = true;
+                }
+            }
+            else
+            {
+                specError(source, line_no, "cannot parse a line starting with ", keyword);
+            }
+        }
+
+        if (table.name_length_ == 0)
+        {
+            specError(source, line_no, "missing protocol name");
+        }
+        if (!table.has(CoherenceState::INVALID))
+        {
+            specError(source, line_no, "states must include I");
+        }
+        // a dirty line in a writeback buffer answers snoops as a MODIFIED one would.
+        for (BusMsgType request : {BusMsgType::READ, BusMsgType::WRITE})
+        {
+            const SnoopTransition &row = table.snoop(CoherenceState::MODIFIED, request);
+            if (!table.has(CoherenceState::MODIFIED) || !row.defined || !row.replies)
+            {
+                specError(source, line_no, "M must reply to READ and WRITE");
+            }
+        }
+        return table;
+    }
+}
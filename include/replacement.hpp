@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace csim
+{
+    enum class ReplacementPolicy
+    {
+        LRU,
+        PLRU,  // tree pseudo-LRU
+        SRRIP, // static re-reference interval prediction
+        BRRIP, // bimodal re-reference interval prediction
+        RANDOM,
+        FIFO
+    };
+
+    std::ostream &operator<<(std::ostream &os, const ReplacementPolicy &policy);
+
+    // Replacement policies plug into CacheArray at compile time. Each one keeps its own
+    // per-set metadata and is told about hits and fills by way index. victim is only
+    // asked for once every way of the set is valid, invalid ways are always used first.
+
+    // Recency rank of every way, 0 = most recently used. Ranks stay a permutation of
+    // 0 .. assoc - 1 per set, so the victim is the way ranked assoc - 1.
+    // With update_on_hit = false the ranks only change on fills, which is FIFO.
+    template <bool update_on_hit>
+    class RankPolicy
+    {
+    public:
+        RankPolicy(size_t num_sets, size_t assoc) : assoc_(assoc), ranks_(num_sets * assoc)
+        {
+            for (size_t i = 0; i < ranks_.size(); i++)
+            {
+                ranks_[i] = static_cast<uint32_t>(i % assoc);
+            }
+        }
+
+        void onHit(size_t set, size_t way)
+        {
+            if (update_on_hit)
+            {
+                promote(set, way);
+            }
+        }
+
+        void onFill(size_t set, size_t way)
+        {
+            promote(set, way);
+        }
+
+        size_t victim(size_t set) const
+        {
+            const uint32_t *ranks = &ranks_[set * assoc_];
+            for (size_t way = 0; way < assoc_; way++)
+            {
+                if (ranks[way] == assoc_ - 1)
+                {
+                    return way;
+                }
+            }
+            return 0;
+        }
+
+    private:
+        size_t assoc_;
+        std::vector<uint32_t> ranks_;
+
+        void promote(size_t set, size_t way)
+        {
+            uint32_t *ranks = &ranks_[set * assoc_];
+            uint32_t rank = ranks[way];
+            for (size_t w = 0; w < assoc_; w++)
+            {
+                ranks[w] += ranks[w] < rank;
+            }
+            ranks[way] = 0;
+        }
+    };
+
+    using LRUPolicy = RankPolicy<true>;
+    using FIFOPolicy = RankPolicy<false>;
+
+    // One bit per internal node of a binary tree over the ways, pointing towards the
+    // less recently used half. Needs a power of two associativity of at most 64.
+    class PLRUPolicy
+    {
+    public:
+        PLRUPolicy(size_t num_sets, size_t assoc) : levels_(0), trees_(num_sets, 0)
+        {
+            while ((size_t(1) << levels_) < assoc)
+            {
+                levels_++;
+            }
+        }
+
+        void onHit(size_t set, size_t way)
+        {
+            touch(set, way);
+        }
+
+        void onFill(size_t set, size_t way)
+        {
+            touch(set, way);
+        }
+
+        size_t victim(size_t set) const
+        {
+            uint64_t tree = trees_[set];
+            size_t node = 1;
+            size_t way = 0;
+            for (size_t level = 0; level < levels_; level++)
+            {
+                size_t bit = (tree >> node) & 1;
+                way = way * 2 + bit;
+                node = node * 2 + bit;
+            }
+            return way;
+        }
+
+    private:
+        size_t levels_;
+        std::vector<uint64_t> trees_; // bit n is tree node n, the root is node 1
+
+        void touch(size_t set, size_t way)
+        {
+            uint64_t &tree = trees_[set];
+            size_t node = 1;
+            for (size_t level = levels_; level-- > 0;)
+            {
+                uint64_t bit = (way >> level) & 1;
+                // point away from the half that was just used.
+                tree = (tree & ~(uint64_t(1) << node)) | ((bit ^ 1) << node);
+                node = node * 2 + bit;
+            }
+        }
+    };
+
+    // 2-bit re-reference prediction value per way. Hits predict a near re-reference,
+    // fills a long one (SRRIP) or, bimodally, mostly a distant one (BRRIP), so lines
+    // that are never reused leave before the working set does.
+    template <bool bimodal>
+    class RRIPPolicy
+    {
+    public:
+        static constexpr uint8_t MAX_RRPV = 3;
+        static constexpr size_t BRRIP_LONG_INTERVAL = 32; // one in this many BRRIP fills is long
+
+        RRIPPolicy(size_t num_sets, size_t assoc) : assoc_(assoc), rrpvs_(num_sets * assoc, MAX_RRPV) {}
+
+        void onHit(size_t set, size_t way)
+        {
+            rrpvs_[set * assoc_ + way] = 0;
+        }
+
+        void onFill(size_t set, size_t way)
+        {
+            uint8_t rrpv = MAX_RRPV - 1;
+            if (bimodal && ++fills_ % BRRIP_LONG_INTERVAL != 0)
+            {
+                rrpv = MAX_RRPV;
+            }
+            rrpvs_[set * assoc_ + way] = rrpv;
+        }
+
+        size_t victim(size_t set)
+        {
+            uint8_t *rrpvs = &rrpvs_[set * assoc_];
+            while (true)
+            {
+                for (size_t way = 0; way < assoc_; way++)
+                {
+                    if (rrpvs[way] == MAX_RRPV)
+                    {
+                        return way;
+                    }
+                }
+                for (size_t way = 0; way < assoc_; way++)
+                {
+                    rrpvs[way]++;
+                }
+            }
+        }
+
+    private:
+        size_t assoc_;
+        std::vector<uint8_t> rrpvs_;
+        uint64_t fills_ = 0;
+    };
+
+    using SRRIPPolicy = RRIPPolicy<false>;
+    using BRRIPPolicy = RRIPPolicy<true>;
+
+    // Uniformly random victims from a fixed-seed xorshift generator, so runs repeat.
+    class RandomPolicy
+    {
+    public:
+        RandomPolicy(size_t num_sets, size_t assoc) : assoc_(assoc)
+        {
+            (void)num_sets;
+        }
+
+        void onHit(size_t set, size_t way)
+        {
+            (void)set;
+            (void)way;
+        }
+
+        void onFill(size_t set, size_t way)
+        {
+            (void)set;
+            (void)way;
+        }
+
+        size_t victim(size_t set)
+        {
+            (void)set;
+            state_ ^= state_ << 13;
+            state_ ^= state_ >> 7;
+            state_ ^= state_ << 17;
+            return state_ % assoc_;
+        }
+
+    private:
+        size_t assoc_;
+        uint64_t state_ = 0x9E3779B97F4A7C15;
+    };
+}
+
+// Calls X with every policy, the engines templated on one are explicitly instantiated
+// for all of them next to their definitions.
+#define CSIM_REPLACEMENT_POLICIES(X) \
+    X(csim::LRUPolicy)               \
+    X(csim::PLRUPolicy)              \
+    X(csim::SRRIPPolicy)             \
+    X(csim::BRRIPPolicy)             \
+    X(csim::RandomPolicy)            \
+    X(csim::FIFOPolicy)
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace csim
+{
+    enum class SchedulerType
+    {
+        CYCLE, // step every component in every cycle, the reference
+        EVENT  // step only the components with something due
+    };
+
+    std::ostream &operator<<(std::ostream &os, const SchedulerType &type);
+
+    // What a cycle steps, in the order it steps them: every processor, then every private
+    // cache, then the interconnect.
+    enum class Component
+    {
+        CPU,
+        CACHE,
+        INTERCONNECT
+    };
+
+    // Events of numbered components by cycle. The next num_slots cycles each have a slot
+    // listing the components due in it, later events wait in a heap until the wheel turns
+    // far enough to take them.
+    class TimingWheel
+    {
+    public:
+        explicit TimingWheel(size_t num_slots = 1024);
+
+        // An event for id at cycle, which the wheel must not have passed.
+        void schedule(size_t cycle, size_t id);
+        // Turns the wheel to its earliest event and returns its cycle, nullopt if there is none.
+        std::optional<size_t> next();
+        // Moves the events of the cycle next returned to ids.
+        void take(std::vector<size_t> &ids);
+
+    private:
+        std::vector<std::vector<size_t>> slots_; // ids per cycle of [now_, now_ + slots_.size())
+        size_t mask_;
+        size_t now_ = 0;
+        size_t count_ = 0; // events in slots_
+        std::priority_queue<std::pair<size_t, size_t>, std::vector<std::pair<size_t, size_t>>, std::greater<std::pair<size_t, size_t>>> later_;
+
+        void refill();
+    };
+
+    // Steps components only in the cycles they have something to do in: a processor that
+    // can issue, a cache with a miss completing, requests to look up or misses to send in
+    // its turn, an interconnect carrying a request or draining writebacks. Components ask
+    // for their own next step when they are stepped, others wake them when they hand
+    // them work. A component keeps only its earliest wake, it finds its later ones again
+    // when stepped.
+    class EventScheduler
+    {
+    public:
+        explicit EventScheduler(size_t num_procs);
+
+        // Asks for proc's component to be stepped at cycle, or in the next cycle if the
+        // current one has already stepped that kind of component. The interconnect is proc 0.
+        void wake(Component component, size_t proc, size_t cycle);
+        // Moves on to the next cycle with a component due, nullopt once there is none.
+        std::optional<size_t> advance();
+        // The processors whose component is due in the current cycle, in order. Taken
+        // once per kind in step order, the wakes for this cycle that follow go to the next.
+        const std::vector<size_t> &take(Component component);
+
+    private:
+        static constexpr size_t NONE = static_cast<size_t>(-1);
+        static constexpr size_t NUM_KINDS = 3;
+
+        size_t num_procs_;
+        TimingWheel wheel_;
+        std::vector<size_t> due_; // earliest wake per component, NONE once stepped
+        std::array<std::vector<size_t>, NUM_KINDS> current_; // procs due in now_ per kind
+        std::vector<size_t> stepping_; // the procs take handed out
+        std::vector<size_t> ids_;
+        bool started_ = false;
+        size_t now_ = 0;
+        size_t taken_ = 0; // kinds of component already stepped in now_
+    };
+}
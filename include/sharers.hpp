@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace csim
+{
+    enum class DirEncoding
+    {
+        FULL,       // a presence bit per processor
+        LIMITED_B,  // Dir_i_B: i processor pointers, broadcast once they overflow
+        LIMITED_NB, // Dir_i_NB: i processor pointers, an overflow invalidates a sharer
+        COARSE      // a presence bit per group of processors
+    };
+
+    std::ostream &operator<<(std::ostream &os, const DirEncoding &encoding);
+
+    // Reads and writes the sharers of a directory entry, kept in one 64 bit word. Only
+    // FULL is exact. The others may name processors that hold no copy, which then get
+    // invalidations they did not need. An empty set is the word 0. FULL past 64
+    // processors keeps the bits out of line and the word names them.
+    class SharerEncoding
+    {
+    public:
+        SharerEncoding(DirEncoding type, size_t num_procs, size_t pointers, size_t group);
+
+        // Whether the sharers of num_procs processors fit a word, FULL always does.
+        static bool fits(DirEncoding type, size_t num_procs, size_t pointers, size_t group);
+
+        bool empty(uint64_t sharers) const { return sharers == 0; }
+        // May be true for a processor without a copy.
+        bool contains(uint64_t sharers, size_t proc) const;
+        // Dir_i_B: the pointers overflowed, every processor may share the line.
+        bool overflowed(uint64_t sharers) const;
+        // Adds proc. Under Dir_i_NB returns the sharer that lost its pointer to it and
+        // has to be invalidated.
+        std::optional<size_t> add(uint64_t &sharers, size_t proc);
+        // Removes proc where the encoding can tell it apart from the others.
+        void remove(uint64_t &sharers, size_t proc);
+        // The processors [first, last) that remove cannot tell apart from proc: its group
+        // under COARSE, all of them once Dir_i_B overflowed. Empty for exact entries.
+        std::pair<size_t, size_t> aliases(uint64_t sharers, size_t proc) const;
+        // Drops proc with its aliases, for when none of them holds a copy any more.
+        void drop(uint64_t &sharers, size_t proc);
+        void clear(uint64_t &sharers);
+
+        // Calls visit for every processor that may hold a copy.
+        template <typename Visit>
+        void forEach(uint64_t sharers, Visit visit) const
+        {
+            switch (type_)
+            {
+            case DirEncoding::FULL:
+                if (words_ > 0)
+                {
+                    for (size_t i = 0; sharers && i < words_; i++)
+                    {
+                        for (uint64_t word = pool_[set(sharers) + i]; word; word &= word - 1)
+                        {
+                            visit(i * 64 + __builtin_ctzll(word));
+                        }
+                    }
+                    break;
+                }
+                [[fallthrough]];
+            case DirEncoding::COARSE:
+                for (; sharers; sharers &= sharers - 1)
+                {
+                    size_t bit = __builtin_ctzll(sharers);
+                    for (size_t proc = bit * group_; proc < num_procs_ && proc < (bit + 1) * group_; proc++)
+                    {
+                        visit(proc);
+                    }
+                }
+                break;
+            case DirEncoding::LIMITED_B:
+            case DirEncoding::LIMITED_NB:
+                if (overflowed(sharers))
+                {
+                    for (size_t proc = 0; proc < num_procs_; proc++)
+                    {
+                        visit(proc);
+                    }
+                    break;
+                }
+                for (size_t i = 0; i < count(sharers); i++)
+                {
+                    visit(pointer(sharers, i));
+                }
+                break;
+            }
+        }
+
+    private:
+        DirEncoding type_;
+        size_t num_procs_;
+        size_t pointers_;      // LIMITED: pointers per entry
+        size_t pointer_bits_;  // LIMITED: bits per pointer
+        size_t group_;         // processors per presence bit, 1 for FULL
+        size_t words_;         // FULL past 64 processors: words per out of line set, else 0
+
+        // out of line sets, a word names its set by index + 1.
+        std::vector<uint64_t> pool_;
+        std::vector<size_t> free_;
+
+        // LIMITED words hold a pointer count, an overflow bit and the pointers.
+        static const size_t COUNT_BITS = 4;
+        static const size_t OVERFLOW_BIT = COUNT_BITS;
+        static const size_t POINTERS_SHIFT = COUNT_BITS + 1;
+
+        size_t set(uint64_t sharers) const { return (sharers - 1) * words_; }
+        size_t count(uint64_t sharers) const { return sharers & ((1ULL << COUNT_BITS) - 1); }
+        size_t pointer(uint64_t sharers, size_t i) const;
+        void setPointer(uint64_t &sharers, size_t i, size_t proc) const;
+    };
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <vector>
+#include "linemap.hpp"
+#include "replacement.hpp"
+
+namespace csim
+{
+    enum class SnoopFilterType
+    {
+        NONE,
+        EXACT,  // presence bits for every line ever cached
+        BOUNDED // fixed number of entries, inclusive of every cache
+    };
+
+    std::ostream &operator<<(std::ostream &os, const SnoopFilterType &type);
+
+    // Presence bits of the lines held by the snooping caches. The bus only forwards a
+    // request to caches whose bit is set. Caches report every line they gain or lose, so
+    // the bits are exact in both modes. A bounded filter tracks at most num_sets x assoc
+    // lines and, to stay inclusive, a line that loses its entry must be invalidated in
+    // every cache holding it (back-invalidation).
+    class SnoopFilter
+    {
+    public:
+        SnoopFilter(SnoopFilterType type, size_t num_procs, size_t num_sets, size_t assoc, size_t line_size);
+
+        // Records whether a snoop of address is forwarded to proc.
+        bool deliver(size_t address, size_t proc);
+        bool holds(size_t address, size_t proc) const;
+        bool heldByOther(size_t address, size_t except_proc) const;
+
+        // proc gained address. Returns a line that lost its entry and must be
+        // back-invalidated, if any.
+        std::optional<size_t> add(size_t address, size_t proc);
+        // proc no longer holds address.
+        void remove(size_t address, size_t proc);
+        void recordBackInvalidations(size_t copies) { back_invalidations_ += copies; }
+
+        // Addresses are dense line IDs from now on.
+        void setLineAddresses(const std::vector<size_t> *addresses);
+
+        SnoopFilterType type() const { return type_; }
+        size_t delivered() const { return delivered_; }
+        size_t filtered() const { return filtered_; }
+        size_t backInvalidations() const { return back_invalidations_; }
+
+    private:
+        SnoopFilterType type_;
+        size_t num_procs_;
+        size_t num_words_; // presence words per line
+        size_t num_sets_;
+        size_t assoc_;
+        size_t line_size_;
+
+        // EXACT: line -> entry
+        LineMap<uint32_t> entries_;
+        // BOUNDED: num_sets x assoc entries, free ones are tagged NO_ADDRESS
+        std::vector<size_t> tags_;
+        LRUPolicy policy_;
+        const std::vector<size_t> *line_addresses_ = nullptr;
+
+        std::vector<uint64_t> presence_; // num_words_ per entry
+        size_t delivered_ = 0;
+        size_t filtered_ = 0;
+        size_t back_invalidations_ = 0;
+
+        size_t find(size_t address) const; // entry index, or npos
+        bool empty(size_t entry) const;
+    };
+
+    std::ostream &operator<<(std::ostream &os, const SnoopFilter &filter);
+}
@@ -11,7 +11,9 @@ namespace csim
     {
         size_t hits;
         size_t misses;
-        size_t evictions;
+        size_t evictions;          // lines lost to coherence invalidations
+        size_t capacity_evictions; // lines replaced to make room in a full set
+        size_t writebacks;         // dirty lines written back to memory after a capacity eviction
     };
 
     struct InterconnectStats
@@ -22,13 +24,73 @@ namespace csim
         size_t mem_data_traffic;
     };
 
+    struct BufferStats
+    {
+        size_t victim_hits;    // accesses served from a victim cache
+        size_t wb_snoop_hits;  // snoops answered from a writeback buffer
+        size_t wb_forced_flushes; // evictions that found the writeback buffer full and wrote its oldest line at once
+        size_t wb_drained;     // buffered writebacks sent while the bus was idle
+    };
+
+    struct PrefetchStats
+    {
+        size_t issued;        // prefetches that filled a cache
+        size_t useful;        // prefetched lines later accessed by their processor
+        size_t late;          // demand misses on lines still waiting to be prefetched
+        size_t evicted;       // prefetched lines replaced before any use
+        size_t invalidated;   // prefetched lines invalidated by another processor before any use
+        size_t demand_misses; // misses not covered by a prefetch
+        size_t lead_cycles;   // cycles from prefetch to first use, summed over useful prefetches
+    };
+
+    struct MSHRStats
+    {
+        size_t merges;        // secondary misses merged into an MSHR of the same line
+        size_t full_stalls;   // lookups held back because every MSHR was busy
+        size_t occupancy;     // busy MSHRs summed over caches and cycles
+        size_t samples;       // caches times cycles
+        size_t max_occupancy; // most busy MSHRs in one cache
+    };
+
+    struct DirBankStats
+    {
+        size_t requests;     // requests the bank served
+        size_t queue_cycles; // cycles they waited for it, summed
+        size_t max_queue;    // most requests queued at once
+        size_t peak_entries; // most lines it tracked at once
+    };
+
+    struct DirectoryStats
+    {
+        size_t invalidations;        // invalidations the directory sent to caches
+        size_t extra_invalidations;  // of those, sent to caches without a copy or forced by a pointer overflow
+        size_t pointer_overflows;    // limited-pointer entries that ran out of pointers
+        size_t sharer_queries;       // caches asked whether they still hold a line an imprecise entry keeps
+        size_t peak_entries;         // most lines tracked at once
+        size_t entry_evictions;      // sparse directory entries replaced
+        size_t recall_invalidations; // cached copies lost to those replacements
+        size_t recall_misses;        // misses on lines a cache lost that way
+        size_t requests;             // misses and upgrades the directory answered
+        size_t forwards;             // of those, forwarded to a cache that supplied the line
+        size_t hops;                 // messages on their critical paths, summed
+        std::vector<DirBankStats> banks;
+    };
+
     struct Stats
     {
         std::size_t num_procs_;
         std::vector<CacheStats> cachestats;
         InterconnectStats interconstats;
+        BufferStats bufferstats;
+        PrefetchStats prefetchstats;
+        MSHRStats mshrstats;
+        DirectoryStats dirstats;
         Stats(size_t num_procs);
     };
 
     std::ostream &operator<<(std::ostream &os, const Stats &stats);
+    std::ostream &operator<<(std::ostream &os, const BufferStats &stats);
+    std::ostream &operator<<(std::ostream &os, const PrefetchStats &stats);
+    std::ostream &operator<<(std::ostream &os, const MSHRStats &stats);
+    std::ostream &operator<<(std::ostream &os, const DirectoryStats &stats);
 }
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "trace.hpp"
+
+namespace csim
+{
+    // The access patterns of tracegen.py.
+    enum class Workload
+    {
+        NONE, // read traces from files
+        FALSE_SHARING,
+        NO_SHARING,
+        PRODUCER_CONSUMER,
+        MULTIPLE_READERS,
+        MULTIPLE_WRITERS,
+        RANDOM,
+        PARTIAL_PROC_USE
+    };
+
+    std::ostream &operator<<(std::ostream &os, const Workload &workload);
+
+    // Generates a tracegen.py pattern in process, num_accesses instructions per processor.
+    // Every processor draws from its own generator seeded from (seed, proc), so the
+    // generated trace does not depend on the order processors are read in.
+    class SyntheticTrace : public TraceSource
+    {
+    public:
+        SyntheticTrace(Workload workload, size_t num_procs, size_t num_accesses, size_t cache_line_size, uint64_t seed);
+        std::optional<Instruction> readNextLine(size_t proc) override;
+
+    private:
+        struct ProcState
+        {
+            std::mt19937_64 rng;
+            size_t issued = 0;
+            bool active = true;
+            std::vector<size_t> pool;   // addresses the pattern picks fresh accesses from
+            std::vector<size_t> recent; // last few addresses, oldest first
+        };
+
+        Workload workload_;
+        size_t num_procs_;
+        size_t num_accesses_;
+        size_t cache_line_size_;
+        std::vector<ProcState> procs_;
+
+        bool chance(ProcState &state, double probability);
+        // picks a random element of addresses
+        size_t pick(ProcState &state, const std::vector<size_t> &addresses);
+        // true if this access revisits one of the recent addresses
+        bool reuse(ProcState &state, double probability);
+        // makes address the most recent one, keeping at most window addresses
+        void remember(ProcState &state, size_t window, size_t address);
+    };
+}
@@ -4,18 +4,37 @@
 #include <optional>
 #include <vector>
 #include <iostream>
+#include <fstream>
+#include <memory>
+#include "mappedfile.hpp"
+
 namespace csim
 {
     // TODO: Ensure to get the block address.
 
     const size_t MASK = 0xFFFFFFFFFFFFFFC0;
 
+    // Binary traces are one <proc>.bin per processor: an 8 byte magic followed by
+    // fixed-width records of 1 byte op (0 = load, 1 = store) and a 64-bit little-endian address.
+    const char BINARY_TRACE_MAGIC[8] = {'C', 'S', 'I', 'M', 'B', 'T', 'R', '1'};
+    const size_t BINARY_TRACE_HEADER_SIZE = sizeof(BINARY_TRACE_MAGIC);
+    const size_t BINARY_RECORD_SIZE = 9;
+
     enum class OperationType
     {
         MEM_LOAD,
         MEM_STORE
     };
 
+    enum class TraceFormat
+    {
+        TEXT,        // <proc>.txt, mapped and parsed in place
+        TEXT_STREAM, // <proc>.txt, read line by line through std::ifstream
+        BINARY,      // <proc>.bin, mapped fixed-width records
+        COMPRESSED,  // <proc>.ctr, streamed delta + varint blocks
+        CONTAINER    // trace.ctc, every processor in one indexed file
+    };
+
     struct Instruction
     {
         OperationType command;
@@ -23,18 +42,64 @@ namespace csim
         bool operator==(Instruction &);
     };
 
-    struct TraceReader
+    void encodeBinaryRecord(char *out, const Instruction &ins);
+
+    // Parses one "L <addr>" / "S <addr>" line starting at first. The address may be
+    // decimal or 0x prefixed hex. Returns the start of the next line, or nullptr if malformed.
+    const char *parseTraceLine(const char *first, const char *last, Instruction &ins);
+
+    // Anything the processors can pull instructions from. readNextLine returns the next
+    // instruction of proc, or nullopt if there is none right now. finished tells the two
+    // apart: sources that can run ahead of their input return false until proc's trace ends.
+    class TraceSource
     {
-        std::optional<Instruction> readNextLine(size_t proc);
+    public:
+        virtual ~TraceSource() = default;
+        virtual std::optional<Instruction> readNextLine(size_t proc) = 0;
+        virtual bool finished(size_t proc)
+        {
+            (void)proc;
+            return true;
+        }
+    };
+
+    class CompressedTraceStream;
+    class ContainerTrace;
+
+    // Reads traces from files in one of the TraceFormats.
+    struct TraceReader : public TraceSource
+    {
+        std::optional<Instruction> readNextLine(size_t proc) override;
         size_t num_procs_;
         std::string directory_;
         size_t cache_line_size_;
+        TraceFormat format_;
         std::vector<std::ifstream> files;
-        TraceReader(std::string directory_, size_t num_procs_, size_t cache_line_size_);
+        std::vector<MappedFile> maps_; // per processor mapping of text/binary traces
+        std::vector<size_t> cursors_;  // per processor byte offset into maps_
+        std::vector<std::unique_ptr<CompressedTraceStream>> streams_;
+        std::unique_ptr<ContainerTrace> container_;
+        size_t offset_;                 // instructions skipped at the start of every processor's trace
+        size_t limit_;                  // instructions read per processor after the offset, 0 = all
+        std::vector<size_t> consumed_;  // instructions read per processor
+        TraceReader(std::string directory_, size_t num_procs_, size_t cache_line_size_, TraceFormat format_ = TraceFormat::TEXT, size_t offset_ = 0, size_t limit_ = 0);
+        ~TraceReader();
         std::vector<std::string> split(const std::string &line, char delim);
+
+    private:
+        std::optional<Instruction> readNextRecord(size_t proc);
+        void open();
+        void skip(size_t proc, size_t count);
+        std::optional<Instruction> readNextText(size_t proc);
+        std::optional<Instruction> readNextTextStream(size_t proc);
+        std::optional<Instruction> readNextBinary(size_t proc);
+        std::optional<Instruction> readNextCompressed(size_t proc);
+        std::optional<Instruction> readNextContainer(size_t proc);
     };
 
     std::ostream &operator<<(std::ostream &os, const OperationType &op);
 
+    std::ostream &operator<<(std::ostream &os, const TraceFormat &format);
+
     std::ostream &operator<<(std::ostream &os, const Instruction &ins);
-}
\ No newline at end of file
+}
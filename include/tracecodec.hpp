@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "mappedfile.hpp"
+#include <vector>
+#include "trace.hpp"
+
+namespace csim
+{
+    // Compressed traces are one <proc>.ctr per processor:
+    //   header: 8 byte magic, uint32 line shift, uint32 max records per block
+    //   blocks: uint32 record count, uint32 payload bytes, payload
+    // Each record is a varint of (zigzag(line - previous line) << 1 | store bit), where
+    // line = address >> line shift. The delta base resets at every block so blocks decode
+    // independently and a reader only ever holds one block per processor.
+    const char COMPRESSED_TRACE_MAGIC[8] = {'C', 'S', 'I', 'M', 'C', 'T', 'R', '1'};
+    const size_t COMPRESSED_TRACE_HEADER_SIZE = sizeof(COMPRESSED_TRACE_MAGIC) + 2 * sizeof(uint32_t);
+    const size_t COMPRESSED_BLOCK_HEADER_SIZE = 2 * sizeof(uint32_t);
+    const uint32_t DEFAULT_BLOCK_RECORDS = 4096;
+    const uint32_t MIN_COMPRESSED_LINE_SHIFT = 2; // keeps the shifted zigzag delta within 64 bits
+
+    inline uint64_t zigzagEncode(int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    inline int64_t zigzagDecode(uint64_t value)
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // Appends value as an LEB128 varint.
+    inline void putVarint(std::vector<uint8_t> &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    // Reads an LEB128 varint, returns nullptr if it runs past last.
+    inline const uint8_t *getVarint(const uint8_t *p, const uint8_t *last, uint64_t &value)
+    {
+        value = 0;
+        for (unsigned shift = 0; p < last && shift < 64; shift += 7)
+        {
+            uint8_t byte = *p++;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return p;
+            }
+        }
+        return nullptr;
+    }
+
+    // Encodes one block of records into payload (which is cleared first).
+    void encodeCompressedBlock(const std::vector<Instruction> &records, uint32_t line_shift, std::vector<uint8_t> &payload);
+
+    // Decodes count records of a block payload into out. Returns false if the payload is malformed.
+    bool decodeCompressedBlock(const uint8_t *payload, size_t bytes, size_t count, uint32_t line_shift, Instruction *out);
+
+    // Writes a compressed trace file record by record.
+    class CompressedTraceWriter
+    {
+    public:
+        CompressedTraceWriter(const std::string &path, uint32_t line_shift, uint32_t block_records = DEFAULT_BLOCK_RECORDS);
+        bool isOpen() const { return static_cast<bool>(out_); }
+        void write(const Instruction &ins);
+        void close();
+
+    private:
+        std::ofstream out_;
+        uint32_t line_shift_;
+        uint32_t block_records_;
+        std::vector<Instruction> block_;
+        std::vector<uint8_t> payload_;
+
+        void flush();
+    };
+
+    // Streams a compressed trace file one block at a time.
+    class CompressedTraceStream
+    {
+    public:
+        bool open(const std::string &path);
+        uint32_t lineShift() const { return line_shift_; }
+        std::optional<Instruction> next();
+
+    private:
+        std::ifstream in_;
+        uint32_t line_shift_ = 0;
+        uint32_t block_records_ = 0;
+        std::vector<uint8_t> payload_;
+        std::vector<Instruction> block_;
+        size_t pos_ = 0;
+        bool failed_ = false;
+
+        bool refill();
+    };
+
+    // A container holds the traces of every processor in one file (<directory>/trace.ctc):
+    //   header: 8 byte magic, uint32 processors, uint32 line shift, uint32 max records per chunk,
+    //           uint32 reserved, uint64 index offset
+    //   chunks: compressed block payloads (same encoding as .ctr blocks), processors interleaved
+    //   index:  uint64 chunk count, then one ContainerChunk per chunk
+    // Chunks of a processor appear in trace order, so the index locates instruction N of any
+    // processor with a binary search and a single chunk decode.
+    const char CONTAINER_TRACE_MAGIC[8] = {'C', 'S', 'I', 'M', 'C', 'T', 'C', '1'};
+    const size_t CONTAINER_TRACE_HEADER_SIZE = 32;
+    const char *const CONTAINER_TRACE_FILE = "trace.ctc";
+
+    struct ContainerChunk
+    {
+        uint32_t proc;
+        uint32_t count;  // records in the chunk
+        uint64_t first;  // index of the first record within the processor's trace
+        uint64_t offset; // payload offset in the file
+        uint64_t bytes;  // payload size
+    };
+    static_assert(sizeof(ContainerChunk) == 32, "container index entries are stored as raw 32 byte records");
+
+    class ContainerTraceWriter
+    {
+    public:
+        ContainerTraceWriter(const std::string &path, uint32_t num_procs, uint32_t line_shift, uint32_t chunk_records = DEFAULT_BLOCK_RECORDS);
+        bool isOpen() const { return static_cast<bool>(out_); }
+        uint32_t chunkRecords() const { return chunk_records_; }
+        // Appends the next chunk of proc's trace, at most chunkRecords() records.
+        void writeChunk(uint32_t proc, const std::vector<Instruction> &records);
+        void close();
+
+    private:
+        std::ofstream out_;
+        uint32_t num_procs_;
+        uint32_t line_shift_;
+        uint32_t chunk_records_;
+        uint64_t offset_;
+        std::vector<uint64_t> written_; // records written per processor
+        std::vector<ContainerChunk> index_;
+        std::vector<uint8_t> payload_;
+    };
+
+    // Reads a mapped container. Every processor has its own cursor, so processors can be
+    // read independently (and from different threads).
+    class ContainerTrace
+    {
+    public:
+        bool open(const std::string &path);
+        uint32_t numProcs() const { return num_procs_; }
+        uint32_t lineShift() const { return line_shift_; }
+        // Positions proc at its instruction offset. Returns false past the end of its trace.
+        bool seek(size_t proc, uint64_t offset);
+        std::optional<Instruction> next(size_t proc);
+
+    private:
+        struct Cursor
+        {
+            std::vector<uint32_t> chunks; // indices into index_, in trace order
+            size_t chunk = 0;             // next chunk to decode
+            std::vector<Instruction> block;
+            size_t pos = 0;
+        };
+
+        MappedFile map_;
+        uint32_t num_procs_ = 0;
+        uint32_t line_shift_ = 0;
+        uint32_t chunk_records_ = 0;
+        std::vector<ContainerChunk> index_;
+        std::vector<Cursor> cursors_;
+
+        bool decodeChunk(Cursor &cursor, uint32_t chunk);
+    };
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "trace.hpp"
+
+namespace csim
+{
+    // A batch of decoded instructions. last marks the final batch of a processor's trace.
+    struct InstructionBatch
+    {
+        std::vector<Instruction> instructions;
+        size_t count = 0;
+        bool last = false;
+    };
+
+    // Lock-free single producer / single consumer ring of preallocated batches.
+    // The producer fills producerSlot() in place and publishes it, the consumer reads
+    // front() in place and pops it once done, so no batch is ever copied or reallocated.
+    class BatchRing
+    {
+    public:
+        BatchRing(size_t depth, size_t batch_size);
+
+        InstructionBatch *producerSlot();
+        void publish();
+        InstructionBatch *front();
+        void pop();
+        void waitNonEmpty();
+
+    private:
+        std::vector<InstructionBatch> slots_;
+        alignas(64) std::atomic<uint64_t> head_{0}; // next slot to consume
+        alignas(64) std::atomic<uint64_t> tail_{0}; // next slot to produce
+    };
+
+    struct TracePipelineStats
+    {
+        size_t starved = 0;    // reads that found the ring empty and had to wait
+        uint64_t starved_ns = 0; // total time spent waiting
+    };
+
+    // Decodes a trace source on background threads into per processor rings ahead of the
+    // simulation. Processor p is decoded by thread p % num_threads, and only ever
+    // consumed by the simulation thread through readNextLine.
+    class TracePipeline : public TraceSource
+    {
+    public:
+        TracePipeline(TraceSource *trace_source, size_t num_procs, size_t num_threads, size_t depth, size_t batch_size);
+        ~TracePipeline();
+        std::optional<Instruction> readNextLine(size_t proc) override;
+        const std::vector<TracePipelineStats> &stats() const { return stats_; }
+
+    private:
+        struct Consumer
+        {
+            InstructionBatch *batch = nullptr;
+            size_t pos = 0;
+            bool done = false;
+        };
+
+        TraceSource *trace_source_;
+        size_t num_procs_;
+        size_t batch_size_;
+        std::vector<std::unique_ptr<BatchRing>> rings_;
+        std::vector<Consumer> consumers_;
+        std::vector<TracePipelineStats> stats_;
+        std::vector<std::thread> threads_;
+        std::atomic<uint64_t> pops_{0}; // bumped on every consumed batch to wake idle decoders
+        std::atomic<bool> stop_{false};
+
+        void decode(size_t thread, size_t num_threads);
+    };
+
+    std::ostream &operator<<(std::ostream &os, const TracePipeline &pipeline);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "trace.hpp"
+
+namespace csim
+{
+    // Reads one interleaved trace of "<proc> L|S <addr>" lines from stdin ("-") or a
+    // named pipe and splits it into bounded per processor queues. Nothing is read
+    // ahead once the queue the next line belongs to is full, so a fast producer
+    // blocks on the pipe instead of growing memory.
+    class StreamTraceSource : public TraceSource
+    {
+    public:
+        StreamTraceSource(const std::string &path, size_t num_procs, size_t cache_line_size, size_t depth);
+        ~StreamTraceSource();
+        StreamTraceSource(const StreamTraceSource &) = delete;
+        StreamTraceSource &operator=(const StreamTraceSource &) = delete;
+
+        std::optional<Instruction> readNextLine(size_t proc) override;
+        bool finished(size_t proc) override;
+
+        size_t lines() const { return lines_; }
+        size_t stalls() const { return stalls_; }
+
+    private:
+        // Fixed capacity ring of instructions waiting for one processor.
+        struct Queue
+        {
+            std::vector<Instruction> ring;
+            size_t head = 0;
+            size_t size = 0;
+        };
+
+        struct PendingLine
+        {
+            size_t proc;
+            Instruction ins;
+        };
+
+        int fd_ = -1;
+        size_t num_procs_;
+        size_t cache_line_size_;
+        std::vector<Queue> queues_;
+        std::optional<PendingLine> pending_; // line read whose queue was full
+        std::vector<char> buffer_;
+        size_t begin_ = 0;          // first unparsed byte of buffer_
+        size_t end_ = 0;            // end of the bytes read into buffer_
+        bool input_done_ = false;   // the writer closed the stream
+        bool stream_done_ = false;  // every line has been parsed
+        size_t lines_ = 0;
+        size_t stalls_ = 0; // reads that found their queue empty behind a full one
+
+        bool fill();
+        bool readLine(PendingLine &line);
+    };
+
+    std::ostream &operator<<(std::ostream &os, const StreamTraceSource &stream);
+}
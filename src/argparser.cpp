@@ -7,6 +7,39 @@
 
 namespace csim
 {
+    namespace
+    {
+        ReplacementPolicy parseReplacement(const std::string &value)
+        {
+            if (value == "LRU" || value == "lru")
+            {
+                return ReplacementPolicy::LRU;
+            }
+            else if (value == "PLRU" || value == "plru")
+            {
+                return ReplacementPolicy::PLRU;
+            }
+            else if (value == "SRRIP" || value == "srrip")
+            {
+                return ReplacementPolicy::SRRIP;
+            }
+            else if (value == "BRRIP" || value == "brrip")
+            {
+                return ReplacementPolicy::BRRIP;
+            }
+            else if (value == "RANDOM" || value == "random")
+            {
+                return ReplacementPolicy::RANDOM;
+            }
+            else if (value == "FIFO" || value == "fifo")
+            {
+                return ReplacementPolicy::FIFO;
+            }
+            std::cerr << "Invalid Replacement Policy" << std::endl;
+            exit(1);
+        }
+    }
+
     std::vector<std::string> split(const std::string &s, char delimiter)
     {
         std::vector<std::string> tokens;
@@ -101,10 +134,345 @@ namespace csim
             {
                 config.cache_size = std::stoi(value);
             }
+            else if (key == "cache_assoc")
+            {
+                config.cache_assoc = std::stoi(value);
+            }
+            else if (key == "replacement")
+            {
+                config.replacement = parseReplacement(value);
+            }
             else if (key == "diropt")
             {
                 config.diropt = (value == "true" || value == "1");
             }
+            else if (key == "trace_format")
+            {
+                if (value == "TEXT" || value == "text")
+                {
+                    config.trace_format = TraceFormat::TEXT;
+                }
+                else if (value == "TEXT_STREAM" || value == "text_stream")
+                {
+                    config.trace_format = TraceFormat::TEXT_STREAM;
+                }
+                else if (value == "BINARY" || value == "binary")
+                {
+                    config.trace_format = TraceFormat::BINARY;
+                }
+                else if (value == "COMPRESSED" || value == "compressed")
+                {
+                    config.trace_format = TraceFormat::COMPRESSED;
+                }
+                else if (value == "CONTAINER" || value == "container")
+                {
+                    config.trace_format = TraceFormat::CONTAINER;
+                }
+                else
+                {
+                    std::cerr << "Invalid Trace Format" << std::endl;
+                    exit(1);
+                }
+            }
+            else if (key == "workload")
+            {
+                if (value == "false_sharing")
+                {
+                    config.workload = Workload::FALSE_SHARING;
+                }
+                else if (value == "no_sharing")
+                {
+                    config.workload = Workload::NO_SHARING;
+                }
+                else if (value == "producer_consumer")
+                {
+                    config.workload = Workload::PRODUCER_CONSUMER;
+                }
+                else if (value == "multiple_readers")
+                {
+                    config.workload = Workload::MULTIPLE_READERS;
+                }
+                else if (value == "multiple_writers")
+                {
+                    config.workload = Workload::MULTIPLE_WRITERS;
+                }
+                else if (value == "random")
+                {
+                    config.workload = Workload::RANDOM;
+                }
+                else if (value == "partial_proc_use")
+                {
+                    config.workload = Workload::PARTIAL_PROC_USE;
+                }
+                else
+                {
+                    std::cerr << "Invalid Workload" << std::endl;
+                    exit(1);
+                }
+            }
+            else if (key == "num_accesses")
+            {
+                config.num_accesses = std::stoull(value);
+            }
+            else if (key == "seed")
+            {
+                config.seed = std::stoull(value);
+            }
+            else if (key == "protocol_spec")
+            {
+                config.protocol_spec = value;
+            }
+            else if (key == "stream")
+            {
+                config.stream = value;
+            }
+            else if (key == "stream_depth")
+            {
+                config.stream_depth = std::stoul(value);
+                if (config.stream_depth == 0)
+                {
+                    std::cerr << "Invalid Stream Depth" << std::endl;
+                    exit(1);
+                }
+            }
+            else if (key == "cache_latency")
+            {
+                config.cache_latency = std::stoul(value);
+            }
+            else if (key == "l1_size")
+            {
+                config.l1_size = std::stoul(value);
+            }
+            else if (key == "l1_assoc")
+            {
+                config.l1_assoc = std::stoul(value);
+            }
+            else if (key == "l1_latency")
+            {
+                config.l1_latency = std::stoul(value);
+            }
+            else if (key == "llc_size")
+            {
+                config.llc_size = std::stoul(value);
+            }
+            else if (key == "llc_assoc")
+            {
+                config.llc_assoc = std::stoul(value);
+            }
+            else if (key == "llc_latency")
+            {
+                config.llc_latency = std::stoul(value);
+            }
+            else if (key == "llc_inclusion")
+            {
+                if (value == "INCLUSIVE" || value == "inclusive")
+                {
+                    config.llc_inclusion = InclusionPolicy::INCLUSIVE;
+                }
+                else if (value == "NON_INCLUSIVE" || value == "non_inclusive")
+                {
+                    config.llc_inclusion = InclusionPolicy::NON_INCLUSIVE;
+                }
+                else
+                {
+                    std::cerr << "Invalid LLC Inclusion Policy" << std::endl;
+                    exit(1);
+                }
+            }
+            else if (key == "mem_latency")
+            {
+                config.mem_latency = std::stoul(value);
+            }
+            else if (key == "snoop_filter")
+            {
+                if (value == "NONE" || value == "none")
+                {
+                    config.snoop_filter = SnoopFilterType::NONE;
+                }
+                else if (value == "EXACT" || value == "exact")
+                {
+                    config.snoop_filter = SnoopFilterType::EXACT;
+                }
+                else if (value == "BOUNDED" || value == "bounded")
+                {
+                    config.snoop_filter = SnoopFilterType::BOUNDED;
+                }
+                else
+                {
+                    std::cerr << "Invalid Snoop Filter" << std::endl;
+                    exit(1);
+                }
+            }
+            else if (key == "dir_encoding")
+            {
+                if (value == "FULL" || value == "full")
+                {
+                    config.dir_encoding = DirEncoding::FULL;
+                }
+                else if (value == "LIMITED_B" || value == "limited_b")
+                {
+                    config.dir_encoding = DirEncoding::LIMITED_B;
+                }
+                else if (value == "LIMITED_NB" || value == "limited_nb")
+                {
+                    config.dir_encoding = DirEncoding::LIMITED_NB;
+                }
+                else if (value == "COARSE" || value == "coarse")
+                {
+                    config.dir_encoding = DirEncoding::COARSE;
+                }
+                else
+                {
+                    std::cerr << "Invalid Directory Encoding" << std::endl;
+                    exit(1);
+                }
+            }
+            else if (key == "dir_pointers")
+            {
+                config.dir_pointers = std::stoul(value);
+            }
+            else if (key == "dir_group")
+            {
+                config.dir_group = std::stoul(value);
+            }
+            else if (key == "dir_entries")
+            {
+                config.dir_entries = std::stoul(value);
+            }
+            else if (key == "dir_assoc")
+            {
+                config.dir_assoc = std::stoul(value);
+            }
+            else if (key == "dir_replacement")
+            {
+                config.dir_replacement = parseReplacement(value);
+            }
+            else if (key == "dir_banks")
+            {
+                config.dir_banks = std::stoul(value);
+            }
+            else if (key == "dir_interleave")
+            {
+                config.dir_interleave = std::stoul(value);
+            }
+            else if (key == "dir_bank_cycles")
+            {
+                config.dir_bank_cycles = std::stoul(value);
+            }
+            else if (key == "snoop_filter_entries")
+            {
+                config.snoop_filter_entries = std::stoul(value);
+            }
+            else if (key == "snoop_filter_assoc")
+            {
+                config.snoop_filter_assoc = std::stoul(value);
+            }
+            else if (key == "victim_entries")
+            {
+                config.victim_entries = std::stoul(value);
+            }
+            else if (key == "wb_buffer_entries")
+            {
+                config.wb_buffer_entries = std::stoul(value);
+            }
+            else if (key == "mshrs")
+            {
+                config.mshrs = std::stoul(value);
+            }
+            else if (key == "miss_latency")
+            {
+                config.miss_latency = std::stoul(value);
+            }
+            else if (key == "hop_latency")
+            {
+                config.hop_latency = std::stoul(value);
+            }
+            else if (key == "max_outstanding")
+            {
+                config.max_outstanding = std::stoul(value);
+            }
+            else if (key == "scheduler")
+            {
+                if (value == "CYCLE" || value == "cycle")
+                {
+                    config.scheduler = SchedulerType::CYCLE;
+                }
+                else if (value == "EVENT" || value == "event")
+                {
+                    config.scheduler = SchedulerType::EVENT;
+                }
+                else
+                {
+                    std::cerr << "Invalid Scheduler" << std::endl;
+                    exit(1);
+                }
+            }
+            else if (key == "prefetcher")
+            {
+                if (value == "NONE" || value == "none")
+                {
+                    config.prefetcher = PrefetcherType::NONE;
+                }
+                else if (value == "NEXT_LINE" || value == "next_line")
+                {
+                    config.prefetcher = PrefetcherType::NEXT_LINE;
+                }
+                else if (value == "STRIDE" || value == "stride")
+                {
+                    config.prefetcher = PrefetcherType::STRIDE;
+                }
+                else if (value == "ADJACENT" || value == "adjacent")
+                {
+                    config.prefetcher = PrefetcherType::ADJACENT;
+                }
+                else
+                {
+                    std::cerr << "Invalid Prefetcher" << std::endl;
+                    exit(1);
+                }
+            }
+            else if (key == "prefetch_degree")
+            {
+                config.prefetch_degree = std::stoul(value);
+            }
+            else if (key == "line_states")
+            {
+                config.line_states = (value == "true" || value == "1");
+            }
+            else if (key == "remap_lines")
+            {
+                config.remap_lines = (value == "true" || value == "1");
+            }
+            else if (key == "trace_offset")
+            {
+                config.trace_offset = std::stoul(value);
+            }
+            else if (key == "trace_limit")
+            {
+                config.trace_limit = std::stoul(value);
+            }
+            else if (key == "trace_threads")
+            {
+                config.trace_threads = std::stoi(value);
+            }
+            else if (key == "trace_depth")
+            {
+                config.trace_depth = std::stoi(value);
+                if (config.trace_depth == 0)
+                {
+                    std::cerr << "Invalid Trace Depth" << std::endl;
+                    exit(1);
+                }
+            }
+            else if (key == "trace_batch")
+            {
+                config.trace_batch = std::stoi(value);
+                if (config.trace_batch == 0)
+                {
+                    std::cerr << "Invalid Trace Batch" << std::endl;
+                    exit(1);
+                }
+            }
             else
             {
                 std::cerr << "Unknown key: " << key << std::endl;
@@ -118,8 +486,54 @@ namespace csim
         std::cout << "directory: " << config.directory << "\n";
         std::cout << "cohertypes: " << config.cohertype << "\n";
         std::cout << "\ncoherproto: " << config.coherproto << "\n";
+        std::cout << "protocol_spec: " << config.protocol_spec << "\n";
         std::cout << "cache_line_size: " << config.cache_line_size << "\n";
         std::cout << "cache_size: " << config.cache_size << "\n";
+        std::cout << "cache_assoc: " << config.cache_assoc << "\n";
+        std::cout << "replacement: " << config.replacement << "\n";
+        std::cout << "cache_latency: " << config.cache_latency << "\n";
+        std::cout << "l1_size: " << config.l1_size << "\n";
+        std::cout << "l1_assoc: " << config.l1_assoc << "\n";
+        std::cout << "l1_latency: " << config.l1_latency << "\n";
+        std::cout << "llc_size: " << config.llc_size << "\n";
+        std::cout << "llc_assoc: " << config.llc_assoc << "\n";
+        std::cout << "llc_latency: " << config.llc_latency << "\n";
+        std::cout << "llc_inclusion: " << config.llc_inclusion << "\n";
+        std::cout << "mem_latency: " << config.mem_latency << "\n";
+        std::cout << "line_states: " << (config.line_states ? "true" : "false") << "\n";
+        std::cout << "snoop_filter: " << config.snoop_filter << "\n";
+        std::cout << "snoop_filter_entries: " << config.snoop_filter_entries << "\n";
+        std::cout << "snoop_filter_assoc: " << config.snoop_filter_assoc << "\n";
+        std::cout << "victim_entries: " << config.victim_entries << "\n";
+        std::cout << "wb_buffer_entries: " << config.wb_buffer_entries << "\n";
+        std::cout << "mshrs: " << config.mshrs << "\n";
+        std::cout << "miss_latency: " << config.miss_latency << "\n";
+        std::cout << "max_outstanding: " << config.max_outstanding << "\n";
+        std::cout << "scheduler: " << config.scheduler << "\n";
+        std::cout << "prefetcher: " << config.prefetcher << "\n";
+        std::cout << "prefetch_degree: " << config.prefetch_degree << "\n";
         std::cout << "diropt: " << (config.diropt ? "true" : "false") << "\n";
+        std::cout << "hop_latency: " << config.hop_latency << "\n";
+        std::cout << "dir_encoding: " << config.dir_encoding << "\n";
+        std::cout << "dir_pointers: " << config.dir_pointers << "\n";
+        std::cout << "dir_group: " << config.dir_group << "\n";
+        std::cout << "dir_entries: " << config.dir_entries << "\n";
+        std::cout << "dir_assoc: " << config.dir_assoc << "\n";
+        std::cout << "dir_replacement: " << config.dir_replacement << "\n";
+        std::cout << "dir_banks: " << config.dir_banks << "\n";
+        std::cout << "dir_interleave: " << config.dir_interleave << "\n";
+        std::cout << "dir_bank_cycles: " << config.dir_bank_cycles << "\n";
+        std::cout << "trace_format: " << config.trace_format << "\n";
+        std::cout << "workload: " << config.workload << "\n";
+        std::cout << "num_accesses: " << config.num_accesses << "\n";
+        std::cout << "seed: " << config.seed << "\n";
+        std::cout << "stream: " << config.stream << "\n";
+        std::cout << "stream_depth: " << config.stream_depth << "\n";
+        std::cout << "remap_lines: " << (config.remap_lines ? "true" : "false") << "\n";
+        std::cout << "trace_offset: " << config.trace_offset << "\n";
+        std::cout << "trace_limit: " << config.trace_limit << "\n";
+        std::cout << "trace_threads: " << config.trace_threads << "\n";
+        std::cout << "trace_depth: " << config.trace_depth << "\n";
+        std::cout << "trace_batch: " << config.trace_batch << "\n";
     }
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "cache.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace csim
+{
+    VictimCache::VictimCache(size_t num_entries) : num_entries_(num_entries)
+    {
+        assert(num_entries_ > 0);
+        lines_.reserve(num_entries_);
+    }
+
+    CoherenceState VictimCache::get(size_t address) const
+    {
+        for (const CacheLine &line : lines_)
+        {
+            if (line.address == address)
+            {
+                return line.state;
+            }
+        }
+        return CoherenceState::INVALID;
+    }
+
+    bool VictimCache::update(size_t address, CoherenceState state)
+    {
+        for (auto it = lines_.begin(); it != lines_.end(); ++it)
+        {
+            if (it->address == address)
+            {
+                if (state == CoherenceState::INVALID)
+                {
+                    lines_.erase(it);
+                }
+                else
+                {
+                    it->state = state;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::optional<CacheLine> VictimCache::take(size_t address)
+    {
+        for (auto it = lines_.begin(); it != lines_.end(); ++it)
+        {
+            if (it->address == address)
+            {
+                CacheLine line = *it;
+                lines_.erase(it);
+                return line;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::optional<CacheLine> VictimCache::insert(const CacheLine &line)
+    {
+        assert(line.state != CoherenceState::INVALID);
+        std::optional<CacheLine> evicted;
+        if (lines_.size() == num_entries_)
+        {
+            evicted = lines_.back();
+            lines_.pop_back();
+        }
+        lines_.insert(lines_.begin(), line);
+        return evicted;
+    }
+
+    WritebackBuffer::WritebackBuffer(size_t num_entries) : num_entries_(num_entries)
+    {
+        assert(num_entries_ > 0);
+    }
+
+    bool WritebackBuffer::holds(size_t address) const
+    {
+        return std::find(lines_.begin(), lines_.end(), address) != lines_.end();
+    }
+
+    void WritebackBuffer::push(size_t address)
+    {
+        assert(!full() && !holds(address));
+        lines_.push_back(address);
+    }
+
+    size_t WritebackBuffer::pop()
+    {
+        assert(!empty());
+        size_t address = lines_.front();
+        lines_.pop_front();
+        return address;
+    }
+
+    void WritebackBuffer::erase(size_t address)
+    {
+        lines_.erase(std::remove(lines_.begin(), lines_.end(), address), lines_.end());
+    }
+
+    MSHRFile::MSHRFile(size_t num_entries) : num_entries_(num_entries)
+    {
+        assert(num_entries_ > 0);
+        entries_.reserve(num_entries_);
+    }
+
+    MSHR *MSHRFile::find(size_t address)
+    {
+        for (MSHR &mshr : entries_)
+        {
+            if (mshr.address == address)
+            {
+                return &mshr;
+            }
+        }
+        return nullptr;
+    }
+
+    MSHR &MSHRFile::allocate(const CPUMsg &cpureq)
+    {
+        assert(!full() && !find(cpureq.inst_.address));
+        entries_.push_back(MSHR{.address = cpureq.inst_.address, .targets = {cpureq}, .issued = false, .answered = false, .ready_cycle = 0});
+        return entries_.back();
+    }
+
+    void MSHRFile::release(size_t address)
+    {
+        auto it = std::find_if(entries_.begin(), entries_.end(), [address](const MSHR &mshr)
+                               { return mshr.address == address; });
+        assert(it != entries_.end());
+        entries_.erase(it);
+    }
+
+    MSHR *MSHRFile::nextToIssue()
+    {
+        for (MSHR &mshr : entries_)
+        {
+            if (!mshr.issued)
+            {
+                return &mshr;
+            }
+        }
+        return nullptr;
+    }
+
+    MSHR *MSHRFile::nextReady(size_t now)
+    {
+        for (MSHR &mshr : entries_)
+        {
+            if (mshr.answered && mshr.ready_cycle <= now)
+            {
+                return &mshr;
+            }
+        }
+        return nullptr;
+    }
+
+    std::optional<size_t> MSHRFile::readyCycle() const
+    {
+        std::optional<size_t> ready;
+        for (const MSHR &mshr : entries_)
+        {
+            if (mshr.answered && (!ready || mshr.ready_cycle < *ready))
+            {
+                ready = mshr.ready_cycle;
+            }
+        }
+        return ready;
+    }
+}
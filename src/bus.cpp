@@ -1,11 +1,14 @@
 #include "bus.hpp"
 #include "globals.hpp"
 #include "cache.hpp"
+#include "hierarchy.hpp"
+#include <algorithm>
 #include <cassert>
 
 namespace csim
 {
-    void SnoopBus::cycle()
+    template <typename Protocol, typename Policy>
+    void SnoopBus<Protocol, Policy>::cycle()
     {
         // process a request from bus.
         if (curr_msg_)
@@ -22,7 +25,8 @@ namespace csim
 
             for (size_t proc = 0; proc < num_proc_; proc++)
             {
-                if (src != proc)
+                // the snoop filter knows which caches cannot hold the line.
+                if (src != proc && caches_->deliverSnoop(busreq.cpureq_.inst_.address, proc))
                 {
                     // record interconnect traffic
                     stats_->interconstats.traffic++;
@@ -34,10 +38,19 @@ namespace csim
                 }
             }
 
+            // the data comes from another cache or, failing that, from below the bus.
+            size_t shared_latency = 0;
+            if (hierarchy_ && busreq.type_ != BusMsgType::UPGRADE)
+            {
+                shared_latency = hierarchy_->sharedAccess(busreq.cpureq_.inst_.address, src, curr_msg_->state == BusState::PROCESSING);
+            }
+
             // caches will change state if necessary. Now check state.
             BusMsg busresp;
             busresp = curr_msg_->busmsg;
             busresp.dst_proc_ = src;
+            // stamped with the cycle the data is back from the levels below the bus.
+            busresp.proc_cycle_ = std::max(busresp.proc_cycle_, cycles + shared_latency);
 
             if (curr_msg_->state == BusState::CACHEDATA)
             {
@@ -61,8 +74,9 @@ namespace csim
             else if (curr_msg_->state == BusState::PROCESSING)
             {
                 // TODO maybe handle edge case for upgrades, not necessary for now.
-                // cache didn't provide data, memory will
-                busresp.type_ = BusMsgType::MEMDATA;
+                // cache didn't provide data, memory will. A read still has to come back
+                // shared if a clean copy outlived its evicted owner.
+                busresp.type_ = (busreq.type_ == BusMsgType::READ && caches_->hasCopy(busreq.cpureq_.inst_.address, src)) ? BusMsgType::MEMSHARED : BusMsgType::MEMDATA;
 
                 // simulate traffic for memory providing data.
                 stats_->interconstats.traffic+=2;
@@ -75,17 +89,21 @@ namespace csim
             // std::cout << "Traffic count " << stats_->interconstats.traffic << std::endl;
             curr_msg_.reset();
         }
-
-        turn_ = (turn_ + 1) % num_proc_;
+        else
+        {
+            // an idle bus drains buffered writebacks.
+            caches_->drainWriteback();
+        }
     }
 
-    SnoopBus::SnoopBus(size_t num_proc, SnoopCaches *caches, Stats *stats) : num_proc_(num_proc), caches_(caches), stats_(stats)
+    template <typename Protocol, typename Policy>
+    SnoopBus<Protocol, Policy>::SnoopBus(size_t num_proc, SnoopCaches<Protocol, Policy> *caches, Stats *stats) : num_proc_(num_proc), caches_(caches), stats_(stats)
     {
         curr_msg_ = std::nullopt;
-        turn_ = 0;
     }
 
-    void SnoopBus::requestFromCache(BusMsg busmsg)
+    template <typename Protocol, typename Policy>
+    void SnoopBus<Protocol, Policy>::requestFromCache(BusMsg busmsg)
     {
         // record interconnect traffic
         stats_->interconstats.traffic++;
@@ -93,13 +111,14 @@ namespace csim
 
         // received request from cache.
         // can be rd/wr/upg
-        assert(busmsg.src_proc_ == turn_);
+        assert(isCacheTurn(busmsg.src_proc_));
         assert(busmsg.type_ == BusMsgType::READ || busmsg.type_ == BusMsgType::WRITE || busmsg.type_ == BusMsgType::UPGRADE);
         assert(!curr_msg_);
         curr_msg_ = CurrMsg{.busmsg = busmsg, .state = BusState::PROCESSING};
     }
 
-    void SnoopBus::replyFromCache(BusMsg busmsg)
+    template <typename Protocol, typename Policy>
+    void SnoopBus<Protocol, Policy>::replyFromCache(BusMsg busmsg)
     {
         // record interconnect traffic
         stats_->interconstats.traffic++;
@@ -121,13 +140,65 @@ namespace csim
         }
     }
 
-    void SnoopBus::setCaches(SnoopCaches *caches)
+    template <typename Protocol, typename Policy>
+    void SnoopBus<Protocol, Policy>::writebackFromCache(BusMsg busmsg)
+    {
+        // a dirty line being evicted, its data goes to memory.
+        assert(busmsg.type_ == BusMsgType::WRITEBACK);
+        stats_->interconstats.traffic++;
+        stats_->interconstats.mem_data_traffic++;
+        if (hierarchy_)
+        {
+            hierarchy_->writeback(busmsg.cpureq_.inst_.address);
+        }
+    }
+
+    template <typename Protocol, typename Policy>
+    void SnoopBus<Protocol, Policy>::setCaches(SnoopCaches<Protocol, Policy> *caches)
     {
         caches_ = caches;
     }
 
-    bool SnoopBus::isCacheTurn(size_t proc)
+    template <typename Protocol, typename Policy>
+    void SnoopBus<Protocol, Policy>::setHierarchy(Hierarchy<Policy> *hierarchy)
     {
+        hierarchy_ = hierarchy;
+    }
+
+    template <typename Protocol, typename Policy>
+    bool SnoopBus<Protocol, Policy>::isCacheTurn(size_t proc)
+    {
+        // the turn passes on every cycle, busy or idle, also those the bus is not stepped in.
+        if (turn_cycle_ != cycles)
+        {
+            turn_ = cycles % num_proc_;
+            turn_cycle_ = cycles;
+        }
         return proc == turn_;
     }
-}
\ No newline at end of file
+
+    template <typename Protocol, typename Policy>
+    size_t SnoopBus<Protocol, Policy>::nextTurn(size_t proc, size_t from) const
+    {
+        return from + (proc + num_proc_ - from % num_proc_) % num_proc_;
+    }
+
+    template <typename Protocol, typename Policy>
+    size_t SnoopBus<Protocol, Policy>::turns(size_t proc, size_t from, size_t to) const
+    {
+        // turns in [0, cycle) are the cycles proc, proc + num_proc_, ... below cycle.
+        auto before = [this, proc](size_t cycle)
+        { return (cycle + num_proc_ - 1 - proc) / num_proc_; };
+        return before(to) - before(from);
+    }
+
+#define INSTANTIATE(Policy)                                                     \
+    template class SnoopBus<BuiltinProtocol<CoherenceProtocol::MI>, Policy>;    \
+    template class SnoopBus<BuiltinProtocol<CoherenceProtocol::MSI>, Policy>;   \
+    template class SnoopBus<BuiltinProtocol<CoherenceProtocol::MESI>, Policy>;  \
+    template class SnoopBus<BuiltinProtocol<CoherenceProtocol::MOESI>, Policy>; \
+    template class SnoopBus<BuiltinProtocol<CoherenceProtocol::MESIF>, Policy>; \
+    template class SnoopBus<SpecProtocol, Policy>;
+    CSIM_REPLACEMENT_POLICIES(INSTANTIATE)
+#undef INSTANTIATE
+}
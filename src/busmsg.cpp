@@ -26,6 +26,12 @@ namespace csim
         case BusMsgType::MEMDATA:
             os << "MEMDATA";
             break;
+        case BusMsgType::MEMSHARED:
+            os << "MEMSHARED";
+            break;
+        case BusMsgType::WRITEBACK:
+            os << "WRITEBACK";
+            break;
         }
         return os;
     }
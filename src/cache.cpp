@@ -3,1059 +3,1232 @@
 #include "bus.hpp"
 #include <cassert>
 #include "directory.hpp"
+#include "hierarchy.hpp"
 
 namespace csim
 {
-    void SnoopCaches::cycle()
+    namespace
+    {
+        // A finite cache's line may sit in its sets or its victim cache.
+        template <typename Policy>
+        CoherenceState finiteState(const Cache<Policy> &cache, size_t address)
+        {
+            CoherenceState state = cache.sets->get(address);
+            if (state == CoherenceState::INVALID && cache.victims)
+            {
+                state = cache.victims->get(address);
+            }
+            return state;
+        }
+
+        // Returns the line that left the cache to make room, if any.
+        template <typename Policy>
+        std::optional<CacheLine> setFiniteState(Cache<Policy> &cache, size_t address, CoherenceState state)
+        {
+            if (cache.victims && cache.victims->update(address, state))
+            {
+                return std::nullopt;
+            }
+            std::optional<CacheLine> victim = cache.sets->set(address, state);
+            if (victim && cache.victims)
+            {
+                victim = cache.victims->insert(*victim);
+            }
+            return victim;
+        }
+
+        // Moves a re-referenced line from the victim cache back into the sets, the line it
+        // replaces takes its place in the victim cache.
+        template <typename Policy>
+        bool promoteVictim(Cache<Policy> &cache, size_t address)
+        {
+            if (!cache.victims)
+            {
+                return false;
+            }
+            std::optional<CacheLine> line = cache.victims->take(address);
+            if (!line)
+            {
+                return false;
+            }
+            if (std::optional<CacheLine> victim = cache.sets->set(address, line->state))
+            {
+                cache.victims->insert(*victim);
+            }
+            return true;
+        }
+    }
+
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::cycle()
     {
-        // try to process request from processor.
         for (size_t proc = 0; proc < num_procs_; proc++)
         {
-            Cache &cache = caches_[proc];
+            step(proc);
+        }
+        stepInterconnect();
+    }
 
-            if (!cache.pending_cpu_req)
-                continue;
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::step(size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        if (cache.stepped < cycles)
+        {
+            sampleSkipped(proc);
+        }
+        stats_->mshrstats.occupancy += cache.mshrs.size();
+        stats_->mshrstats.samples++;
+        cache.stepped = cycles + 1;
+        completeMisses(proc);
+
+        if (!snoopbus_->isCacheTurn(proc))
+        {
+            schedule(proc, cycles + 1);
+            return;
+        }
 
-            if (!snoopbus_->isCacheTurn(proc))
+        // look up the processor's requests in order, a miss that finds no free MSHR
+        // holds back the ones behind it.
+        while (!cache.cpu_reqs.empty())
+        {
+            CPUMsg &cpureq = cache.cpu_reqs.front();
+            size_t address = cpureq.inst_.address;
+            if (MSHR *mshr = cache.mshrs.find(address))
             {
+                // a secondary miss waits for the line already being fetched.
+                stats_->cachestats[proc].misses++;
+                stats_->mshrstats.merges++;
+                if (!prefetchers_.empty())
+                {
+                    prefetchers_[proc].access(address, true);
+                }
+                mshr->targets.push_back(cpureq);
+                cache.cpu_reqs.pop_front();
                 continue;
             }
-            // there is a pending request from processor
-            if (isAHit(cache.pending_cpu_req.value(), proc))
+
+            bool hit = accessLine(cpureq, proc);
+            if (!hit && cache.mshrs.full())
+            {
+                stats_->mshrstats.full_stalls++;
+                break;
+            }
+            if (!prefetchers_.empty())
+            {
+                prefetchers_[proc].access(address, !hit);
+            }
+            if (hit)
             {
-                // std::cout << proc << "it is a hit " << cache.pending_cpu_req.value() << std::endl;
+                // std::cout << proc << "it is a hit " << cpureq << std::endl;
                 // record cache hit
                 stats_->cachestats[proc].hits++;
+                if (hierarchy_)
+                {
+                    hierarchy_->privateHit(address, proc);
+                }
 
-                CPUMsg cpuresp = cache.pending_cpu_req.value();
+                CPUMsg cpuresp = cpureq;
                 cpuresp.msgtype = CPUMsgType::RESPONSE;
                 cpus_->replyFromCache(cpuresp);
-                cache.pending_cpu_req.reset();
             }
             else
             {
                 stats_->cachestats[proc].misses++;
-                BusMsg busreq;
-
-                if ((coherproto_ == CoherenceProtocol::MESIF || coherproto_ == CoherenceProtocol::MOESI || coherproto_ == CoherenceProtocol::MESI || coherproto_ == CoherenceProtocol::MSI) && (cache.pending_cpu_req->inst_.command == OperationType::MEM_STORE) && (getCoherenceState(cache.pending_cpu_req->inst_.address, proc) == CoherenceState::SHARED || getCoherenceState(cache.pending_cpu_req->inst_.address, proc) == CoherenceState::OWNED || getCoherenceState(cache.pending_cpu_req->inst_.address, proc) == CoherenceState::FORWARDER))
+                if (hierarchy_)
                 {
-                    busreq = BusMsg{
-                        .proc_cycle_ = cycles,
-                        .type_ = BusMsgType::UPGRADE,
-                        .cpureq_ = cache.pending_cpu_req.value(),
-                        .src_proc_ = proc,
-                        .dst_proc_ = BROADCAST,
-                    };
-                    snoopbus_->requestFromCache(busreq);
+                    hierarchy_->privateMiss(address, proc);
                 }
-                else
-                {
-                    busreq = BusMsg{
-                        .proc_cycle_ = cycles,
-                        .type_ = (cache.pending_cpu_req->inst_.command == OperationType::MEM_LOAD) ? BusMsgType::READ : BusMsgType::WRITE,
-                        .cpureq_ = cache.pending_cpu_req.value(),
-                        .src_proc_ = proc,
-                        .dst_proc_ = BROADCAST,
-                    };
-                    snoopbus_->requestFromCache(busreq);
-                }
-
-                // std::cout << proc << " sent request on bus " << busreq << std::endl;
+                cache.mshrs.allocate(cpureq);
             }
+            cache.cpu_reqs.pop_front();
         }
+        cache.stalled = !cache.cpu_reqs.empty();
+        stats_->mshrstats.max_occupancy = std::max(stats_->mshrstats.max_occupancy, cache.mshrs.size());
 
+        // the turn carries one miss, or a predicted line if no miss needs it.
+        if (MSHR *mshr = cache.mshrs.nextToIssue())
+        {
+            issueMiss(*mshr, proc);
+        }
+        else if (!prefetchers_.empty())
+        {
+            issuePrefetch(proc);
+        }
+        if (events_ && !snoopbus_->idle())
+        {
+            events_->wake(Component::INTERCONNECT, 0, cycles);
+        }
+        schedule(proc, cycles + 1);
+    }
+
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::stepInterconnect()
+    {
         snoopbus_->cycle();
+        // an idle bus drains one buffered writeback per cycle.
+        if (events_ && buffersWritebacks())
+        {
+            events_->wake(Component::INTERCONNECT, 0, cycles + 1);
+        }
+    }
+
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::issueMiss(MSHR &mshr, size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        CPUMsg &cpureq = mshr.targets.front();
+        mshr.issued = true;
+
+        // memory must be current before the bus is asked for a line still being written back.
+        if (cache.writebacks && cache.writebacks->holds(mshr.address))
+        {
+            flushWriteback(mshr.address, proc);
+        }
+
+        bool upgrade = cpureq.inst_.command == OperationType::MEM_STORE && protocol_.table().upgrades(getCoherenceState(mshr.address, proc));
+        BusMsg busreq = BusMsg{
+            .proc_cycle_ = cycles,
+            .type_ = upgrade ? BusMsgType::UPGRADE : (cpureq.inst_.command == OperationType::MEM_LOAD) ? BusMsgType::READ : BusMsgType::WRITE,
+            .cpureq_ = cpureq,
+            .src_proc_ = proc,
+            .dst_proc_ = BROADCAST,
+        };
+        snoopbus_->requestFromCache(busreq);
+
+        // std::cout << proc << " sent request on bus " << busreq << std::endl;
+    }
+
+    // Answers the accesses of every MSHR whose data has arrived.
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::completeMisses(size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        while (MSHR *mshr = cache.mshrs.nextReady(cycles))
+        {
+            // the access that sent the request was performed on the bus, merged ones
+            // may still need an upgrade and go out again.
+            CPUMsg cpuresp = mshr->targets.front();
+            cpuresp.msgtype = CPUMsgType::RESPONSE;
+            cpus_->replyFromCache(cpuresp);
+            mshr->targets.erase(mshr->targets.begin());
+            while (!mshr->targets.empty() && isAHit(mshr->targets.front(), proc))
+            {
+                cpuresp = mshr->targets.front();
+                cpuresp.msgtype = CPUMsgType::RESPONSE;
+                cpus_->replyFromCache(cpuresp);
+                mshr->targets.erase(mshr->targets.begin());
+            }
+            if (mshr->targets.empty())
+            {
+                cache.mshrs.release(mshr->address);
+                cache.stalled = false;
+            }
+            else
+            {
+                mshr->issued = false;
+                mshr->answered = false;
+            }
+        }
     }
 
-    void SnoopCaches::requestFromProcessor(CPUMsg cpureq)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::requestFromProcessor(CPUMsg cpureq)
     {
         size_t proc = cpureq.proc_;
-        Cache &cache = caches_[proc];
-        assert(!cache.pending_cpu_req);
-        cache.pending_cpu_req = cpureq;
+        caches_[proc].cpu_reqs.push_back(cpureq);
+        schedule(proc, cycles);
     }
 
-    void SnoopCaches::requestFromBus(BusMsg busmsg)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::requestFromBus(BusMsg busmsg)
     {
         // another processor sent a request.
         // can be rd/wr/upgr
         // respond if you have it, depends on snooping protocol.
 
         size_t proc = busmsg.dst_proc_;
-        std::optional<BusMsg> busresp;
-        switch (coherproto_)
+        size_t address = busmsg.cpureq_.inst_.address;
+        Cache<Policy> &cache = caches_[proc];
+        if (cache.writebacks && cache.writebacks->holds(address))
         {
-        case CoherenceProtocol::MI:
-            busresp = requestFromBusMI(busmsg, proc);
-            break;
-        case CoherenceProtocol::MSI:
-            busresp = requestFromBusMSI(busmsg, proc);
-            break;
-        case CoherenceProtocol::MESI:
-            busresp = requestFromBusMESI(busmsg, proc);
-            break;
-        case CoherenceProtocol::MOESI:
-            busresp = requestFromBusMOESI(busmsg, proc);
-            break;
-        case CoherenceProtocol::MESIF:
-            busresp = requestFromBusMESIF(busmsg, proc);
-            break;
+            // the buffered line is newer than memory, so the buffer answers. A writer takes
+            // it over and the writeback is dropped, a reader gets a copy.
+            stats_->bufferstats.wb_snoop_hits++;
+            if (busmsg.type_ != BusMsgType::READ)
+            {
+                cache.writebacks->erase(address);
+                if (snoop_filter_)
+                {
+                    snoop_filter_->remove(address, proc);
+                }
+            }
+            if (busmsg.type_ != BusMsgType::UPGRADE)
+            {
+                BusMsg busresp = busmsg;
+                busresp.dst_proc_ = busresp.src_proc_;
+                busresp.src_proc_ = proc;
+                // the buffered line is dirty, it answers as a MODIFIED copy would.
+                busresp.type_ = protocol_.table().snoop(CoherenceState::MODIFIED, busmsg.type_).reply;
+                snoopbus_->replyFromCache(std::move(busresp));
+            }
+            return;
+        }
+
+        CoherenceState state = getCoherenceState(address, proc);
+        const SnoopTransition &transition = protocol_.table().snoop(state, busmsg.type_);
+        if (!transition.defined)
+        {
+            std::cerr << "something is broken: " << protocol_.table().name() << " " << state << " snooped " << busmsg.type_ << std::endl;
+            assert(false);
+        }
+        if (transition.next != state)
+        {
+            setCoherenceState(address, transition.next, proc);
         }
-        if (busresp)
+        if (transition.replies)
         {
-            snoopbus_->replyFromCache(std::move(*busresp));
+            BusMsg busresp = busmsg;
+            busresp.dst_proc_ = busresp.src_proc_;
+            busresp.src_proc_ = proc;
+            busresp.type_ = transition.reply;
+            snoopbus_->replyFromCache(std::move(busresp));
         }
     }
 
-    void SnoopCaches::replyFromBus(BusMsg busmsg)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::replyFromBus(BusMsg busmsg)
     {
         // another processor/Memory sent a reply.
         // can be data/shared/memory.
         // depends on coherence protocol.
 
         size_t proc = busmsg.dst_proc_;
+        // an upgrade re-references a resident line, a fill is placed by the replacement policy.
+        bool resident = getCoherenceState(busmsg.cpureq_.inst_.address, proc) != CoherenceState::INVALID;
 
-        CPUMsg cpuresp;
-        switch (coherproto_)
+        CoherenceState fill = protocol_.table().fill(busmsg.type_, busmsg.cpureq_.inst_.command);
+        assert(fill != CoherenceState::INVALID);
+        setCoherenceState(busmsg.cpureq_.inst_.address, fill, proc);
+        CPUMsg cpuresp = busmsg.cpureq_;
+        cpuresp.msgtype = CPUMsgType::RESPONSE;
+
+        if (caches_[proc].pending_prefetch)
         {
-        case CoherenceProtocol::MI:
-            cpuresp = replyFromBusMI(busmsg, proc);
-            break;
-        case CoherenceProtocol::MSI:
-            cpuresp = replyFromBusMSI(busmsg, proc);
-            break;
-        case CoherenceProtocol::MESI:
-            cpuresp = replyFromBusMESI(busmsg, proc);
-            break;
-        case CoherenceProtocol::MOESI:
-            cpuresp = replyFromBusMOESI(busmsg, proc);
-            break;
-        case CoherenceProtocol::MESIF:
-            cpuresp = replyFromBusMESIF(busmsg, proc);
-            break;
+            // nobody waits for a prefetch, the line just lands in the cache.
+            assert(*caches_[proc].pending_prefetch == cpuresp.inst_.address);
+            prefetchers_[proc].filled(cpuresp.inst_.address);
+            caches_[proc].pending_prefetch.reset();
+            // a stalled request may have been waiting for this very line.
+            caches_[proc].stalled = false;
+            schedule(proc, cycles + 1);
+            return;
         }
 
-        assert(caches_[proc].pending_cpu_req);
-        assert(caches_[proc].pending_cpu_req.value() == cpuresp);
-        cpus_->replyFromCache(std::move(cpuresp));
-        caches_[proc].pending_cpu_req.reset();
+        MSHR *mshr = caches_[proc].mshrs.find(cpuresp.inst_.address);
+        assert(mshr && mshr->issued && !mshr->answered);
+        assert(mshr->targets.front() == cpuresp);
+        if (resident)
+        {
+            touchLine(cpuresp.inst_.address, proc);
+        }
+        if (hierarchy_)
+        {
+            hierarchy_->fill(cpuresp.inst_.address, proc);
+        }
+        // the reply is stamped with the cycle the data is back, the private levels add theirs.
+        mshr->answered = true;
+        mshr->ready_cycle = std::max(cycles, busmsg.proc_cycle_) + miss_latency_ + (hierarchy_ ? hierarchy_->missLatency() : 0);
+        completeMisses(proc);
+        schedule(proc, cycles + 1);
     }
 
-    SnoopCaches::SnoopCaches(size_t num_procs, SnoopBus *snoopbus, CPUS *cpus, CoherenceProtocol coherproto, Stats *stats) : num_procs_(num_procs), snoopbus_(snoopbus), cpus_(cpus), coherproto_(coherproto), stats_(stats)
+    template <typename Protocol, typename Policy>
+    SnoopCaches<Protocol, Policy>::SnoopCaches(size_t num_procs, SnoopBus<Protocol, Policy> *snoopbus, CPUS<SnoopCaches> *cpus, Protocol protocol, Stats *stats, const CacheGeometry &geometry) : num_procs_(num_procs), snoopbus_(snoopbus), cpus_(cpus), protocol_(protocol), stats_(stats)
     {
-        caches_ = std::vector(num_procs_, Cache{.lines = std::unordered_map<size_t, CoherenceState>(), .pending_cpu_req = std::nullopt});
+        caches_ = std::vector(num_procs_, Cache<Policy>{.lines = LineMap<CoherenceState>(CoherenceState::INVALID), .sets = std::nullopt, .victims = std::nullopt, .writebacks = std::nullopt, .cpu_reqs = {}, .mshrs = MSHRFile(1), .pending_prefetch = std::nullopt, .stepped = 0, .stalled = false});
+        if (geometry.num_sets > 0)
+        {
+            for (Cache<Policy> &cache : caches_)
+            {
+                cache.sets.emplace(geometry);
+            }
+        }
     }
 
-    void SnoopCaches::setBus(SnoopBus *snoopbus)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::setBus(SnoopBus<Protocol, Policy> *snoopbus)
     {
         snoopbus_ = snoopbus;
     }
 
-    void SnoopCaches::setCPUs(CPUS *cpus)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::setCPUs(CPUS<SnoopCaches> *cpus)
     {
         cpus_ = cpus;
     }
 
-    bool SnoopCaches::isAHit(CPUMsg &cpureq, size_t proc)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::setHierarchy(Hierarchy<Policy> *hierarchy)
     {
-        // TODO: might depend on coherence protocol
-        switch (coherproto_)
-        {
-        case CoherenceProtocol::MI:
-            return isAHitMI(cpureq, proc);
-        case CoherenceProtocol::MSI:
-            return isAHitMSI(cpureq, proc);
-        case CoherenceProtocol::MESI:
-            return isAHitMESI(cpureq, proc);
-        case CoherenceProtocol::MOESI:
-            return isAHitMOESI(cpureq, proc);
-        case CoherenceProtocol::MESIF:
-            return isAHitMESIF(cpureq, proc);
-        }
-
-        return true;
+        hierarchy_ = hierarchy;
     }
 
-    CoherenceState SnoopCaches::getCoherenceState(size_t address, size_t proc)
+    // Only valid for traces remapped to dense line IDs, addresses maps them back.
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::setLineAddresses(const std::vector<size_t> &addresses)
     {
-        Cache &cache = caches_[proc];
-        if (cache.lines.find(address) == cache.lines.end())
+        if (snoop_filter_)
         {
-            return CoherenceState::INVALID;
+            snoop_filter_->setLineAddresses(&addresses);
         }
-        return cache.lines[address];
-    }
-
-    void SnoopCaches::setCoherenceState(size_t address, CoherenceState newstate, size_t proc)
-    {
-        // record coherence invalidations
-        if (getCoherenceState(address, proc) != CoherenceState::INVALID && newstate == CoherenceState::INVALID)
+        if (line_states_)
         {
-            stats_->cachestats[proc].evictions++;
+            line_states_->makeDense(addresses.size());
         }
-
-        Cache &cache = caches_[proc];
-        cache.lines[address] = newstate;
-    }
-
-    std::optional<BusMsg> SnoopCaches::requestFromBusMI(BusMsg &busreq, size_t proc)
-    {
-        size_t address = busreq.cpureq_.inst_.address;
-        CoherenceState curr_state = getCoherenceState(address, proc);
-        BusMsgType busmsgtype = busreq.type_;
-
-        assert(busmsgtype == BusMsgType::READ || busmsgtype == BusMsgType::WRITE);
-        assert(curr_state == CoherenceState::MODIFIED || curr_state == CoherenceState::INVALID);
-
-        if (busmsgtype == BusMsgType::READ)
+        for (Cache<Policy> &cache : caches_)
         {
-            if (curr_state == CoherenceState::INVALID)
+            if (cache.sets)
             {
-                return std::nullopt;
+                cache.sets->setLineAddresses(&addresses);
             }
-            else if (curr_state == CoherenceState::MODIFIED)
+            else
             {
-                // std::cout << proc << " M->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
+                cache.lines.makeDense(addresses.size());
             }
         }
-        else if (busmsgtype == BusMsgType::WRITE)
+    }
+
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::useLineStates()
+    {
+        for (const Cache<Policy> &cache : caches_)
         {
-            if (curr_state == CoherenceState::INVALID)
-            {
-                return std::nullopt;
-            }
-            else if (curr_state == CoherenceState::MODIFIED)
-            {
-                // std::cout << proc << " M->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
+            assert(!cache.sets);
         }
-        return std::nullopt;
+        line_states_.emplace(num_procs_);
     }
 
-    CPUMsg SnoopCaches::replyFromBusMI(BusMsg &busresp, size_t proc)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::useSnoopFilter(SnoopFilterType type, size_t num_sets, size_t assoc, size_t line_size)
     {
-        size_t address = busresp.cpureq_.inst_.address;
-        CoherenceState curr_state = getCoherenceState(address, proc);
-        BusMsgType busmsgtype = busresp.type_;
-
-        assert(busmsgtype == BusMsgType::DATA || busmsgtype == BusMsgType::MEMDATA);
-        assert(curr_state == CoherenceState::INVALID);
-        setCoherenceState(address, CoherenceState::MODIFIED, proc);
-
-        CPUMsg cpuresp = busresp.cpureq_;
-        cpuresp.msgtype = CPUMsgType::RESPONSE;
+        snoop_filter_.emplace(type, num_procs_, num_sets, assoc, line_size);
+    }
 
-        return cpuresp;
+    template <typename Protocol, typename Policy>
+    const SnoopFilter *SnoopCaches<Protocol, Policy>::snoopFilter() const
+    {
+        return snoop_filter_ ? &*snoop_filter_ : nullptr;
     }
 
-    bool SnoopCaches::isAHitMI(CPUMsg &cpureq, size_t proc)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::useVictimCache(size_t num_entries)
     {
-        size_t address = cpureq.inst_.address;
-        CoherenceState currstate = getCoherenceState(address, proc);
-        return currstate == CoherenceState::MODIFIED;
+        for (Cache<Policy> &cache : caches_)
+        {
+            assert(cache.sets);
+            cache.victims.emplace(num_entries);
+        }
     }
-    std::optional<BusMsg> SnoopCaches::requestFromBusMSI(BusMsg &busreq, size_t proc)
+
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::useMSHRs(size_t num_entries, size_t miss_latency)
     {
-        size_t address = busreq.cpureq_.inst_.address;
-        CoherenceState curr_state = getCoherenceState(address, proc);
-        BusMsgType busmsgtype = busreq.type_;
+        for (Cache<Policy> &cache : caches_)
+        {
+            cache.mshrs = MSHRFile(num_entries);
+        }
+        miss_latency_ = miss_latency;
+    }
 
-        assert(busmsgtype == BusMsgType::READ || busmsgtype == BusMsgType::WRITE || busmsgtype == BusMsgType::UPGRADE);
-        assert(curr_state == CoherenceState::MODIFIED || curr_state == CoherenceState::SHARED || curr_state == CoherenceState::INVALID);
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::useScheduler(EventScheduler *events)
+    {
+        events_ = events;
+    }
 
-        if (busmsgtype == BusMsgType::READ)
+    // Wakes proc's cache for its next miss completion and, if it has requests to look
+    // up, a miss or a prefetch to send, for its first turn from cycle from. A request
+    // stalled on full MSHRs waits for a completion.
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::schedule(size_t proc, size_t from)
+    {
+        if (!events_)
         {
-            if (curr_state == CoherenceState::MODIFIED)
-            {
-                // std::cout << proc << " M->S " << address << std::endl;
-                setCoherenceState(address, CoherenceState::SHARED, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::SHARED;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::SHARED)
-            {
-                // std::cout << proc << " S->S " << address << std::endl;
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::SHARED;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::INVALID)
-            {
-                return std::nullopt;
-            }
+            return;
         }
-        else if (busmsgtype == BusMsgType::WRITE)
+        Cache<Policy> &cache = caches_[proc];
+        if (std::optional<size_t> ready = cache.mshrs.readyCycle())
         {
-            if (curr_state == CoherenceState::MODIFIED)
-            {
-                // std::cout << proc << " M->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::SHARED)
-            {
-                // std::cout << proc << " S->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::INVALID)
-            {
-                return std::nullopt;
-            }
+            events_->wake(Component::CACHE, proc, *ready);
         }
-        else if (busmsgtype == BusMsgType::UPGRADE)
+        bool lookups = !cache.cpu_reqs.empty() && !cache.stalled;
+        if (lookups || cache.mshrs.nextToIssue() || (!prefetchers_.empty() && !prefetchers_[proc].idle()))
         {
-            if (curr_state == CoherenceState::MODIFIED)
-            {
-                // std::cout << "something is broken" << std::endl;
-                assert(false);
-            }
-            else if (curr_state == CoherenceState::SHARED)
-            {
-                // std::cout << proc << " S->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                return std::nullopt;
-            }
-            else if (curr_state == CoherenceState::INVALID)
-            {
-                return std::nullopt;
-            }
+            events_->wake(Component::CACHE, proc, snoopbus_->nextTurn(proc, from));
         }
-        return std::nullopt;
     }
-    CPUMsg SnoopCaches::replyFromBusMSI(BusMsg &busresp, size_t proc)
+
+    // Cycles the cache was not stepped in left its MSHRs as they were, and a stalled
+    // request stalled again in each of its turns.
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::sampleSkipped(size_t proc)
     {
-        size_t address = busresp.cpureq_.inst_.address;
-        CoherenceState curr_state = getCoherenceState(address, proc);
-        BusMsgType busmsgtype = busresp.type_;
+        Cache<Policy> &cache = caches_[proc];
+        size_t skipped = cycles - cache.stepped;
+        stats_->mshrstats.occupancy += cache.mshrs.size() * skipped;
+        stats_->mshrstats.samples += skipped;
+        if (cache.stalled)
+        {
+            stats_->mshrstats.full_stalls += snoopbus_->turns(proc, cache.stepped, cycles);
+        }
+        cache.stepped = cycles;
+    }
 
-        assert(busmsgtype == BusMsgType::DATA || busmsgtype == BusMsgType::MEMDATA || busmsgtype == BusMsgType::SHARED);
-        assert(curr_state == CoherenceState::SHARED || curr_state == CoherenceState::INVALID);
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::sampleSkipped()
+    {
+        for (size_t proc = 0; proc < num_procs_; proc++)
+        {
+            sampleSkipped(proc);
+        }
+    }
 
-        if (busmsgtype == BusMsgType::DATA || busmsgtype == BusMsgType::MEMDATA)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::usePrefetcher(PrefetcherType type, size_t degree, size_t line_size)
+    {
+        prefetchers_ = std::vector(num_procs_, Prefetcher(type, degree, line_size, &stats_->prefetchstats));
+    }
+
+    // Sends the first predicted line the cache does not have as a coherent read.
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::issuePrefetch(size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        while (std::optional<size_t> address = prefetchers_[proc].next())
         {
-            if (busresp.cpureq_.inst_.command == OperationType::MEM_LOAD)
-            {
-                setCoherenceState(address, CoherenceState::SHARED, proc);
-            }
-            else
+            if (getCoherenceState(*address, proc) != CoherenceState::INVALID || cache.mshrs.find(*address) || (cache.writebacks && cache.writebacks->holds(*address)))
             {
-                setCoherenceState(address, CoherenceState::MODIFIED, proc);
+                continue;
             }
+            cache.pending_prefetch = *address;
+            BusMsg busreq = BusMsg{
+                .proc_cycle_ = cycles,
+                .type_ = BusMsgType::READ,
+                .cpureq_ = CPUMsg{.proc_cycle_ = cycles,
+                                  .msgtype = CPUMsgType::REQUEST,
+                                  .inst_ = Instruction{.command = OperationType::MEM_LOAD, .address = *address},
+                                  .proc_ = proc,
+                                  .proc_seq_ = 0},
+                .src_proc_ = proc,
+                .dst_proc_ = BROADCAST,
+            };
+            snoopbus_->requestFromCache(busreq);
+            return;
         }
-        else if (busmsgtype == BusMsgType::SHARED)
+    }
+
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::useWritebackBuffer(size_t num_entries)
+    {
+        for (Cache<Policy> &cache : caches_)
         {
-            assert(busresp.cpureq_.inst_.command == OperationType::MEM_LOAD);
-            setCoherenceState(address, CoherenceState::SHARED, proc);
+            assert(cache.sets);
+            cache.writebacks.emplace(num_entries);
         }
+    }
 
-        CPUMsg cpuresp = busresp.cpureq_;
-        cpuresp.msgtype = CPUMsgType::RESPONSE;
-
-        return cpuresp;
+    template <typename Protocol, typename Policy>
+    bool SnoopCaches<Protocol, Policy>::deliverSnoop(size_t address, size_t proc)
+    {
+        return !snoop_filter_ || snoop_filter_->deliver(address, proc);
     }
-    bool SnoopCaches::isAHitMSI(CPUMsg &cpureq, size_t proc)
+
+    template <typename Protocol, typename Policy>
+    bool SnoopCaches<Protocol, Policy>::isAHit(CPUMsg &cpureq, size_t proc)
     {
         size_t address = cpureq.inst_.address;
-        CoherenceState currstate = getCoherenceState(address, proc);
-        OperationType type = cpureq.inst_.command;
-
-        assert(currstate == CoherenceState::MODIFIED || currstate == CoherenceState::SHARED || currstate == CoherenceState::INVALID);
-        assert(type == OperationType::MEM_LOAD || type == OperationType::MEM_STORE);
-
-        if (type == OperationType::MEM_LOAD)
+        CoherenceState state = getCoherenceState(address, proc);
+        CoherenceState next = protocol_.table().hit(state, cpureq.inst_.command);
+        if (next == CoherenceState::INVALID)
         {
-            return currstate == CoherenceState::MODIFIED || currstate == CoherenceState::SHARED;
+            return false;
         }
-        else if (type == OperationType::MEM_STORE)
+        // a silent upgrade, like E->M on a store.
+        if (next != state)
         {
-            // std::cout << "here " << currstate << std::endl;
-            return currstate == CoherenceState::MODIFIED;
+            setCoherenceState(address, next, proc);
         }
-        return false;
+        return true;
     }
-    std::optional<BusMsg> SnoopCaches::requestFromBusMESI(BusMsg &busreq, size_t proc)
-    {
-        size_t address = busreq.cpureq_.inst_.address;
-        CoherenceState curr_state = getCoherenceState(address, proc);
-        BusMsgType busmsgtype = busreq.type_;
-
-        assert(busmsgtype == BusMsgType::READ || busmsgtype == BusMsgType::WRITE || busmsgtype == BusMsgType::UPGRADE);
-        assert(curr_state == CoherenceState::MODIFIED || curr_state == CoherenceState::EXCLUSIVE || curr_state == CoherenceState::SHARED || curr_state == CoherenceState::INVALID);
 
-        if (busmsgtype == BusMsgType::READ)
+    // Looks up an access of the processor's. A hit is recorded with the replacement
+    // policy and leaves the line in the state the protocol gives, in one search of a
+    // finite cache's set.
+    template <typename Protocol, typename Policy>
+    bool SnoopCaches<Protocol, Policy>::accessLine(CPUMsg &cpureq, size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        size_t address = cpureq.inst_.address;
+        if (cache.sets)
         {
-            if (curr_state == CoherenceState::MODIFIED)
+            OperationType command = cpureq.inst_.command;
+            CoherenceState next = cache.sets->access(address, [this, command](CoherenceState state)
+                                                     { return protocol_.table().hit(state, command); });
+            // a line in the victim cache has to be moved back into the sets first.
+            if (next != CoherenceState::INVALID || !cache.victims)
             {
-                // std::cout << proc << " M->S " << address << std::endl;
-                setCoherenceState(address, CoherenceState::SHARED, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::SHARED;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::EXCLUSIVE)
-            {
-                // std::cout << proc << " E->S " << address << std::endl;
-                setCoherenceState(address, CoherenceState::SHARED, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::SHARED;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::SHARED)
-            {
-                // std::cout << proc << " S->S " << address << std::endl;
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::SHARED;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::INVALID)
-            {
-                return std::nullopt;
+                return next != CoherenceState::INVALID;
             }
         }
-        else if (busmsgtype == BusMsgType::WRITE)
+        if (!isAHit(cpureq, proc))
         {
-            if (curr_state == CoherenceState::MODIFIED)
-            {
-                // std::cout << proc << " M->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::EXCLUSIVE)
-            {
-                // std::cout << proc << " E->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::SHARED)
-            {
-                // std::cout << proc << " S->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::INVALID)
-            {
-                return std::nullopt;
-            }
+            return false;
         }
-        else if (busmsgtype == BusMsgType::UPGRADE)
+        touchLine(address, proc);
+        return true;
+    }
+
+    template <typename Protocol, typename Policy>
+    CoherenceState SnoopCaches<Protocol, Policy>::getCoherenceState(size_t address, size_t proc)
+    {
+        if (line_states_)
         {
-            if (curr_state == CoherenceState::MODIFIED)
-            {
-                std::cerr << "something is broken" << std::endl;
-                assert(false);
-            }
-            else if (curr_state == CoherenceState::EXCLUSIVE)
-            {
-                std::cerr << "something is broken" << std::endl;
-                assert(false);
-            }
-            else if (curr_state == CoherenceState::SHARED)
-            {
-                // std::cout << proc << " S->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                return std::nullopt;
-            }
-            else if (curr_state == CoherenceState::INVALID)
-            {
-                return std::nullopt;
-            }
+            return line_states_->get(address, proc);
         }
-        return std::nullopt;
+        Cache<Policy> &cache = caches_[proc];
+        return cache.sets ? finiteState(cache, address) : cache.lines.get(address);
     }
-    CPUMsg SnoopCaches::replyFromBusMESI(BusMsg &busresp, size_t proc)
-    {
-        size_t address = busresp.cpureq_.inst_.address;
-        CoherenceState curr_state = getCoherenceState(address, proc);
-        BusMsgType busmsgtype = busresp.type_;
 
-        assert(busmsgtype == BusMsgType::DATA || busmsgtype == BusMsgType::MEMDATA || busmsgtype == BusMsgType::SHARED);
-        assert(curr_state == CoherenceState::SHARED || curr_state == CoherenceState::INVALID);
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::setCoherenceState(size_t address, CoherenceState newstate, size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        if (!cache.sets)
+        {
+            // one probe finds the line and updates it in place.
+            CoherenceState &state = line_states_ ? line_states_->at(address, proc) : cache.lines[address];
+            CoherenceState oldstate = state;
+            // record coherence invalidations
+            if (oldstate != CoherenceState::INVALID && newstate == CoherenceState::INVALID)
+            {
+                stats_->cachestats[proc].evictions++;
+                if (hierarchy_)
+                {
+                    hierarchy_->invalidate(address, proc);
+                }
+                if (!prefetchers_.empty())
+                {
+                    prefetchers_[proc].lost(address, true);
+                }
+            }
+            state = newstate;
+            updateSnoopFilter(address, oldstate, newstate, proc);
+            return;
+        }
 
-        if (busmsgtype == BusMsgType::DATA || busmsgtype == BusMsgType::MEMDATA)
+        // record coherence invalidations
+        CoherenceState oldstate = finiteState(cache, address);
+        if (oldstate != CoherenceState::INVALID && newstate == CoherenceState::INVALID)
         {
-            switch (busresp.cpureq_.inst_.command)
+            stats_->cachestats[proc].evictions++;
+            if (hierarchy_)
             {
-            case OperationType::MEM_LOAD:
-                setCoherenceState(address, CoherenceState::EXCLUSIVE, proc);
-                break;
-            case OperationType::MEM_STORE:
-                setCoherenceState(address, CoherenceState::MODIFIED, proc);
-                break;
+                hierarchy_->invalidate(address, proc);
+            }
+            if (!prefetchers_.empty())
+            {
+                prefetchers_[proc].lost(address, true);
             }
         }
-        else if (busmsgtype == BusMsgType::SHARED)
+
+        // filling a full set pushes out its least recently used line.
+        if (std::optional<CacheLine> victim = setFiniteState(cache, address, newstate))
         {
-            assert(busresp.cpureq_.inst_.command == OperationType::MEM_LOAD);
-            setCoherenceState(address, CoherenceState::SHARED, proc);
+            evictLine(*victim, proc);
         }
-        CPUMsg cpuresp = busresp.cpureq_;
-        cpuresp.msgtype = CPUMsgType::RESPONSE;
-
-        return cpuresp;
+        updateSnoopFilter(address, oldstate, newstate, proc);
     }
-    bool SnoopCaches::isAHitMESI(CPUMsg &cpureq, size_t proc)
-    {
-        size_t address = cpureq.inst_.address;
-        CoherenceState currstate = getCoherenceState(address, proc);
-        OperationType type = cpureq.inst_.command;
 
-        assert(type == OperationType::MEM_LOAD || type == OperationType::MEM_STORE);
-        assert(currstate == CoherenceState::MODIFIED || currstate == CoherenceState::EXCLUSIVE || currstate == CoherenceState::SHARED || currstate == CoherenceState::INVALID);
-
-        switch (type)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::updateSnoopFilter(size_t address, CoherenceState oldstate, CoherenceState newstate, size_t proc)
+    {
+        if (!snoop_filter_ || (oldstate == CoherenceState::INVALID) == (newstate == CoherenceState::INVALID))
         {
-        case OperationType::MEM_LOAD:
-            return currstate == CoherenceState::MODIFIED || currstate == CoherenceState::EXCLUSIVE || currstate == CoherenceState::SHARED;
-        case OperationType::MEM_STORE:
-            if (currstate == CoherenceState::EXCLUSIVE)
-            {
-                std::cout << proc << " E->M " << std::endl;
-                setCoherenceState(address, CoherenceState::MODIFIED, proc);
-                return true;
-            }
-            return currstate == CoherenceState::MODIFIED;
+            return;
         }
-    }
-    std::optional<BusMsg> SnoopCaches::requestFromBusMOESI(BusMsg &busreq, size_t proc)
-    {
-        size_t address = busreq.cpureq_.inst_.address;
-        CoherenceState curr_state = getCoherenceState(address, proc);
-        BusMsgType busmsgtype = busreq.type_;
-
-        assert(busmsgtype == BusMsgType::READ || busmsgtype == BusMsgType::WRITE || busmsgtype == BusMsgType::UPGRADE);
-        assert(curr_state == CoherenceState::MODIFIED || curr_state == CoherenceState::OWNED || curr_state == CoherenceState::EXCLUSIVE || curr_state == CoherenceState::SHARED || curr_state == CoherenceState::INVALID);
 
-        if (busmsgtype == BusMsgType::READ)
+        if (newstate == CoherenceState::INVALID)
         {
-            if (curr_state == CoherenceState::MODIFIED)
-            {
-                // std::cout << proc << " M->O " << address << std::endl;
-                setCoherenceState(address, CoherenceState::OWNED, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::SHARED;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::OWNED)
-            {
-                // std::cout << proc << " O->O " << address << std::endl;
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::SHARED;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::EXCLUSIVE)
-            {
-                // std::cout << proc << " E->O " << address << std::endl;
-                setCoherenceState(address, CoherenceState::OWNED, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::SHARED;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::SHARED)
-            {
-                // std::cout << proc << " S->S " << address << std::endl;
-                return std::nullopt;
-            }
-            else if (curr_state == CoherenceState::INVALID)
-            {
-                return std::nullopt;
-            }
+            snoop_filter_->remove(address, proc);
         }
-        else if (busmsgtype == BusMsgType::WRITE)
+        else if (std::optional<size_t> victim = snoop_filter_->add(address, proc))
         {
-            if (curr_state == CoherenceState::MODIFIED)
-            {
-                // std::cout << proc << " M->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::OWNED)
-            {
-                // std::cout << proc << " O->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::EXCLUSIVE)
-            {
-                // std::cout << proc << " E->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::SHARED)
-            {
-                // std::cout << proc << " S->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::INVALID)
-            {
-                return std::nullopt;
-            }
+            // the bounded filter dropped the line, so no cache may keep it.
+            snoop_filter_->recordBackInvalidations(backInvalidate(*victim));
         }
-        else if (busmsgtype == BusMsgType::UPGRADE)
+    }
+
+    template <typename Protocol, typename Policy>
+    size_t SnoopCaches<Protocol, Policy>::backInvalidate(size_t address)
+    {
+        size_t copies = 0;
+        for (size_t proc = 0; proc < num_procs_; proc++)
         {
-            if (curr_state == CoherenceState::MODIFIED)
+            CoherenceState state = getCoherenceState(address, proc);
+            if (state == CoherenceState::INVALID)
             {
-                std::cerr << "something is broken" << std::endl;
-                assert(false);
-            }
-            else if (curr_state == CoherenceState::OWNED)
-            {
-                // std::cout << proc << " O->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                return std::nullopt;
+                continue;
             }
-            else if (curr_state == CoherenceState::EXCLUSIVE)
+
+            copies++;
+            evictLine(CacheLine{.address = address, .state = state}, proc);
+            Cache<Policy> &cache = caches_[proc];
+            if (cache.sets)
             {
-                std::cerr << "something is broken" << std::endl;
-                assert(false);
+                setFiniteState(cache, address, CoherenceState::INVALID);
             }
-            else if (curr_state == CoherenceState::SHARED)
+            else if (line_states_)
             {
-                // std::cout << proc << " S->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                return std::nullopt;
+                line_states_->at(address, proc) = CoherenceState::INVALID;
             }
-            else if (curr_state == CoherenceState::INVALID)
+            else
             {
-                return std::nullopt;
+                cache.lines[address] = CoherenceState::INVALID;
             }
-            return std::nullopt;
         }
-        return std::nullopt;
-    }
-    CPUMsg SnoopCaches::replyFromBusMOESI(BusMsg &busresp, size_t proc)
-    {
-        size_t address = busresp.cpureq_.inst_.address;
-        CoherenceState curr_state = getCoherenceState(address, proc);
-        BusMsgType busmsgtype = busresp.type_;
 
-        assert(busmsgtype == BusMsgType::DATA || busmsgtype == BusMsgType::MEMDATA || busmsgtype == BusMsgType::SHARED);
-        assert(curr_state == CoherenceState::OWNED || curr_state == CoherenceState::SHARED || curr_state == CoherenceState::INVALID);
-
-        if (busmsgtype == BusMsgType::DATA || busmsgtype == BusMsgType::MEMDATA)
+        // nothing that tracked the line is left to route snoops to a buffered copy.
+        for (size_t proc = 0; proc < num_procs_; proc++)
         {
-            switch (busresp.cpureq_.inst_.command)
+            if (caches_[proc].writebacks && caches_[proc].writebacks->holds(address))
             {
-            case OperationType::MEM_LOAD:
-                setCoherenceState(address, CoherenceState::EXCLUSIVE, proc);
-                break;
-            case OperationType::MEM_STORE:
-                setCoherenceState(address, CoherenceState::MODIFIED, proc);
-                break;
+                flushWriteback(address, proc);
             }
         }
-        else if (busmsgtype == BusMsgType::SHARED)
-        {
-            assert(busresp.cpureq_.inst_.command == OperationType::MEM_LOAD);
-            setCoherenceState(address, CoherenceState::SHARED, proc);
-        }
-        CPUMsg cpuresp = busresp.cpureq_;
-        cpuresp.msgtype = CPUMsgType::RESPONSE;
-
-        return cpuresp;
+        return copies;
     }
-    bool SnoopCaches::isAHitMOESI(CPUMsg &cpureq, size_t proc)
-    {
-        size_t address = cpureq.inst_.address;
-        CoherenceState currstate = getCoherenceState(address, proc);
-        OperationType type = cpureq.inst_.command;
 
-        assert(type == OperationType::MEM_LOAD || type == OperationType::MEM_STORE);
-        assert(currstate == CoherenceState::MODIFIED || currstate == CoherenceState::OWNED || currstate == CoherenceState::EXCLUSIVE || currstate == CoherenceState::SHARED || currstate == CoherenceState::INVALID);
-
-        switch (type)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::touchLine(size_t address, size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        if (cache.sets)
         {
-        case OperationType::MEM_LOAD:
-            return currstate == CoherenceState::MODIFIED || currstate == CoherenceState::OWNED || currstate == CoherenceState::EXCLUSIVE || currstate == CoherenceState::SHARED;
-        case OperationType::MEM_STORE:
-            if (currstate == CoherenceState::EXCLUSIVE)
+            if (promoteVictim(cache, address))
             {
-                // std::cout << proc << " E->M " << std::endl;
-                setCoherenceState(address, CoherenceState::MODIFIED, proc);
-                return true;
+                stats_->bufferstats.victim_hits++;
             }
-            return currstate == CoherenceState::MODIFIED;
+            cache.sets->touch(address);
         }
     }
-    std::optional<BusMsg> SnoopCaches::requestFromBusMESIF(BusMsg &busreq, size_t proc)
-    {
-        size_t address = busreq.cpureq_.inst_.address;
-        CoherenceState curr_state = getCoherenceState(address, proc);
-        BusMsgType busmsgtype = busreq.type_;
 
-        assert(busmsgtype == BusMsgType::READ || busmsgtype == BusMsgType::WRITE || busmsgtype == BusMsgType::UPGRADE);
-        assert(curr_state == CoherenceState::MODIFIED || curr_state == CoherenceState::EXCLUSIVE || curr_state == CoherenceState::SHARED || curr_state == CoherenceState::INVALID || curr_state == CoherenceState::FORWARDER);
-
-        if (busmsgtype == BusMsgType::READ)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::evictLine(const CacheLine &victim, size_t proc)
+    {
+        stats_->cachestats[proc].capacity_evictions++;
+        if (hierarchy_)
         {
-            if (curr_state == CoherenceState::MODIFIED)
-            {
-                // std::cout << proc << " M->S " << address << std::endl;
-                setCoherenceState(address, CoherenceState::SHARED, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::SHARED;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::EXCLUSIVE)
-            {
-                // std::cout << proc << " E->S " << address << std::endl;
-                setCoherenceState(address, CoherenceState::SHARED, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::SHARED;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::SHARED)
-            {
-                // std::cout << proc << " S->S " << address << std::endl;
-                return std::nullopt;
-            }
-            else if (curr_state == CoherenceState::INVALID)
-            {
-                return std::nullopt;
-            }
-            else if (curr_state == CoherenceState::FORWARDER)
-            {
-                // std::cout << proc << " F->S " << address << std::endl;
-                setCoherenceState(address, CoherenceState::SHARED, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::SHARED;
-                return busresp;
-            }
+            hierarchy_->invalidate(victim.address, proc);
         }
-        else if (busmsgtype == BusMsgType::WRITE)
+        if (!prefetchers_.empty())
         {
-            if (curr_state == CoherenceState::MODIFIED)
-            {
-                // std::cout << proc << " M->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::EXCLUSIVE)
-            {
-                // std::cout << proc << " E->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
-            else if (curr_state == CoherenceState::SHARED)
-            {
-                // std::cout << proc << " S->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                return std::nullopt;
-            }
-            else if (curr_state == CoherenceState::INVALID)
-            {
-                return std::nullopt;
-            }
-            else if (curr_state == CoherenceState::FORWARDER)
-            {
-                // std::cout << proc << " F->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                BusMsg busresp = busreq;
-                busresp.dst_proc_ = busresp.src_proc_;
-                busresp.src_proc_ = proc;
-                busresp.type_ = BusMsgType::DATA;
-                return busresp;
-            }
+            prefetchers_[proc].lost(victim.address, false);
         }
-        else if (busmsgtype == BusMsgType::UPGRADE)
-        {
-            if (curr_state == CoherenceState::MODIFIED)
-            {
-                std::cerr << "something is broken" << std::endl;
-                assert(false);
-            }
-            else if (curr_state == CoherenceState::EXCLUSIVE)
+
+        // clean lines leave silently, dirty ones are written back over the bus.
+        bool dirty = victim.state == CoherenceState::MODIFIED || victim.state == CoherenceState::OWNED;
+        Cache<Policy> &cache = caches_[proc];
+        if (dirty && cache.writebacks)
+        {
+            // the buffer takes the line off the miss path, snoops still find it there.
+            if (cache.writebacks->full())
             {
-                std::cerr << "something is broken" << std::endl;
-                assert(false);
+                stats_->bufferstats.wb_forced_flushes++;
+                flushWriteback(cache.writebacks->pop(), proc);
             }
-            else if (curr_state == CoherenceState::SHARED)
+            cache.writebacks->push(victim.address);
+            if (events_)
             {
-                // std::cout << proc << " S->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                return std::nullopt;
+                events_->wake(Component::INTERCONNECT, 0, cycles);
             }
-            else if (curr_state == CoherenceState::INVALID)
+            return;
+        }
+
+        if (snoop_filter_)
+        {
+            snoop_filter_->remove(victim.address, proc);
+        }
+        if (dirty)
+        {
+            sendWriteback(victim.address, proc);
+        }
+    }
+
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::sendWriteback(size_t address, size_t proc)
+    {
+        stats_->cachestats[proc].writebacks++;
+        BusMsg writeback = BusMsg{
+            .proc_cycle_ = cycles,
+            .type_ = BusMsgType::WRITEBACK,
+            .cpureq_ = CPUMsg{.proc_cycle_ = cycles,
+                              .msgtype = CPUMsgType::REQUEST,
+                              .inst_ = Instruction{.command = OperationType::MEM_STORE, .address = address},
+                              .proc_ = proc,
+                              .proc_seq_ = 0},
+            .src_proc_ = proc,
+            .dst_proc_ = MEMORY,
+        };
+        snoopbus_->writebackFromCache(writeback);
+    }
+
+    // Writes a buffered line back now, it may or may not still be queued.
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::flushWriteback(size_t address, size_t proc)
+    {
+        caches_[proc].writebacks->erase(address);
+        if (snoop_filter_)
+        {
+            snoop_filter_->remove(address, proc);
+        }
+        sendWriteback(address, proc);
+    }
+
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::drainWriteback()
+    {
+        for (size_t i = 0; i < num_procs_; i++)
+        {
+            size_t proc = (drain_proc_ + i) % num_procs_;
+            Cache<Policy> &cache = caches_[proc];
+            if (cache.writebacks && !cache.writebacks->empty())
             {
-                return std::nullopt;
+                stats_->bufferstats.wb_drained++;
+                flushWriteback(cache.writebacks->pop(), proc);
+                drain_proc_ = (proc + 1) % num_procs_;
+                return;
             }
-            else if (curr_state == CoherenceState::FORWARDER)
+        }
+    }
+
+    template <typename Protocol, typename Policy>
+    bool SnoopCaches<Protocol, Policy>::buffersWritebacks() const
+    {
+        // every cache has a buffer or none does.
+        if (caches_.empty() || !caches_.front().writebacks)
+        {
+            return false;
+        }
+        for (const Cache<Policy> &cache : caches_)
+        {
+            if (!cache.writebacks->empty())
             {
-                // std::cout << proc << " F->I " << address << std::endl;
-                setCoherenceState(address, CoherenceState::INVALID, proc);
-                return std::nullopt;
+                return true;
             }
         }
-        return std::nullopt;
+        return false;
     }
-    CPUMsg SnoopCaches::replyFromBusMESIF(BusMsg &busresp, size_t proc)
-    {
-        size_t address = busresp.cpureq_.inst_.address;
-        CoherenceState curr_state = getCoherenceState(address, proc);
-        BusMsgType busmsgtype = busresp.type_;
-
-        assert(busmsgtype == BusMsgType::DATA || busmsgtype == BusMsgType::MEMDATA || busmsgtype == BusMsgType::SHARED);
-        assert(curr_state == CoherenceState::SHARED || curr_state == CoherenceState::INVALID || curr_state == CoherenceState::FORWARDER);
 
-        if (busmsgtype == BusMsgType::DATA || busmsgtype == BusMsgType::MEMDATA)
+    template <typename Protocol, typename Policy>
+    void SnoopCaches<Protocol, Policy>::flushWritebacks()
+    {
+        for (size_t proc = 0; proc < num_procs_; proc++)
         {
-            switch (busresp.cpureq_.inst_.command)
+            Cache<Policy> &cache = caches_[proc];
+            while (cache.writebacks && !cache.writebacks->empty())
             {
-            case OperationType::MEM_LOAD:
-                setCoherenceState(address, CoherenceState::EXCLUSIVE, proc);
-                break;
-            case OperationType::MEM_STORE:
-                setCoherenceState(address, CoherenceState::MODIFIED, proc);
-                break;
+                stats_->bufferstats.wb_drained++;
+                flushWriteback(cache.writebacks->pop(), proc);
             }
         }
-        else if (busmsgtype == BusMsgType::SHARED)
+    }
+
+    // The bus' shared line: whether any cache other than except_proc holds address.
+    template <typename Protocol, typename Policy>
+    bool SnoopCaches<Protocol, Policy>::hasCopy(size_t address, size_t except_proc)
+    {
+        if (snoop_filter_)
         {
-            assert(busresp.cpureq_.inst_.command == OperationType::MEM_LOAD);
-            setCoherenceState(address, CoherenceState::FORWARDER, proc);
+            return snoop_filter_->heldByOther(address, except_proc);
         }
-        CPUMsg cpuresp = busresp.cpureq_;
-        cpuresp.msgtype = CPUMsgType::RESPONSE;
-
-        return cpuresp;
+        for (size_t proc = 0; proc < num_procs_; proc++)
+        {
+            if (proc != except_proc && getCoherenceState(address, proc) != CoherenceState::INVALID)
+            {
+                return true;
+            }
+        }
+        return false;
     }
-    bool SnoopCaches::isAHitMESIF(CPUMsg &cpureq, size_t proc)
+
+    template <typename Protocol, typename Policy>
+    bool DirectoryCaches<Protocol, Policy>::isAHit(CPUMsg &cpureq, size_t proc)
     {
         size_t address = cpureq.inst_.address;
         CoherenceState currstate = getCoherenceState(address, proc);
         OperationType type = cpureq.inst_.command;
 
         assert(type == OperationType::MEM_LOAD || type == OperationType::MEM_STORE);
-        assert(currstate == CoherenceState::MODIFIED || currstate == CoherenceState::EXCLUSIVE || currstate == CoherenceState::SHARED || currstate == CoherenceState::INVALID || currstate == CoherenceState::FORWARDER);
+        assert(protocol_.table().has(currstate));
 
-        switch (type)
+        CoherenceState nextstate = protocol_.table().hit(currstate, type);
+        if (nextstate == CoherenceState::INVALID)
+        {
+            return false;
+        }
+        if (nextstate != currstate)
+        {
+            setCoherenceState(address, nextstate, proc);
+        }
+        return true;
+    }
+
+    // Looks up an access of the processor's. A hit is recorded with the replacement
+    // policy and leaves the line in the state the protocol gives, in one search of a
+    // finite cache's set.
+    template <typename Protocol, typename Policy>
+    bool DirectoryCaches<Protocol, Policy>::accessLine(CPUMsg &cpureq, size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        size_t address = cpureq.inst_.address;
+        if (cache.sets)
         {
-        case OperationType::MEM_LOAD:
-            return currstate == CoherenceState::MODIFIED || currstate == CoherenceState::EXCLUSIVE || currstate == CoherenceState::SHARED || currstate == CoherenceState::FORWARDER;
-        case OperationType::MEM_STORE:
-            if (currstate == CoherenceState::EXCLUSIVE)
+            OperationType command = cpureq.inst_.command;
+            CoherenceState next = cache.sets->access(address, [this, command](CoherenceState state)
+                                                     { return protocol_.table().hit(state, command); });
+            // a line in the victim cache has to be moved back into the sets first.
+            if (next != CoherenceState::INVALID || !cache.victims)
             {
-                // std::cout << proc << " E->M " << address << std::endl;
-                setCoherenceState(address, CoherenceState::MODIFIED, proc);
-                return true;
+                return next != CoherenceState::INVALID;
             }
-            return currstate == CoherenceState::MODIFIED;
         }
+        if (!isAHit(cpureq, proc))
+        {
+            return false;
+        }
+        touchLine(address, proc);
+        return true;
     }
 
-    bool DirectoryCaches::isAHit(CPUMsg &cpureq, size_t proc)
+    template <typename Protocol, typename Policy>
+    CoherenceState DirectoryCaches<Protocol, Policy>::getCoherenceState(size_t address, size_t proc)
     {
-        size_t address = cpureq.inst_.address;
-        CoherenceState currstate = getCoherenceState(address, proc);
-        OperationType type = cpureq.inst_.command;
+        Cache<Policy> &cache = caches_[proc];
+        return cache.sets ? finiteState(cache, address) : cache.lines.get(address);
+    }
 
-        assert(type == OperationType::MEM_LOAD || type == OperationType::MEM_STORE);
-        assert(currstate == CoherenceState::MODIFIED || currstate == CoherenceState::EXCLUSIVE || currstate == CoherenceState::SHARED || currstate == CoherenceState::INVALID);
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::setCoherenceState(size_t address, CoherenceState newstate, size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        if (!cache.sets)
+        {
+            // one probe finds the line and updates it in place.
+            CoherenceState &state = cache.lines[address];
+            // record coherence invalidations
+            if (state != CoherenceState::INVALID && newstate == CoherenceState::INVALID)
+            {
+                stats_->cachestats[proc].evictions++;
+                if (hierarchy_)
+                {
+                    hierarchy_->invalidate(address, proc);
+                }
+                if (!prefetchers_.empty())
+                {
+                    prefetchers_[proc].lost(address, true);
+                }
+            }
+            state = newstate;
+            return;
+        }
 
-        switch (type)
+        // record coherence invalidations
+        if (finiteState(cache, address) != CoherenceState::INVALID && newstate == CoherenceState::INVALID)
         {
-        case OperationType::MEM_LOAD:
-            return currstate == CoherenceState::MODIFIED || currstate == CoherenceState::EXCLUSIVE || currstate == CoherenceState::SHARED;
-        case OperationType::MEM_STORE:
-            if (currstate == CoherenceState::EXCLUSIVE)
+            stats_->cachestats[proc].evictions++;
+            if (hierarchy_)
             {
-                // std::cout << proc << " E->M " << std::endl;
-                setCoherenceState(address, CoherenceState::MODIFIED, proc);
-                return true;
+                hierarchy_->invalidate(address, proc);
+            }
+            if (!prefetchers_.empty())
+            {
+                prefetchers_[proc].lost(address, true);
             }
-            return currstate == CoherenceState::MODIFIED;
+        }
+
+        // filling a full set pushes out its least recently used line.
+        if (std::optional<CacheLine> victim = setFiniteState(cache, address, newstate))
+        {
+            evictLine(*victim, proc);
         }
     }
 
-    CoherenceState DirectoryCaches::getCoherenceState(size_t address, size_t proc)
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::touchLine(size_t address, size_t proc)
     {
-        Cache &cache = caches_[proc];
-        if (cache.lines.find(address) == cache.lines.end())
+        Cache<Policy> &cache = caches_[proc];
+        if (cache.sets)
         {
-            return CoherenceState::INVALID;
+            if (promoteVictim(cache, address))
+            {
+                stats_->bufferstats.victim_hits++;
+            }
+            cache.sets->touch(address);
         }
-        return cache.lines[address];
     }
 
-    void DirectoryCaches::setCoherenceState(size_t address, CoherenceState newstate, size_t proc)
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::evictLine(const CacheLine &victim, size_t proc)
     {
-        // record coherence invalidations
-        if (getCoherenceState(address, proc) != CoherenceState::INVALID && newstate == CoherenceState::INVALID)
+        stats_->cachestats[proc].capacity_evictions++;
+        if (hierarchy_)
         {
-            stats_->cachestats[proc].evictions++;
+            hierarchy_->invalidate(victim.address, proc);
         }
+        if (!prefetchers_.empty())
+        {
+            prefetchers_[proc].lost(victim.address, false);
+        }
+
+        notifyDirectory(victim.address, victim.state, proc);
+    }
 
-        Cache &cache = caches_[proc];
-        cache.lines[address] = newstate;
+    // Tells the directory that proc dropped the line it held in state, so it stops
+    // tracking this cache. Dirty lines carry their data.
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::notifyDirectory(size_t address, CoherenceState state, size_t proc)
+    {
+        bool dirty = state == CoherenceState::MODIFIED || state == CoherenceState::OWNED;
+        if (dirty)
+        {
+            stats_->cachestats[proc].writebacks++;
+        }
+        DirMsg evict = DirMsg{
+            .proc_cycle_ = cycles,
+            .type_ = dirty ? DirMsgType::WRITEBACK : DirMsgType::EVICT,
+            .cpureq_ = CPUMsg{.proc_cycle_ = cycles,
+                              .msgtype = CPUMsgType::REQUEST,
+                              .inst_ = Instruction{.command = OperationType::MEM_STORE, .address = address},
+                              .proc_ = proc,
+                              .proc_seq_ = 0},
+            .src_proc_ = proc,
+            .dst_proc_ = DIRECTORY};
+        directory_->requestFromCache(evict);
     }
 
-    DirectoryCaches::DirectoryCaches(size_t num_procs, Directory *directory, CPUS *cpus, Stats *stats) : num_procs_(num_procs), cpus_(cpus), directory_(directory), stats_(stats)
+    template <typename Protocol, typename Policy>
+    DirectoryCaches<Protocol, Policy>::DirectoryCaches(size_t num_procs, Directory<Protocol, Policy> *directory, CPUS<DirectoryCaches> *cpus, Protocol protocol, Stats *stats, const CacheGeometry &geometry) : num_procs_(num_procs), cpus_(cpus), directory_(directory), protocol_(protocol), stats_(stats)
     {
-        caches_ = std::vector(num_procs_, Cache{.lines = std::unordered_map<size_t, CoherenceState>(), .pending_cpu_req = std::nullopt});
+        caches_ = std::vector(num_procs_, Cache<Policy>{.lines = LineMap<CoherenceState>(CoherenceState::INVALID), .sets = std::nullopt, .victims = std::nullopt, .writebacks = std::nullopt, .cpu_reqs = {}, .mshrs = MSHRFile(1), .pending_prefetch = std::nullopt, .stepped = 0, .stalled = false});
+        if (geometry.num_sets > 0)
+        {
+            for (Cache<Policy> &cache : caches_)
+            {
+                cache.sets.emplace(geometry);
+            }
+        }
     }
 
-    void DirectoryCaches::cycle()
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::cycle()
     {
         // validate consistency in our cache.
 
         // try to process request from processor.
         for (size_t proc = 0; proc < num_procs_; proc++)
         {
-            Cache &cache = caches_[proc];
+            step(proc);
+        }
+    }
 
-            if (!cache.pending_cpu_req)
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::step(size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        if (cache.stepped < cycles)
+        {
+            sampleSkipped(proc);
+        }
+        stats_->mshrstats.occupancy += cache.mshrs.size();
+        stats_->mshrstats.samples++;
+        cache.stepped = cycles + 1;
+        completeMisses(proc);
+
+        // look up the processor's requests in order, a miss that finds no free MSHR
+        // holds back the ones behind it.
+        while (!cache.cpu_reqs.empty())
+        {
+            CPUMsg &cpureq = cache.cpu_reqs.front();
+            size_t address = cpureq.inst_.address;
+            if (MSHR *mshr = cache.mshrs.find(address))
+            {
+                // a secondary miss waits for the line already being fetched.
+                stats_->cachestats[proc].misses++;
+                stats_->mshrstats.merges++;
+                if (!prefetchers_.empty())
+                {
+                    prefetchers_[proc].access(address, true);
+                }
+                mshr->targets.push_back(cpureq);
+                cache.cpu_reqs.pop_front();
                 continue;
+            }
 
-            if (isAHit(cache.pending_cpu_req.value(), proc))
+            bool hit = accessLine(cpureq, proc);
+            if (!hit && cache.mshrs.full())
+            {
+                stats_->mshrstats.full_stalls++;
+                break;
+            }
+            if (!prefetchers_.empty())
+            {
+                prefetchers_[proc].access(address, !hit);
+            }
+            if (hit)
             {
                 // record cache hit
                 stats_->cachestats[proc].hits++;
+                if (hierarchy_)
+                {
+                    hierarchy_->privateHit(address, proc);
+                }
 
-                CPUMsg cpuresp = cache.pending_cpu_req.value();
+                CPUMsg cpuresp = cpureq;
                 cpuresp.msgtype = CPUMsgType::RESPONSE;
                 cpus_->replyFromCache(cpuresp);
-                cache.pending_cpu_req.reset();
             }
             else
             {
                 stats_->cachestats[proc].misses++;
-                DirMsg dirreq;
-
-                if (cache.pending_cpu_req->inst_.command == OperationType::MEM_STORE && getCoherenceState(cache.pending_cpu_req->inst_.address, proc) == CoherenceState::SHARED)
-                {
-                    dirreq = DirMsg{
-                        .proc_cycle_ = cycles,
-                        .type_ = DirMsgType::UPGRADE,
-                        .cpureq_ = cache.pending_cpu_req.value(),
-                        .src_proc_ = proc,
-                        .dst_proc_ = DIRECTORY};
-                    directory_->requestFromCache(dirreq);
-                }
-                else
+                if (hierarchy_)
                 {
-                    dirreq = DirMsg{
-                        .proc_cycle_ = cycles,
-                        .type_ = (cache.pending_cpu_req->inst_.command == OperationType::MEM_LOAD) ? DirMsgType::READ : DirMsgType::WRITE,
-                        .cpureq_ = cache.pending_cpu_req.value(),
-                        .src_proc_ = proc,
-                        .dst_proc_ = DIRECTORY};
-                    directory_->requestFromCache(dirreq);
+                    hierarchy_->privateMiss(address, proc);
                 }
+                cache.mshrs.allocate(cpureq);
+            }
+            cache.cpu_reqs.pop_front();
+        }
+        cache.stalled = !cache.cpu_reqs.empty();
+        stats_->mshrstats.max_occupancy = std::max(stats_->mshrstats.max_occupancy, cache.mshrs.size());
+
+        // the cache sends one miss per cycle, or a predicted line if no miss needs the slot.
+        if (MSHR *mshr = cache.mshrs.nextToIssue())
+        {
+            issueMiss(*mshr, proc);
+        }
+        else if (!prefetchers_.empty())
+        {
+            issuePrefetch(proc);
+        }
+        schedule(proc, cycles + 1);
+    }
+
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::issueMiss(MSHR &mshr, size_t proc)
+    {
+        CPUMsg cpureq = mshr.targets.front();
+        mshr.issued = true;
+        DirMsg dirreq;
+
+        if (cpureq.inst_.command == OperationType::MEM_STORE && protocol_.table().upgrades(getCoherenceState(mshr.address, proc)))
+        {
+            dirreq = DirMsg{
+                .proc_cycle_ = cycles,
+                .type_ = DirMsgType::UPGRADE,
+                .cpureq_ = cpureq,
+                .src_proc_ = proc,
+                .dst_proc_ = DIRECTORY};
+            directory_->requestFromCache(dirreq);
+        }
+        else
+        {
+            dirreq = DirMsg{
+                .proc_cycle_ = cycles,
+                .type_ = (cpureq.inst_.command == OperationType::MEM_LOAD) ? DirMsgType::READ : DirMsgType::WRITE,
+                .cpureq_ = cpureq,
+                .src_proc_ = proc,
+                .dst_proc_ = DIRECTORY};
+            directory_->requestFromCache(dirreq);
+        }
+    }
+
+    // Answers the accesses of every MSHR whose data has arrived.
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::completeMisses(size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        while (MSHR *mshr = cache.mshrs.nextReady(cycles))
+        {
+            // the access that sent the request was performed by the directory, merged
+            // ones may still need an upgrade and go out again.
+            CPUMsg cpuresp = mshr->targets.front();
+            cpuresp.msgtype = CPUMsgType::RESPONSE;
+            cpus_->replyFromCache(cpuresp);
+            mshr->targets.erase(mshr->targets.begin());
+            while (!mshr->targets.empty() && isAHit(mshr->targets.front(), proc))
+            {
+                cpuresp = mshr->targets.front();
+                cpuresp.msgtype = CPUMsgType::RESPONSE;
+                cpus_->replyFromCache(cpuresp);
+                mshr->targets.erase(mshr->targets.begin());
+            }
+            if (mshr->targets.empty())
+            {
+                cache.mshrs.release(mshr->address);
+                cache.stalled = false;
+            }
+            else
+            {
+                mshr->issued = false;
+                mshr->answered = false;
             }
         }
     }
-    void DirectoryCaches::requestFromProcessor(CPUMsg cpureq)
+
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::requestFromProcessor(CPUMsg cpureq)
     {
         size_t proc = cpureq.proc_;
-        Cache &cache = caches_[proc];
-        assert(!cache.pending_cpu_req);
-        cache.pending_cpu_req = cpureq;
+        caches_[proc].cpu_reqs.push_back(cpureq);
+        schedule(proc, cycles);
     }
 
-    void DirectoryCaches::requestFromDirectory(DirMsg dirreq)
+    template <typename Protocol, typename Policy>
+    bool DirectoryCaches<Protocol, Policy>::requestFromDirectory(DirMsg dirreq)
     {
         size_t proc = dirreq.dst_proc_;
         DirMsgType type = dirreq.type_;
         size_t address = dirreq.cpureq_.inst_.address;
 
-        // request from directory only comes to downgrade to shared or invalidate.
+        // request from directory only comes to downgrade to shared or invalidate, the
+        // protocol answers it as it would a snooped read or write.
         assert(type == DirMsgType::SHARED || type == DirMsgType::INVALIDATE);
 
         CoherenceState currstate = getCoherenceState(address, proc);
-        if (type == DirMsgType::SHARED)
+        if (currstate == CoherenceState::INVALID)
+        {
+            // an imprecise sharer set named a cache without a copy.
+            assert(type == DirMsgType::INVALIDATE);
+            stats_->dirstats.extra_invalidations++;
+            return false;
+        }
+        SnoopTransition row = protocol_.table().snoop(currstate, type == DirMsgType::SHARED ? BusMsgType::READ : BusMsgType::WRITE);
+        assert(row.defined);
+        if (row.next != currstate)
         {
-            assert(currstate == CoherenceState::MODIFIED || currstate == CoherenceState::EXCLUSIVE);
-            // std::cout << proc << " " << currstate << "-> S" << std::endl;
-            setCoherenceState(address, CoherenceState::SHARED, proc);
+            setCoherenceState(address, row.next, proc);
         }
-        else if (type == DirMsgType::INVALIDATE)
+
+        // a recall has no requestor to take the line, it goes back to the directory.
+        if (dirreq.cpureq_.proc_ == DIRECTORY)
         {
-            assert(currstate == CoherenceState::MODIFIED || currstate == CoherenceState::EXCLUSIVE || currstate == CoherenceState::SHARED);
-            // std::cout << proc << " " << currstate << "-> I" << std::endl;
-            setCoherenceState(address, CoherenceState::INVALID, proc);
+            notifyDirectory(address, currstate, proc);
         }
+        return currstate == CoherenceState::MODIFIED || currstate == CoherenceState::OWNED;
     }
-    void DirectoryCaches::replyFromDirectory(DirMsg dirresp)
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::replyFromDirectory(DirMsg dirresp)
     {
         size_t proc = dirresp.dst_proc_;
         DirMsgType type = dirresp.type_;
@@ -1065,90 +1238,225 @@ namespace csim
         CoherenceState curr_state = getCoherenceState(address, proc);
 
         assert(type == DirMsgType::DATA || type == DirMsgType::SHARED);
-        assert(curr_state == CoherenceState::SHARED || curr_state == CoherenceState::INVALID);
+        assert(curr_state == CoherenceState::INVALID || protocol_.table().upgrades(curr_state));
 
-        if (type == DirMsgType::DATA)
-        {
-            switch (optype)
-            {
-            case OperationType::MEM_LOAD:
-                setCoherenceState(address, CoherenceState::EXCLUSIVE, proc);
-                break;
-            case OperationType::MEM_STORE:
-                setCoherenceState(address, CoherenceState::MODIFIED, proc);
-                break;
-            }
-        }
-        else if (type == DirMsgType::SHARED)
-        {
-            assert(optype == OperationType::MEM_LOAD);
-            setCoherenceState(address, CoherenceState::SHARED, proc);
-        }
+        CoherenceState fillstate = protocol_.table().fill(type == DirMsgType::DATA ? BusMsgType::DATA : BusMsgType::SHARED, optype);
+        assert(fillstate != CoherenceState::INVALID);
+        setCoherenceState(address, fillstate, proc);
 
         CPUMsg cpuresp = dirresp.cpureq_;
         cpuresp.msgtype = CPUMsgType::RESPONSE;
 
-        assert(caches_[proc].pending_cpu_req);
-        assert(caches_[proc].pending_cpu_req.value() == cpuresp);
+        if (caches_[proc].pending_prefetch)
+        {
+            // nobody waits for a prefetch, the line just lands in the cache.
+            assert(*caches_[proc].pending_prefetch == address);
+            prefetchers_[proc].filled(address);
+            caches_[proc].pending_prefetch.reset();
+            // a stalled request may have been waiting for this very line.
+            caches_[proc].stalled = false;
+            return;
+        }
+
+        MSHR *mshr = caches_[proc].mshrs.find(address);
+        assert(mshr && mshr->issued && !mshr->answered);
+        assert(mshr->targets.front() == cpuresp);
 
-        cpus_->replyFromCache(std::move(cpuresp));
-        caches_[proc].pending_cpu_req.reset();
+        // an upgrade re-references a resident line, a fill is placed by the replacement policy.
+        if (curr_state != CoherenceState::INVALID)
+        {
+            touchLine(address, proc);
+        }
+        if (hierarchy_)
+        {
+            hierarchy_->fill(address, proc);
+        }
+        // the reply is stamped with the cycle its last message arrives.
+        mshr->answered = true;
+        mshr->ready_cycle = std::max(cycles, dirresp.proc_cycle_) + miss_latency_ + (hierarchy_ ? hierarchy_->missLatency() : 0);
+        completeMisses(proc);
     }
 
-    void DirectoryCaches::setDirectory(Directory *directory)
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::setDirectory(Directory<Protocol, Policy> *directory)
     {
         directory_ = directory;
     }
-    void DirectoryCaches::setCPUs(CPUS *cpus)
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::setCPUs(CPUS<DirectoryCaches> *cpus)
     {
         cpus_ = cpus;
     }
-    std::ostream &operator<<(std::ostream &os, const CoherenceState &state)
+
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::setHierarchy(Hierarchy<Policy> *hierarchy)
+    {
+        hierarchy_ = hierarchy;
+    }
+
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::useVictimCache(size_t num_entries)
     {
-        switch (state)
+        for (Cache<Policy> &cache : caches_)
         {
-        case CoherenceState::MODIFIED:
-            os << "M";
-            break;
-        case CoherenceState::INVALID:
-            os << "I";
-            break;
-        case CoherenceState::SHARED:
-            os << "S";
-            break;
-        case CoherenceState::EXCLUSIVE:
-            os << "E";
-            break;
-        case CoherenceState::OWNED:
-            os << "O";
-            break;
-        case CoherenceState::FORWARDER:
-            os << "F";
-            break;
+            assert(cache.sets);
+            cache.victims.emplace(num_entries);
         }
-        return os;
     }
-    std::ostream &operator<<(std::ostream &os, const CoherenceProtocol &protocol)
+
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::useMSHRs(size_t num_entries, size_t miss_latency)
     {
-        switch (protocol)
+        for (Cache<Policy> &cache : caches_)
         {
-        case CoherenceProtocol::MI:
-            os << "MI";
-            break;
-        case CoherenceProtocol::MSI:
-            os << "MSI";
-            break;
-        case CoherenceProtocol::MESI:
-            os << "MESI";
-            break;
-        case CoherenceProtocol::MOESI:
-            os << "MOESI";
-            break;
-        case CoherenceProtocol::MESIF:
-            os << "MESIF";
-            break;
+            cache.mshrs = MSHRFile(num_entries);
+        }
+        miss_latency_ = miss_latency;
+    }
+
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::useScheduler(EventScheduler *events)
+    {
+        events_ = events;
+    }
+
+    // Wakes proc's cache for its next miss completion and, if it has requests to look
+    // up, a miss or a prefetch to send, at cycle from. A request stalled on full MSHRs
+    // waits for a completion. The directory banks' queues need no events of their own,
+    // a request's wait in them is part of the cycle its miss completes.
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::schedule(size_t proc, size_t from)
+    {
+        if (!events_)
+        {
+            return;
+        }
+        Cache<Policy> &cache = caches_[proc];
+        if (std::optional<size_t> ready = cache.mshrs.readyCycle())
+        {
+            events_->wake(Component::CACHE, proc, *ready);
+        }
+        bool lookups = !cache.cpu_reqs.empty() && !cache.stalled;
+        if (lookups || cache.mshrs.nextToIssue() || (!prefetchers_.empty() && !prefetchers_[proc].idle()))
+        {
+            events_->wake(Component::CACHE, proc, from);
+        }
+    }
+
+    // Cycles the cache was not stepped in left its MSHRs as they were, and a stalled
+    // request stalled again in each of them.
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::sampleSkipped(size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        size_t skipped = cycles - cache.stepped;
+        stats_->mshrstats.occupancy += cache.mshrs.size() * skipped;
+        stats_->mshrstats.samples += skipped;
+        if (cache.stalled)
+        {
+            stats_->mshrstats.full_stalls += skipped;
+        }
+        cache.stepped = cycles;
+    }
+
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::sampleSkipped()
+    {
+        for (size_t proc = 0; proc < num_procs_; proc++)
+        {
+            sampleSkipped(proc);
+        }
+    }
+
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::usePrefetcher(PrefetcherType type, size_t degree, size_t line_size)
+    {
+        prefetchers_ = std::vector(num_procs_, Prefetcher(type, degree, line_size, &stats_->prefetchstats));
+    }
+
+    // Sends the first predicted line the cache does not have as a coherent read.
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::issuePrefetch(size_t proc)
+    {
+        Cache<Policy> &cache = caches_[proc];
+        while (std::optional<size_t> address = prefetchers_[proc].next())
+        {
+            if (getCoherenceState(*address, proc) != CoherenceState::INVALID || cache.mshrs.find(*address))
+            {
+                continue;
+            }
+            cache.pending_prefetch = *address;
+            DirMsg dirreq = DirMsg{
+                .proc_cycle_ = cycles,
+                .type_ = DirMsgType::READ,
+                .cpureq_ = CPUMsg{.proc_cycle_ = cycles,
+                                  .msgtype = CPUMsgType::REQUEST,
+                                  .inst_ = Instruction{.command = OperationType::MEM_LOAD, .address = *address},
+                                  .proc_ = proc,
+                                  .proc_seq_ = 0},
+                .src_proc_ = proc,
+                .dst_proc_ = DIRECTORY};
+            directory_->requestFromCache(dirreq);
+            return;
+        }
+    }
+
+    template <typename Protocol, typename Policy>
+    size_t DirectoryCaches<Protocol, Policy>::backInvalidate(size_t address)
+    {
+        size_t copies = 0;
+        for (size_t proc = 0; proc < num_procs_; proc++)
+        {
+            CoherenceState state = getCoherenceState(address, proc);
+            if (state == CoherenceState::INVALID)
+            {
+                continue;
+            }
+
+            // the directory drops this cache from the line's sharers or owner.
+            copies++;
+            evictLine(CacheLine{.address = address, .state = state}, proc);
+            Cache<Policy> &cache = caches_[proc];
+            if (cache.sets)
+            {
+                setFiniteState(cache, address, CoherenceState::INVALID);
+            }
+            else
+            {
+                cache.lines[address] = CoherenceState::INVALID;
+            }
+        }
+        return copies;
+    }
+
+    template <typename Protocol, typename Policy>
+    bool DirectoryCaches<Protocol, Policy>::hasCopy(size_t address, size_t first_proc, size_t last_proc, size_t except_proc)
+    {
+        for (size_t proc = first_proc; proc < last_proc; proc++)
+        {
+            if (proc != except_proc && getCoherenceState(address, proc) != CoherenceState::INVALID)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Only valid for traces remapped to dense line IDs, addresses maps them back.
+    template <typename Protocol, typename Policy>
+    void DirectoryCaches<Protocol, Policy>::setLineAddresses(const std::vector<size_t> &addresses)
+    {
+        for (Cache<Policy> &cache : caches_)
+        {
+            if (cache.sets)
+            {
+                cache.sets->setLineAddresses(&addresses);
+            }
+            else
+            {
+                cache.lines.makeDense(addresses.size());
+            }
         }
-        return os;
     }
 
     std::ostream &operator<<(std::ostream &os, const CoherenceType &type)
@@ -1164,4 +1472,19 @@ namespace csim
         }
         return os;
     }
+
+#define INSTANTIATE(Policy)                                                            \
+    template class SnoopCaches<BuiltinProtocol<CoherenceProtocol::MI>, Policy>;        \
+    template class SnoopCaches<BuiltinProtocol<CoherenceProtocol::MSI>, Policy>;       \
+    template class SnoopCaches<BuiltinProtocol<CoherenceProtocol::MESI>, Policy>;      \
+    template class SnoopCaches<BuiltinProtocol<CoherenceProtocol::MOESI>, Policy>;     \
+    template class SnoopCaches<BuiltinProtocol<CoherenceProtocol::MESIF>, Policy>;     \
+    template class SnoopCaches<SpecProtocol, Policy>;                                  \
+    template class DirectoryCaches<BuiltinProtocol<CoherenceProtocol::MI>, Policy>;    \
+    template class DirectoryCaches<BuiltinProtocol<CoherenceProtocol::MSI>, Policy>;   \
+    template class DirectoryCaches<BuiltinProtocol<CoherenceProtocol::MESI>, Policy>;  \
+    template class DirectoryCaches<BuiltinProtocol<CoherenceProtocol::MOESI>, Policy>; \
+    template class DirectoryCaches<BuiltinProtocol<CoherenceProtocol::MESIF>, Policy>;
+    CSIM_REPLACEMENT_POLICIES(INSTANTIATE)
+#undef INSTANTIATE
 }
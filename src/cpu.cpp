@@ -1,81 +1,132 @@
 #include "cpu.hpp"
 #include "globals.hpp"
 #include "cache.hpp"
+#include <algorithm>
 #include <cassert>
 
 namespace csim
 {
-    bool CPUS::cycle()
+    template <typename Interconnect>
+    bool CPUS<Interconnect>::cycle()
     {
 
         bool progress = false;
 
         for (size_t proc = 0; proc < num_procs_; proc++)
         {
-            CPU &cpu = cpus[proc];
+            progress = step(proc) || progress;
+        }
 
-            if (cpu.pending_req_)
-            {
-                // stalling due to ongoing operation.
-                // std::cout << proc << "cpu request pending " << std::endl;
-                progress = true;
-                continue;
-            }
+        caches_->cycle();
 
-            // processor not waiting on memory
+        cycles++;
 
-            // ensure no pending requests
-            assert(!cpu.pending_req_);
+        return progress;
+    }
 
-            // get next instruction
-            std::optional<Instruction> inst = trace_reader_->readNextLine(proc);
+    template <typename Interconnect>
+    bool CPUS<Interconnect>::step(size_t proc)
+    {
+        CPU &cpu = cpus[proc];
 
-            // check for eof
-            if (!inst)
-            {
-                continue;
-            }
+        if (cpu.pending_reqs_.size() == max_outstanding_)
+        {
+            // stalling due to ongoing operation, a reply wakes it.
+            // std::cout << proc << "cpu request pending " << std::endl;
+            return true;
+        }
 
-            // std::cout << proc << " processing " << *inst << std::endl;
+        // processor can issue another request
+        assert(cpu.pending_reqs_.size() < max_outstanding_);
 
-            // send request to cache
-            size_t seq = cpu.seq_++;
+        // get next instruction
+        std::optional<Instruction> inst = trace_source_->readNextLine(proc);
 
-            CPUMsg cpumsg = CPUMsg{.proc_cycle_ = cycles,
-                                   .msgtype = CPUMsgType::REQUEST,
-                                   .inst_ = *inst,
-                                   .proc_ = proc,
-                                   .proc_seq_ = seq};
-            cpu.pending_req_ = cpumsg;
+        // check for eof, a stream may only be waiting on another processor.
+        if (!inst)
+        {
+            cpu.done_ = trace_source_->finished(proc);
+            return !cpu.pending_reqs_.empty() || !trace_source_->finished(proc);
+        }
 
-            caches_->requestFromProcessor(cpumsg);
+        // std::cout << proc << " processing " << *inst << std::endl;
 
-            progress = true;
-        }
+        // send request to cache
+        size_t seq = cpu.seq_++;
 
-        caches_->cycle();
+        CPUMsg cpumsg = CPUMsg{.proc_cycle_ = cycles,
+                               .msgtype = CPUMsgType::REQUEST,
+                               .inst_ = *inst,
+                               .proc_ = proc,
+                               .proc_seq_ = seq};
+        cpu.pending_reqs_.push_back(cpumsg);
 
-        cycles++;
+        caches_->requestFromProcessor(cpumsg);
 
-        return progress;
+        if (events_ && cpu.pending_reqs_.size() < max_outstanding_)
+        {
+            events_->wake(Component::CPU, proc, cycles + 1);
+        }
+        return true;
     }
 
-    void CPUS::replyFromCache(CPUMsg cpumsg)
+    template <typename Interconnect>
+    void CPUS<Interconnect>::replyFromCache(CPUMsg cpumsg)
     {
         size_t proc = cpumsg.proc_;
         CPU &cpu = cpus[proc];
-        assert(cpu.pending_req_);
-        assert(cpu.pending_req_.value() == cpumsg);
-        cpu.pending_req_.reset();
+        auto it = std::find_if(cpu.pending_reqs_.begin(), cpu.pending_reqs_.end(), [&cpumsg](CPUMsg &req)
+                               { return req == cpumsg; });
+        assert(it != cpu.pending_reqs_.end());
+        cpu.pending_reqs_.erase(it);
+        if (events_)
+        {
+            events_->wake(Component::CPU, proc, cycles + 1);
+        }
+    }
+
+    template <typename Interconnect>
+    void CPUS<Interconnect>::setMaxOutstanding(size_t max_outstanding)
+    {
+        assert(max_outstanding > 0);
+        max_outstanding_ = max_outstanding;
     }
 
-    void CPUS::setCaches(Caches *caches)
+    template <typename Interconnect>
+    void CPUS<Interconnect>::useScheduler(EventScheduler *events)
+    {
+        events_ = events;
+        // every processor starts by reading its trace.
+        for (size_t proc = 0; proc < num_procs_; proc++)
+        {
+            events_->wake(Component::CPU, proc, cycles);
+        }
+    }
+
+    template <typename Interconnect>
+    void CPUS<Interconnect>::setCaches(Interconnect *caches)
     {
         caches_ = caches;
     }
 
-    CPUS::CPUS(TraceReader *trace_reader, size_t num_procs, Caches *caches) : trace_reader_(trace_reader), num_procs_(num_procs), caches_(caches)
+    template <typename Interconnect>
+    CPUS<Interconnect>::CPUS(TraceSource *trace_source, size_t num_procs, Interconnect *caches) : trace_source_(trace_source), num_procs_(num_procs), caches_(caches)
     {
-        cpus = std::vector(num_procs_, CPU{.seq_ = 0, .pending_req_ = std::nullopt});
+        cpus = std::vector(num_procs_, CPU{.seq_ = 0, .pending_reqs_ = {}, .done_ = false});
     }
-}
\ No newline at end of file
+
+#define INSTANTIATE(Policy)                                                                  \
+    template class CPUS<SnoopCaches<BuiltinProtocol<CoherenceProtocol::MI>, Policy>>;        \
+    template class CPUS<SnoopCaches<BuiltinProtocol<CoherenceProtocol::MSI>, Policy>>;       \
+    template class CPUS<SnoopCaches<BuiltinProtocol<CoherenceProtocol::MESI>, Policy>>;      \
+    template class CPUS<SnoopCaches<BuiltinProtocol<CoherenceProtocol::MOESI>, Policy>>;     \
+    template class CPUS<SnoopCaches<BuiltinProtocol<CoherenceProtocol::MESIF>, Policy>>;     \
+    template class CPUS<SnoopCaches<SpecProtocol, Policy>>;                                  \
+    template class CPUS<DirectoryCaches<BuiltinProtocol<CoherenceProtocol::MI>, Policy>>;    \
+    template class CPUS<DirectoryCaches<BuiltinProtocol<CoherenceProtocol::MSI>, Policy>>;   \
+    template class CPUS<DirectoryCaches<BuiltinProtocol<CoherenceProtocol::MESI>, Policy>>;  \
+    template class CPUS<DirectoryCaches<BuiltinProtocol<CoherenceProtocol::MOESI>, Policy>>; \
+    template class CPUS<DirectoryCaches<BuiltinProtocol<CoherenceProtocol::MESIF>, Policy>>;
+    CSIM_REPLACEMENT_POLICIES(INSTANTIATE)
+#undef INSTANTIATE
+}
@@ -0,0 +1,122 @@
+#include "directory.hpp"
+#include <cassert>
+
+namespace csim
+{
+    namespace
+    {
+        const size_t NO_WAY = static_cast<size_t>(-1);
+        const size_t NO_ADDRESS = static_cast<size_t>(-1);
+    }
+
+    DirectoryArray::Policies DirectoryArray::makePolicy(size_t num_sets, size_t assoc, ReplacementPolicy replacement)
+    {
+        switch (replacement)
+        {
+        case ReplacementPolicy::LRU:
+            return Policies(std::in_place_type<LRUPolicy>, num_sets, assoc);
+        case ReplacementPolicy::PLRU:
+            return Policies(std::in_place_type<PLRUPolicy>, num_sets, assoc);
+        case ReplacementPolicy::SRRIP:
+            return Policies(std::in_place_type<SRRIPPolicy>, num_sets, assoc);
+        case ReplacementPolicy::BRRIP:
+            return Policies(std::in_place_type<BRRIPPolicy>, num_sets, assoc);
+        case ReplacementPolicy::RANDOM:
+            return Policies(std::in_place_type<RandomPolicy>, num_sets, assoc);
+        case ReplacementPolicy::FIFO:
+            return Policies(std::in_place_type<FIFOPolicy>, num_sets, assoc);
+        }
+        return Policies(std::in_place_type<LRUPolicy>, num_sets, assoc);
+    }
+
+    DirectoryArray::DirectoryArray(size_t num_sets, size_t assoc, size_t line_size, const Interleave &interleave, ReplacementPolicy replacement)
+        : num_sets_(num_sets), assoc_(assoc), line_size_(line_size), interleave_(interleave), tags_(num_sets * assoc, NO_ADDRESS), entries_(num_sets * assoc), policy_(makePolicy(num_sets, assoc, replacement))
+    {
+        assert(num_sets_ > 0 && assoc_ > 0);
+    }
+
+    size_t DirectoryArray::setOf(size_t address) const
+    {
+        size_t line = line_addresses_ ? (*line_addresses_)[address] : address;
+        return interleave_.local(line / line_size_) % num_sets_;
+    }
+
+    size_t DirectoryArray::way(size_t address) const
+    {
+        size_t base = setOf(address) * assoc_;
+        for (size_t way = base; way < base + assoc_; way++)
+        {
+            if (tags_[way] == address)
+            {
+                return way;
+            }
+        }
+        return NO_WAY;
+    }
+
+    DirEntry *DirectoryArray::find(size_t address)
+    {
+        size_t index = way(address);
+        return index == NO_WAY ? nullptr : &entries_[index];
+    }
+
+    void DirectoryArray::touch(size_t address)
+    {
+        size_t index = way(address);
+        assert(index != NO_WAY);
+        std::visit([this, index](auto &policy)
+                   { policy.onHit(index / assoc_, index % assoc_); },
+                   policy_);
+    }
+
+    std::optional<size_t> DirectoryArray::victim(size_t address)
+    {
+        size_t set = setOf(address);
+        for (size_t way = set * assoc_; way < (set + 1) * assoc_; way++)
+        {
+            if (tags_[way] == NO_ADDRESS)
+            {
+                return std::nullopt;
+            }
+        }
+        size_t victim = std::visit([set](auto &policy)
+                                   { return policy.victim(set); },
+                                   policy_);
+        return tags_[set * assoc_ + victim];
+    }
+
+    DirEntry &DirectoryArray::allocate(size_t address, const DirEntry &entry)
+    {
+        assert(way(address) == NO_WAY);
+        size_t set = setOf(address);
+        for (size_t w = 0; w < assoc_; w++)
+        {
+            size_t index = set * assoc_ + w;
+            if (tags_[index] == NO_ADDRESS)
+            {
+                tags_[index] = address;
+                entries_[index] = entry;
+                std::visit([set, w](auto &policy)
+                           { policy.onFill(set, w); },
+                           policy_);
+                return entries_[index];
+            }
+        }
+        assert(false);
+        return entries_[set * assoc_];
+    }
+
+    void DirectoryArray::release(size_t address)
+    {
+        size_t index = way(address);
+        if (index != NO_WAY)
+        {
+            tags_[index] = NO_ADDRESS;
+        }
+    }
+
+    void DirectoryArray::setLineAddresses(const std::vector<size_t> *addresses)
+    {
+        line_addresses_ = addresses;
+    }
+}
@@ -1,25 +1,122 @@
 #include "directory.hpp"
 #include "cache.hpp"
+#include "hierarchy.hpp"
+#include <algorithm>
 #include <cassert>
 
 namespace csim
 {
+    namespace
+    {
+        const DirEntry UNTRACKED = DirEntry{.state = DirState::UNCACHED, .owner = NO_PROC, .forwarder = NO_PROC, .sharers = 0};
+        const size_t NO_ADDRESS = static_cast<size_t>(-1);
+        const DirBank EMPTY_BANK = DirBank{.lines = LineMap<DirEntry>(UNTRACKED), .sparse = std::nullopt, .tracked = 0, .queue = {}};
+        const DirBankStats EMPTY_BANK_STATS = DirBankStats{.requests = 0, .queue_cycles = 0, .max_queue = 0, .peak_entries = 0};
+    }
+
+    template <typename Protocol, typename Policy>
+    Directory<Protocol, Policy>::Directory(size_t num_procs, DirectoryCaches<Protocol, Policy> *caches, const SharerEncoding &encoding, Stats *stats, bool dir_opt)
+        : num_procs_(num_procs), banks_(1, EMPTY_BANK), interleave_(Interleave{.num_banks = 1, .granularity = 1}), line_size_(1), caches_(caches), encoding_(encoding), stats_(stats), dir_opt_(dir_opt), recalling_(NO_ADDRESS), recalled_(num_procs, LineMap<uint8_t>(0))
+    {
+        assert(num_procs_ < NO_PROC);
+        stats_->dirstats.banks.assign(1, EMPTY_BANK_STATS);
+    }
+
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::setLineAddresses(const std::vector<size_t> &addresses)
+    {
+        line_addresses_ = &addresses;
+        for (DirBank &bank : banks_)
+        {
+            if (bank.sparse)
+            {
+                bank.sparse->setLineAddresses(&addresses);
+            }
+            else if (banks_.size() == 1)
+            {
+                // dense line IDs do not split by bank, several banks keep hashing them.
+                bank.lines.makeDense(addresses.size());
+            }
+        }
+        for (LineMap<uint8_t> &recalled : recalled_)
+        {
+            recalled.makeDense(addresses.size());
+        }
+    }
+
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::useSparse(size_t num_entries, size_t assoc, size_t line_size, ReplacementPolicy replacement)
+    {
+        assert(assoc > 0 && num_entries % (assoc * banks_.size()) == 0);
+        for (DirBank &bank : banks_)
+        {
+            bank.sparse.emplace(num_entries / banks_.size() / assoc, assoc, line_size, interleave_, replacement);
+        }
+    }
 
-    Directory::Directory(size_t num_procs, DirectoryCaches *caches, Stats *stats, bool dir_opt) : num_procs_(num_procs), caches_(caches), stats_(stats), dir_opt_(dir_opt)
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::useBanks(size_t num_banks, size_t interleave, size_t line_size, size_t bank_cycles)
     {
-        directory_ = std::unordered_map<size_t, DirEntry>();
+        assert(num_banks > 0 && interleave > 0 && interleave % line_size == 0);
+        assert(!banks_[0].sparse);
+        banks_.assign(num_banks, EMPTY_BANK);
+        interleave_ = Interleave{.num_banks = num_banks, .granularity = interleave / line_size};
+        line_size_ = line_size;
+        bank_cycles_ = bank_cycles;
+        stats_->dirstats.banks.assign(num_banks, EMPTY_BANK_STATS);
     }
 
-    void Directory::requestFromCache(DirMsg req)
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::setHierarchy(Hierarchy<Policy> *hierarchy)
+    {
+        hierarchy_ = hierarchy;
+    }
+
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::useHopLatency(size_t hop_latency)
+    {
+        hop_latency_ = hop_latency;
+    }
+
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::requestFromCache(DirMsg req)
     {
         DirMsgType type = req.type_;
         size_t src = req.src_proc_;
         size_t address = req.cpureq_.inst_.address;
 
         // std::cout << type << std::endl;
-        assert(type == DirMsgType::READ || type == DirMsgType::WRITE || type == DirMsgType::UPGRADE);
+        assert(type == DirMsgType::READ || type == DirMsgType::WRITE || type == DirMsgType::UPGRADE || type == DirMsgType::EVICT || type == DirMsgType::WRITEBACK);
+
+        // the request waits for its home bank, which delays every message after it.
+        size_t bank = bankOf(address);
+        stats_->dirstats.banks[bank].requests++;
+        if (bank_cycles_ > 0)
+        {
+            req.proc_cycle_ += enqueue(bank, req.proc_cycle_ + hop_latency_);
+        }
 
         DirState currstate = GetState(address);
+        bool miss = type == DirMsgType::READ || type == DirMsgType::WRITE;
+        if (banks_[bank].sparse && currstate != DirState::UNCACHED && (miss || type == DirMsgType::UPGRADE))
+        {
+            banks_[bank].sparse->touch(address);
+        }
+        if (miss && recalled_[src].get(address))
+        {
+            recalled_[src][address] = 0;
+            stats_->dirstats.recall_misses++;
+        }
+
+        // an uncached line comes from below the directory, otherwise a cache supplies it.
+        if (hierarchy_ && miss)
+        {
+            req.proc_cycle_ += hierarchy_->sharedAccess(address, src, fromMemory(lookup(address)));
+        }
+        else if (hierarchy_ && type == DirMsgType::WRITEBACK)
+        {
+            hierarchy_->writeback(address);
+        }
 
         if (type == DirMsgType::READ)
         {
@@ -27,112 +124,124 @@ namespace csim
             {
             case DirState::UNCACHED:
             {
-                // respond with full ownership
-                DirMsg &resp = req;
-                resp.type_ = DirMsgType::DATA;
-                resp.src_proc_ = DIRECTORY;
-                resp.dst_proc_ = src;
-                caches_->replyFromDirectory(resp);
-
-                // simulate traffic
-                if (dir_opt_)
+                // respond with full ownership, MSI has no clean exclusive state to give.
+                respond(req, EXCLUSIVE_READS ? DirMsgType::DATA : DirMsgType::SHARED, DataSource::MEMORY, 0);
+
+                // record that a processor now owns this line.
+                if constexpr (EXCLUSIVE_READS)
                 {
-                    stats_->interconstats.traffic += (2 * 2);
-                    stats_->interconstats.cache_control_traffic += (1 * 2);
-                    stats_->interconstats.mem_data_traffic += (1 * 2);
+                    track(address, DirEntry{.state = DirState::EXCLUSIVE,
+                                            .owner = static_cast<uint16_t>(src),
+                                            .forwarder = NO_PROC,
+                                            .sharers = 0});
                 }
                 else
                 {
-                    stats_->interconstats.traffic += (2 * 2);
-                    stats_->interconstats.cache_control_traffic += (1 * 2);
-                    stats_->interconstats.mem_data_traffic += (1 * 2);
+                    track(address, DirEntry{.state = DirState::SHARED,
+                                            .owner = NO_PROC,
+                                            .forwarder = NO_PROC,
+                                            .sharers = 0});
+                    addSharer(req, src);
                 }
 
-                // record that a processor now owns this line.
-                directory_[address] = DirEntry{.address = address,
-                                               .owner = src,
-                                               .sharers = std::unordered_set<size_t>(),
-                                               .state = DirState::EXCLUSIVE};
-
                 break;
             }
             case DirState::SHARED:
             {
-                assert(!directory_[address].owner.has_value());
-                assert(directory_[address].sharers.size() > 0);
-
-                // respond with sharing
-                DirMsg &resp = req;
-                resp.type_ = DirMsgType::SHARED;
-                resp.src_proc_ = DIRECTORY;
-                resp.dst_proc_ = src;
-                caches_->replyFromDirectory(resp);
-
-                // simulate traffic
-                if (dir_opt_)
-                {
-                    stats_->interconstats.traffic += (4 * 2);
-                    stats_->interconstats.cache_control_traffic += (3 * 2);
-                    stats_->interconstats.cache_data_traffic += (1 * 2);
-                }
-                else
+                assert(entry(address).owner == NO_PROC);
+                assert(!encoding_.empty(entry(address).sharers));
+
+                if constexpr (FORWARDS)
                 {
-                    stats_->interconstats.traffic += (5 * 2);
-                    stats_->interconstats.cache_control_traffic += (4 * 2);
-                    stats_->interconstats.cache_data_traffic += (1 * 2);
+                    // the forwarder supplies the line and hands its role to the requestor,
+                    // without one the line comes from memory.
+                    bool forwarded = entry(address).forwarder != NO_PROC;
+                    if (forwarded)
+                    {
+                        DirMsg downgradereq = req;
+                        downgradereq.type_ = DirMsgType::SHARED;
+                        downgradereq.src_proc_ = DIRECTORY;
+                        downgradereq.dst_proc_ = entry(address).forwarder;
+                        caches_->requestFromDirectory(downgradereq);
+                    }
+                    respond(req, DirMsgType::SHARED, forwarded ? DataSource::CACHE : DataSource::MEMORY, forwarded ? 1 : 0);
+
+                    addSharer(req, src);
+                    entry(address).forwarder = static_cast<uint16_t>(src);
+                    break;
                 }
 
+                // shared lines are clean, memory supplies the line without asking a sharer.
+                respond(req, DirMsgType::SHARED, DataSource::MEMORY, 0);
+
                 // Add to list sharers
-                directory_[address].sharers.insert(src);
+                addSharer(req, src);
                 break;
             }
 
             case DirState::EXCLUSIVE:
             {
-                assert(directory_[address].owner.has_value());
-                assert(directory_[address].sharers.empty());
+                assert(entry(address).owner != NO_PROC);
+                assert(encoding_.empty(entry(address).sharers));
+
+                if constexpr (!SHARES)
+                {
+                    // a line is never shared, the owner loses it to the reader.
+                    size_t sent = invalidateCopies(req);
+                    respond(req, DirMsgType::DATA, DataSource::CACHE, sent);
+                    entry(address).owner = static_cast<uint16_t>(src);
+                    break;
+                }
 
                 // downgrade current owner
-                size_t owner = directory_[address].owner.value();
+                size_t owner = entry(address).owner;
                 DirMsg downgradereq = req;
                 downgradereq.type_ = DirMsgType::SHARED;
                 downgradereq.src_proc_ = DIRECTORY;
                 downgradereq.dst_proc_ = owner;
-                caches_->requestFromDirectory(downgradereq);
-
-                // remove owner and add it to sharers
-                directory_[address].owner.reset();
-                directory_[address].sharers.insert(owner);
+                bool dirty = caches_->requestFromDirectory(downgradereq);
 
-                // reply with shared to current requestor
-                DirMsg sharedresp = req;
-                sharedresp.type_ = DirMsgType::SHARED;
-                sharedresp.src_proc_ = DIRECTORY;
-                sharedresp.dst_proc_ = src;
-                caches_->replyFromDirectory(sharedresp);
-
-                // add requestor to sharers list
-                directory_[address].sharers.insert(src);
-
-                // change state to shared
-                directory_[address].state = DirState::SHARED;
-
-                // simulate traffic
-                if (dir_opt_)
+                // MOESI keeps the owner responsible for the line, the others share it.
+                if constexpr (OWNS)
                 {
-                    stats_->interconstats.traffic += (4 * 2);
-                    stats_->interconstats.cache_control_traffic += (3 * 2);
-                    stats_->interconstats.cache_data_traffic += (1 * 2);
+                    entry(address).state = DirState::OWNED;
                 }
                 else
                 {
-                    stats_->interconstats.traffic += (5 * 2);
-                    stats_->interconstats.cache_control_traffic += (4 * 2);
-                    stats_->interconstats.cache_data_traffic += (1 * 2);
+                    // remove owner and add it to sharers
+                    entry(address).owner = NO_PROC;
+                    addSharer(req, owner);
+                    entry(address).state = DirState::SHARED;
+                }
+
+                // the owner sends the line to the current requestor, a dirty line also goes
+                // to memory unless the owner keeps it.
+                bool writeback = dirty && !OWNS;
+                if (writeback && hierarchy_)
+                {
+                    hierarchy_->writeback(address);
+                }
+                respond(req, DirMsgType::SHARED, DataSource::CACHE, 1, writeback);
+
+                // add requestor to sharers list, under MESIF it forwards the line from now on.
+                addSharer(req, src);
+                if constexpr (FORWARDS)
+                {
+                    entry(address).forwarder = static_cast<uint16_t>(src);
                 }
 
                 break;
             }
+            case DirState::OWNED:
+            {
+                assert(entry(address).owner != NO_PROC);
+
+                // the owner supplies the line and keeps it dirty.
+                respond(req, DirMsgType::SHARED, DataSource::CACHE, 1);
+                addSharer(req, src);
+
+                break;
+            }
             }
         }
         else if (type == DirMsgType::WRITE)
@@ -142,125 +251,66 @@ namespace csim
             case DirState::UNCACHED:
             {
                 // respond with full ownership
-                DirMsg &resp = req;
-                resp.type_ = DirMsgType::DATA;
-                resp.src_proc_ = DIRECTORY;
-                resp.dst_proc_ = src;
-                caches_->replyFromDirectory(resp);
-
-                // simulate traffic
-                if (dir_opt_)
-                {
-                    stats_->interconstats.traffic += (2 * 2);
-                    stats_->interconstats.cache_control_traffic += (1 * 2);
-                    stats_->interconstats.mem_data_traffic += (1 * 2);
-                }
-                else
-                {
-                    stats_->interconstats.traffic += (2 * 2);
-                    stats_->interconstats.cache_control_traffic += (1 * 2);
-                    stats_->interconstats.mem_data_traffic += (1 * 2);
-                }
+                respond(req, DirMsgType::DATA, DataSource::MEMORY, 0);
 
                 // record that a processor now owns this line.
-                directory_[address] = DirEntry{.address = address,
-                                               .owner = src,
-                                               .sharers = std::unordered_set<size_t>(),
-                                               .state = DirState::EXCLUSIVE};
+                track(address, DirEntry{.state = DirState::EXCLUSIVE,
+                                        .owner = static_cast<uint16_t>(src),
+                                        .forwarder = NO_PROC,
+                                        .sharers = 0});
 
                 break;
             }
             case DirState::SHARED:
             {
-                assert(!directory_[address].owner.has_value());
-                assert(directory_[address].sharers.size() > 0);
+                assert(entry(address).owner == NO_PROC);
+                assert(!encoding_.empty(entry(address).sharers));
 
-                size_t sharerscount = directory_[address].sharers.size();
+                // memory supplies a shared line unless a MESIF forwarder does.
+                bool from_memory = fromMemory(entry(address));
 
                 // invalidate all sharers
-                for (size_t sharer : directory_[address].sharers)
-                {
-                    DirMsg invlreq = req;
-                    invlreq.type_ = DirMsgType::INVALIDATE;
-                    invlreq.src_proc_ = DIRECTORY;
-                    invlreq.dst_proc_ = sharer;
-                    caches_->requestFromDirectory(invlreq);
-                }
-
-                // remove the shared ownership
-                directory_[address].sharers.clear();
+                size_t sharerscount = invalidateCopies(req);
 
                 // respond to requestor with full ownership
-                DirMsg resp = req;
-                resp.type_ = DirMsgType::DATA;
-                resp.src_proc_ = DIRECTORY;
-                resp.dst_proc_ = src;
-                caches_->replyFromDirectory(resp);
+                respond(req, DirMsgType::DATA, (from_memory || sharerscount == 0) ? DataSource::MEMORY : DataSource::CACHE, sharerscount);
 
                 // record that the requestor now owns this line
-                directory_[address].owner = src;
-                directory_[address].state = DirState::EXCLUSIVE;
+                entry(address).owner = static_cast<uint16_t>(src);
+                entry(address).state = DirState::EXCLUSIVE;
 
-                // simulate traffic
-                if (dir_opt_)
-                {
-                    stats_->interconstats.traffic += ((2 + (sharerscount * 2)) * 2);
-                    stats_->interconstats.cache_control_traffic += (1 * 2);
-                    stats_->interconstats.cache_control_traffic += ((sharerscount * 2) * 2);
-                    stats_->interconstats.cache_data_traffic += (1 * 2);
-                }
-                else
-                {
-                    stats_->interconstats.traffic += ((2 + (sharerscount * 2)) * 2);
-                    stats_->interconstats.cache_control_traffic += (1 * 2);
-                    stats_->interconstats.cache_control_traffic += ((sharerscount * 2) * 2);
-                    stats_->interconstats.cache_data_traffic += (1 * 2);
-                }
+                break;
+            }
+            case DirState::OWNED:
+            {
+                assert(entry(address).owner != NO_PROC);
+
+                // invalidate the owner, which supplies the line, and every sharer
+                size_t copiescount = invalidateCopies(req);
+
+                // respond to requestor with full ownership
+                respond(req, DirMsgType::DATA, DataSource::CACHE, copiescount);
+
+                // record that the requestor now owns this line
+                entry(address).owner = static_cast<uint16_t>(src);
+                entry(address).state = DirState::EXCLUSIVE;
 
                 break;
             }
             case DirState::EXCLUSIVE:
             {
-                assert(directory_[address].owner.has_value());
-                assert(directory_[address].sharers.empty());
+                assert(entry(address).owner != NO_PROC);
+                assert(encoding_.empty(entry(address).sharers));
 
-                // invalidate current owner
-                size_t currowner = directory_[address].owner.value();
-                DirMsg invlreq = req;
-                invlreq.type_ = DirMsgType::INVALIDATE;
-                invlreq.src_proc_ = DIRECTORY;
-                invlreq.dst_proc_ = currowner;
-                caches_->requestFromDirectory(invlreq);
-
-                // remove the current ownership
-                directory_[address].owner.reset();
+                // invalidate current owner, which supplies the line
+                size_t sent = invalidateCopies(req);
 
                 // respond to requestor with full ownership
-                DirMsg resp = req;
-                resp.type_ = DirMsgType::DATA;
-                resp.src_proc_ = DIRECTORY;
-                resp.dst_proc_ = src;
-                caches_->replyFromDirectory(resp);
+                respond(req, DirMsgType::DATA, DataSource::CACHE, sent);
 
                 // record that the requestor now owns this line
-                directory_[address].owner = src;
-                directory_[address].state = DirState::EXCLUSIVE;
-
-                // simulate traffic
-                if (dir_opt_)
-                {
-                    stats_->interconstats.traffic += ((2 + (1 * 2)) * 2);
-                    stats_->interconstats.cache_control_traffic += (1 * 2);
-                    stats_->interconstats.cache_control_traffic += ((1 * 2) * 2);
-                    stats_->interconstats.cache_data_traffic += (1 * 2);
-                }
-                else
-                {
-                    stats_->interconstats.traffic += ((2 + (1 * 2)) * 2);
-                    stats_->interconstats.cache_control_traffic += (1 * 2);
-                    stats_->interconstats.cache_control_traffic += ((1 * 2) * 2);
-                    stats_->interconstats.cache_data_traffic += (1 * 2);
-                }
+                entry(address).owner = static_cast<uint16_t>(src);
+                entry(address).state = DirState::EXCLUSIVE;
 
                 break;
             }
@@ -278,49 +328,33 @@ namespace csim
             }
             case DirState::SHARED:
             {
-                assert(!directory_[address].owner.has_value());
-                assert(directory_[address].sharers.size() > 0);
-
-                size_t sharerscount = directory_[address].sharers.size() - 1;
+                assert(entry(address).owner == NO_PROC);
+                assert(!encoding_.empty(entry(address).sharers));
 
                 // invalidate all sharers except the requestor
-                for (size_t sharer : directory_[address].sharers)
-                {
-                    if (sharer != src)
-                    {
-                        DirMsg invlreq = req;
-                        invlreq.type_ = DirMsgType::INVALIDATE;
-                        invlreq.src_proc_ = DIRECTORY;
-                        invlreq.dst_proc_ = sharer;
-                        caches_->requestFromDirectory(invlreq);
-                    }
-                }
-
-                // remove the shared ownership
-                directory_[address].sharers.clear();
+                size_t sharerscount = invalidateCopies(req);
 
                 // respond to requestor with full ownership
-                DirMsg resp = req;
-                resp.type_ = DirMsgType::DATA;
-                resp.src_proc_ = DIRECTORY;
-                resp.dst_proc_ = src;
-                caches_->replyFromDirectory(resp);
+                respond(req, DirMsgType::DATA, DataSource::NONE, sharerscount);
 
                 // record that the requestor now owns this line
-                directory_[address].owner = src;
-                directory_[address].state = DirState::EXCLUSIVE;
+                entry(address).owner = static_cast<uint16_t>(src);
+                entry(address).state = DirState::EXCLUSIVE;
 
-                // simulate traffic
-                if (dir_opt_)
-                {
-                    stats_->interconstats.traffic += ((2 + (sharerscount * 2)) * 2);
-                    stats_->interconstats.cache_control_traffic += ((2 + (sharerscount * 2)) * 2);
-                }
-                else
-                {
-                    stats_->interconstats.traffic += ((2 + (sharerscount * 2)) * 2);
-                    stats_->interconstats.cache_control_traffic += ((2 + (sharerscount * 2)) * 2);
-                }
+                break;
+            }
+            case DirState::OWNED:
+            {
+                assert(entry(address).owner != NO_PROC);
+
+                // the owner or a sharer writes, every other copy goes.
+                assert(entry(address).owner == src || encoding_.contains(entry(address).sharers, src));
+                size_t copiescount = invalidateCopies(req);
+
+                respond(req, DirMsgType::DATA, DataSource::NONE, copiescount);
+
+                entry(address).owner = static_cast<uint16_t>(src);
+                entry(address).state = DirState::EXCLUSIVE;
 
                 break;
             }
@@ -332,14 +366,363 @@ namespace csim
             }
             }
         }
+        else if (type == DirMsgType::EVICT || type == DirMsgType::WRITEBACK)
+        {
+            // a cache replaced the line, stop tracking it there.
+            assert(currstate != DirState::UNCACHED);
+            if (address == recalling_)
+            {
+                // a copy answers the recall of the line's entry, which then goes as a whole.
+                recalled_[src][address] = 1;
+                stats_->dirstats.recall_invalidations++;
+                send(type == DirMsgType::WRITEBACK ? Payload::MEMORY_DATA : Payload::CONTROL);
+                return;
+            }
+            if (currstate == DirState::EXCLUSIVE)
+            {
+                assert(entry(address).owner == src);
+                entry(address).owner = NO_PROC;
+                entry(address).state = DirState::UNCACHED;
+            }
+            else if (currstate == DirState::OWNED && entry(address).owner == src)
+            {
+                // the dirty copy reached memory, the sharers are left with a clean line.
+                assert(type == DirMsgType::WRITEBACK);
+                entry(address).owner = NO_PROC;
+                entry(address).state = encoding_.empty(entry(address).sharers) ? DirState::UNCACHED : DirState::SHARED;
+            }
+            else
+            {
+                assert(type == DirMsgType::EVICT);
+                assert(encoding_.contains(entry(address).sharers, src));
+                encoding_.remove(entry(address).sharers, src);
+                // an imprecise entry keeps src until the caches it cannot tell apart dropped the
+                // line. It asks each of them, and each answers.
+                auto [first, last] = encoding_.aliases(entry(address).sharers, src);
+                if (first < last)
+                {
+                    size_t asked = last - first - (src >= first && src < last ? 1 : 0);
+                    stats_->dirstats.sharer_queries += asked;
+                    send(Payload::CONTROL, 2 * asked);
+                    if (!caches_->hasCopy(address, first, last, src))
+                    {
+                        encoding_.drop(entry(address).sharers, src);
+                    }
+                }
+                if (entry(address).forwarder == src)
+                {
+                    entry(address).forwarder = NO_PROC;
+                }
+                if (encoding_.empty(entry(address).sharers) && currstate == DirState::SHARED)
+                {
+                    entry(address).state = DirState::UNCACHED;
+                }
+            }
+
+            // simulate traffic, a writeback carries the line to memory.
+            send(type == DirMsgType::WRITEBACK ? Payload::MEMORY_DATA : Payload::CONTROL);
+
+            if (entry(address).state == DirState::UNCACHED)
+            {
+                untrack(address);
+            }
+        }
+    }
+    // The home bank of a line.
+    template <typename Protocol, typename Policy>
+    size_t Directory<Protocol, Policy>::bankOf(size_t address) const
+    {
+        if (banks_.size() == 1)
+        {
+            return 0;
+        }
+        size_t line = (line_addresses_ ? (*line_addresses_)[address] : address) / line_size_;
+        return interleave_.bank(line);
+    }
+
+    // Queues a request that reaches bank at arrival behind the ones it is still serving,
+    // returns the cycles it waits.
+    template <typename Protocol, typename Policy>
+    size_t Directory<Protocol, Policy>::enqueue(size_t bank, size_t arrival)
+    {
+        std::deque<size_t> &queue = banks_[bank].queue;
+        while (!queue.empty() && queue.front() <= arrival)
+        {
+            queue.pop_front();
+        }
+        size_t start = queue.empty() ? arrival : std::max(arrival, queue.back());
+        queue.push_back(start + bank_cycles_);
+
+        DirBankStats &bankstats = stats_->dirstats.banks[bank];
+        bankstats.queue_cycles += start - arrival;
+        bankstats.max_queue = std::max(bankstats.max_queue, queue.size());
+        return start - arrival;
+    }
+
+    template <typename Protocol, typename Policy>
+    DirState Directory<Protocol, Policy>::GetState(size_t address)
+    {
+        return lookup(address).state;
+    }
+
+    template <typename Protocol, typename Policy>
+    DirEntry Directory<Protocol, Policy>::lookup(size_t address)
+    {
+        DirBank &bank = banks_[bankOf(address)];
+        if (bank.sparse)
+        {
+            DirEntry *tracked = bank.sparse->find(address);
+            return tracked ? *tracked : UNTRACKED;
+        }
+        return bank.lines.get(address);
+    }
+
+    // The entry of a line that has one.
+    template <typename Protocol, typename Policy>
+    DirEntry &Directory<Protocol, Policy>::entry(size_t address)
+    {
+        DirBank &bank = banks_[bankOf(address)];
+        if (bank.sparse)
+        {
+            DirEntry *tracked = bank.sparse->find(address);
+            assert(tracked);
+            return *tracked;
+        }
+        return bank.lines[address];
+    }
+
+    // Gives an uncached line its entry, a sparse directory may have to replace one for it.
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::track(size_t address, const DirEntry &fresh)
+    {
+        size_t index = bankOf(address);
+        DirBank &bank = banks_[index];
+        if (bank.sparse)
+        {
+            if (std::optional<size_t> victim = bank.sparse->victim(address))
+            {
+                recall(*victim);
+            }
+            bank.sparse->allocate(address, fresh);
+        }
+        else
+        {
+            bank.lines[address] = fresh;
+        }
+        tracked_++;
+        bank.tracked++;
+        stats_->dirstats.peak_entries = std::max(stats_->dirstats.peak_entries, tracked_);
+        stats_->dirstats.banks[index].peak_entries = std::max(stats_->dirstats.banks[index].peak_entries, bank.tracked);
+    }
+
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::untrack(size_t address)
+    {
+        DirBank &bank = banks_[bankOf(address)];
+        if (bank.sparse)
+        {
+            bank.sparse->release(address);
+        }
+        tracked_--;
+        bank.tracked--;
+    }
+
+    // Takes every copy of a line back from the caches so its entry can go.
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::recall(size_t address)
+    {
+        stats_->dirstats.entry_evictions++;
+
+        // nobody missed, the caches holding a copy answer the directory with it.
+        DirMsg req = DirMsg{
+            .proc_cycle_ = 0,
+            .type_ = DirMsgType::INVALIDATE,
+            .cpureq_ = CPUMsg{.proc_cycle_ = 0,
+                              .msgtype = CPUMsgType::REQUEST,
+                              .inst_ = Instruction{.command = OperationType::MEM_STORE, .address = address},
+                              .proc_ = DIRECTORY,
+                              .proc_seq_ = 0},
+            .src_proc_ = DIRECTORY,
+            .dst_proc_ = DIRECTORY};
+        size_t answered = stats_->dirstats.recall_invalidations;
+        recalling_ = address;
+        size_t sent = invalidateCopies(req);
+        recalling_ = NO_ADDRESS;
+        answered = stats_->dirstats.recall_invalidations - answered;
+
+        // the invalidations, then the acknowledgements of the caches without a copy.
+        send(Payload::CONTROL, sent);
+        send(Payload::CONTROL, sent - answered);
+        untrack(address);
+    }
+
+    // Whether a miss on entry gets its data from memory rather than from a cache.
+    template <typename Protocol, typename Policy>
+    bool Directory<Protocol, Policy>::fromMemory(const DirEntry &entry) const
+    {
+        if (entry.state == DirState::UNCACHED)
+        {
+            return true;
+        }
+        // shared lines are clean, only a MESIF forwarder supplies one from its cache.
+        return entry.state == DirState::SHARED && (!FORWARDS || entry.forwarder == NO_PROC);
+    }
+
+    // Invalidates the owner and the sharers other than the requestor, none of them keeps a
+    // copy. Returns the invalidations sent, imprecise encodings send some to caches
+    // without a copy.
+    template <typename Protocol, typename Policy>
+    size_t Directory<Protocol, Policy>::invalidateCopies(const DirMsg &req)
+    {
+        size_t address = req.cpureq_.inst_.address;
+        DirEntry copies = entry(address);
+        size_t sent = 0;
+        auto invalidate = [&](size_t proc)
+        {
+            if (proc == req.src_proc_)
+            {
+                return;
+            }
+            DirMsg invlreq = req;
+            invlreq.type_ = DirMsgType::INVALIDATE;
+            invlreq.src_proc_ = DIRECTORY;
+            invlreq.dst_proc_ = proc;
+            caches_->requestFromDirectory(invlreq);
+            sent++;
+        };
+        if (copies.owner != NO_PROC)
+        {
+            invalidate(copies.owner);
+        }
+        encoding_.forEach(copies.sharers, invalidate);
+        stats_->dirstats.invalidations += sent;
+
+        entry(address).owner = NO_PROC;
+        entry(address).forwarder = NO_PROC;
+        encoding_.clear(entry(address).sharers);
+        return sent;
+    }
+
+    // Records proc as a sharer. A Dir_i_NB entry out of pointers invalidates its oldest sharer.
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::addSharer(const DirMsg &req, size_t proc)
+    {
+        size_t address = req.cpureq_.inst_.address;
+        uint64_t &sharers = entry(address).sharers;
+        bool overflowed = encoding_.overflowed(sharers);
+        std::optional<size_t> victim = encoding_.add(sharers, proc);
+        if (!overflowed && encoding_.overflowed(sharers))
+        {
+            stats_->dirstats.pointer_overflows++;
+        }
+        if (!victim)
+        {
+            return;
+        }
+
+        stats_->dirstats.pointer_overflows++;
+        if (entry(address).forwarder == *victim)
+        {
+            entry(address).forwarder = NO_PROC;
+        }
+        DirMsg invlreq = req;
+        invlreq.type_ = DirMsgType::INVALIDATE;
+        invlreq.src_proc_ = DIRECTORY;
+        invlreq.dst_proc_ = *victim;
+        caches_->requestFromDirectory(invlreq);
+        stats_->dirstats.invalidations++;
+        stats_->dirstats.extra_invalidations++;
+
+        // simulate traffic, the invalidation and its acknowledgement.
+        send(Payload::CONTROL, 2);
     }
-    DirState Directory::GetState(size_t address)
+
+    // Counts count messages, each one twice.
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::send(Payload payload, size_t count)
     {
-        if (directory_.find(address) == directory_.end())
+        stats_->interconstats.traffic += (count * 2);
+        switch (payload)
+        {
+        case Payload::CONTROL:
+            stats_->interconstats.cache_control_traffic += (count * 2);
+            break;
+        case Payload::CACHE_DATA:
+            stats_->interconstats.cache_data_traffic += (count * 2);
+            break;
+        case Payload::MEMORY_DATA:
+            stats_->interconstats.mem_data_traffic += (count * 2);
+            break;
+        }
+    }
+
+    // Counts the messages of a request the home answers after forwarding it to, or
+    // invalidating, copies caches. Without dir_opt the caches answer the home, which then
+    // replies: 4 hops. With it they answer the requestor directly and a cache that supplies
+    // the line tells the home it moved: 3 hops. Returns the hops on the critical path.
+    // A supplier with a writeback pays for the dirty line reaching memory.
+    template <typename Protocol, typename Policy>
+    size_t Directory<Protocol, Policy>::sendTransaction(DataSource source, size_t copies, bool writeback)
+    {
+        assert(source != DataSource::CACHE || copies > 0);
+        bool supplied = source == DataSource::CACHE;
+
+        // the request, then the home forwards it or invalidates.
+        send(Payload::CONTROL);
+        send(Payload::CONTROL, copies);
+
+        // the caches answer, the one that supplies the line with it.
+        if (supplied)
+        {
+            stats_->dirstats.forwards++;
+            send(Payload::CACHE_DATA);
+            send(Payload::CONTROL, copies - 1);
+        }
+        else
+        {
+            send(Payload::CONTROL, copies);
+        }
+
+        // the home replies, unless the supplier already sent the line to the requestor.
+        // Then it only tells the home, with the line if memory has to take it.
+        if (supplied && dir_opt_)
+        {
+            send(writeback ? Payload::MEMORY_DATA : Payload::CONTROL);
+        }
+        else if (supplied)
+        {
+            send(Payload::CACHE_DATA);
+        }
+        else
         {
-            return DirState::UNCACHED;
+            send(source == DataSource::MEMORY ? Payload::MEMORY_DATA : Payload::CONTROL);
         }
 
-        return directory_[address].state;
+        size_t hops = copies == 0 ? 2 : (dir_opt_ ? 3 : 4);
+        stats_->dirstats.requests++;
+        stats_->dirstats.hops += hops;
+        return hops;
     }
+
+    // Sends the requestor its line or ownership once the transaction's messages arrive.
+    template <typename Protocol, typename Policy>
+    void Directory<Protocol, Policy>::respond(const DirMsg &req, DirMsgType type, DataSource source, size_t copies, bool writeback)
+    {
+        size_t hops = sendTransaction(source, copies, writeback);
+        DirMsg resp = req;
+        resp.type_ = type;
+        resp.proc_cycle_ = req.proc_cycle_ + hops * hop_latency_;
+        resp.src_proc_ = DIRECTORY;
+        resp.dst_proc_ = req.src_proc_;
+        caches_->replyFromDirectory(resp);
+    }
+
+#define INSTANTIATE(Policy)                                                      \
+    template class Directory<BuiltinProtocol<CoherenceProtocol::MI>, Policy>;    \
+    template class Directory<BuiltinProtocol<CoherenceProtocol::MSI>, Policy>;   \
+    template class Directory<BuiltinProtocol<CoherenceProtocol::MESI>, Policy>;  \
+    template class Directory<BuiltinProtocol<CoherenceProtocol::MOESI>, Policy>; \
+    template class Directory<BuiltinProtocol<CoherenceProtocol::MESIF>, Policy>;
+    CSIM_REPLACEMENT_POLICIES(INSTANTIATE)
+#undef INSTANTIATE
 }
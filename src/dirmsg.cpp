@@ -26,6 +26,12 @@ namespace csim
         case DirMsgType::INVALIDATE:
             os << "INVALIDATE";
             break;
+        case DirMsgType::EVICT:
+            os << "EVICT";
+            break;
+        case DirMsgType::WRITEBACK:
+            os << "WRITEBACK";
+            break;
         }
         return os;
     }
@@ -0,0 +1,229 @@
+#include "hierarchy.hpp"
+#include <cassert>
+
+namespace csim
+{
+    template <typename Policy>
+    Hierarchy<Policy>::Hierarchy(const HierarchyConfig &config, size_t num_procs, HierarchyStats *stats) : config_(config), stats_(stats)
+    {
+        if (config_.l1.num_sets > 0)
+        {
+            l1s_ = std::vector<CacheArray<Policy>>(num_procs, CacheArray<Policy>(config_.l1));
+        }
+        if (config_.llc.num_sets > 0)
+        {
+            llc_.emplace(config_.llc);
+        }
+        const LevelStats empty = LevelStats{.hits = 0, .misses = 0};
+        *stats_ = HierarchyStats{.l1 = !l1s_.empty(), .llc = llc_.has_value(), .l1_stats = empty, .l2_stats = empty, .llc_stats = empty, .llc_writebacks = 0, .back_invalidations = 0, .memory_reads = 0, .memory_writes = 0, .accesses = 0, .latency = 0};
+    }
+
+    template <typename Policy>
+    void Hierarchy<Policy>::setCaches(Caches *caches)
+    {
+        caches_ = caches;
+    }
+
+    // Only valid for traces remapped to dense line IDs, addresses maps them back.
+    template <typename Policy>
+    void Hierarchy<Policy>::setLineAddresses(const std::vector<size_t> &addresses)
+    {
+        for (CacheArray<Policy> &l1 : l1s_)
+        {
+            l1.setLineAddresses(&addresses);
+        }
+        if (llc_)
+        {
+            llc_->setLineAddresses(&addresses);
+        }
+    }
+
+    template <typename Policy>
+    void Hierarchy<Policy>::privateHit(size_t address, size_t proc)
+    {
+        stats_->accesses++;
+        if (l1s_.empty())
+        {
+            stats_->l2_stats.hits++;
+            stats_->latency += config_.l2_latency;
+            return;
+        }
+
+        CacheArray<Policy> &l1 = l1s_[proc];
+        stats_->latency += config_.l1_latency;
+        if (l1.touch(address) != CoherenceState::INVALID)
+        {
+            stats_->l1_stats.hits++;
+            return;
+        }
+        stats_->l1_stats.misses++;
+        stats_->l2_stats.hits++;
+        stats_->latency += config_.l2_latency;
+        l1.set(address, CoherenceState::SHARED);
+    }
+
+    template <typename Policy>
+    void Hierarchy<Policy>::privateMiss(size_t address, size_t proc)
+    {
+        (void)address;
+        (void)proc;
+        stats_->accesses++;
+        if (!l1s_.empty())
+        {
+            // an L1 copy that needs an upgrade still misses.
+            stats_->l1_stats.misses++;
+        }
+        stats_->l2_stats.misses++;
+        stats_->latency += missLatency();
+    }
+
+    template <typename Policy>
+    size_t Hierarchy<Policy>::missLatency() const
+    {
+        return (l1s_.empty() ? 0 : config_.l1_latency) + config_.l2_latency;
+    }
+
+    template <typename Policy>
+    void Hierarchy<Policy>::fill(size_t address, size_t proc)
+    {
+        if (l1s_.empty())
+        {
+            return;
+        }
+        // L1 lines are clean copies of the L2's, dropping one needs no writeback.
+        CacheArray<Policy> &l1 = l1s_[proc];
+        if (l1.touch(address) == CoherenceState::INVALID)
+        {
+            l1.set(address, CoherenceState::SHARED);
+        }
+    }
+
+    template <typename Policy>
+    void Hierarchy<Policy>::invalidate(size_t address, size_t proc)
+    {
+        if (!l1s_.empty())
+        {
+            l1s_[proc].set(address, CoherenceState::INVALID);
+        }
+    }
+
+    template <typename Policy>
+    size_t Hierarchy<Policy>::sharedAccess(size_t address, size_t proc, bool from_memory)
+    {
+        (void)proc;
+        size_t latency = config_.llc_latency;
+        if (llc_)
+        {
+            // a non-inclusive LLC may miss on a line another cache supplies.
+            bool hit = llc_->touch(address) != CoherenceState::INVALID;
+            if (hit)
+            {
+                stats_->llc_stats.hits++;
+            }
+            else
+            {
+                stats_->llc_stats.misses++;
+            }
+            if (hit || !from_memory)
+            {
+                stats_->latency += latency;
+                return latency;
+            }
+            if (std::optional<CacheLine> victim = llc_->set(address, CoherenceState::SHARED))
+            {
+                evictFromLLC(*victim);
+            }
+        }
+        if (from_memory)
+        {
+            stats_->memory_reads++;
+            latency += config_.mem_latency;
+        }
+        stats_->latency += latency;
+        return latency;
+    }
+
+    template <typename Policy>
+    void Hierarchy<Policy>::writeback(size_t address)
+    {
+        if (!llc_)
+        {
+            stats_->memory_writes++;
+            return;
+        }
+
+        if (llc_->get(address) != CoherenceState::INVALID)
+        {
+            llc_->set(address, CoherenceState::MODIFIED);
+            return;
+        }
+        if (config_.llc_inclusion == InclusionPolicy::INCLUSIVE)
+        {
+            // only a back-invalidated line can be missing from an inclusive LLC, it is
+            // on its way to memory.
+            stats_->memory_writes++;
+            return;
+        }
+        if (std::optional<CacheLine> victim = llc_->set(address, CoherenceState::MODIFIED))
+        {
+            evictFromLLC(*victim);
+        }
+    }
+
+    template <typename Policy>
+    void Hierarchy<Policy>::evictFromLLC(const CacheLine &victim)
+    {
+        if (victim.state == CoherenceState::MODIFIED)
+        {
+            stats_->llc_writebacks++;
+            stats_->memory_writes++;
+        }
+        if (config_.llc_inclusion == InclusionPolicy::INCLUSIVE)
+        {
+            assert(caches_);
+            stats_->back_invalidations += caches_->backInvalidate(victim.address);
+        }
+    }
+
+    std::ostream &operator<<(std::ostream &os, const InclusionPolicy &policy)
+    {
+        switch (policy)
+        {
+        case InclusionPolicy::INCLUSIVE:
+            os << "INCLUSIVE";
+            break;
+        case InclusionPolicy::NON_INCLUSIVE:
+            os << "NON_INCLUSIVE";
+            break;
+        }
+        return os;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const HierarchyStats &stats)
+    {
+        os << "HIERARCHY" << "\n";
+        if (stats.l1)
+        {
+            os << "L1 HITS:\t" << stats.l1_stats.hits << "\n";
+            os << "L1 MISSES:\t" << stats.l1_stats.misses << "\n";
+        }
+        os << "L2 HITS:\t" << stats.l2_stats.hits << "\n";
+        os << "L2 MISSES:\t" << stats.l2_stats.misses << "\n";
+        if (stats.llc)
+        {
+            os << "LLC HITS:\t" << stats.llc_stats.hits << "\n";
+            os << "LLC MISSES:\t" << stats.llc_stats.misses << "\n";
+            os << "LLC WRITEBACKS:\t" << stats.llc_writebacks << "\n";
+            os << "LLC BACK INVALIDATIONS:\t" << stats.back_invalidations << "\n";
+        }
+        os << "MEMORY READS:\t" << stats.memory_reads << "\n";
+        os << "MEMORY WRITES:\t" << stats.memory_writes << "\n";
+        os << "TOTAL LATENCY:\t" << stats.latency << "\n";
+        os << "AVERAGE LATENCY:\t" << (stats.accesses ? (double)stats.latency / stats.accesses : 0.0) << "\n";
+        return os;
+    }
+
+#define INSTANTIATE(Policy) template class Hierarchy<Policy>;
+    CSIM_REPLACEMENT_POLICIES(INSTANTIATE)
+#undef INSTANTIATE
+}
@@ -0,0 +1,68 @@
+#include "lineremap.hpp"
+#include <unordered_map>
+
+namespace csim
+{
+    namespace
+    {
+        // IDs keep one bit for the operation.
+        const size_t MAX_LINE_IDS = size_t(1) << 31;
+    }
+
+    RemappedTrace::RemappedTrace(TraceSource *trace_source, size_t num_procs)
+    {
+        records_ = std::vector<std::vector<uint32_t>>(num_procs);
+        cursors_ = std::vector<size_t>(num_procs, 0);
+
+        std::unordered_map<size_t, uint32_t> ids;
+        for (size_t proc = 0; proc < num_procs; proc++)
+        {
+            while (std::optional<Instruction> ins = trace_source->readNextLine(proc))
+            {
+                auto [it, inserted] = ids.try_emplace(ins->address, static_cast<uint32_t>(addresses_.size()));
+                if (inserted)
+                {
+                    if (addresses_.size() == MAX_LINE_IDS)
+                    {
+                        std::cerr << "trace touches more than " << MAX_LINE_IDS << " lines, cannot remap" << std::endl;
+                        exit(255);
+                    }
+                    addresses_.push_back(ins->address);
+                }
+                records_[proc].push_back(it->second << 1 | (ins->command == OperationType::MEM_STORE ? 1 : 0));
+            }
+            records_[proc].shrink_to_fit();
+        }
+    }
+
+    std::optional<Instruction> RemappedTrace::readNextLine(size_t proc)
+    {
+        size_t &cursor = cursors_[proc];
+        if (cursor == records_[proc].size())
+        {
+            return std::nullopt;
+        }
+
+        uint32_t record = records_[proc][cursor++];
+        return Instruction{.command = (record & 1) ? OperationType::MEM_STORE : OperationType::MEM_LOAD,
+                           .address = record >> 1};
+    }
+
+    size_t RemappedTrace::numRecords() const
+    {
+        size_t records = 0;
+        for (const std::vector<uint32_t> &proc_records : records_)
+        {
+            records += proc_records.size();
+        }
+        return records;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const RemappedTrace &trace)
+    {
+        os << "LINE REMAP" << "\n";
+        os << "RECORDS:\t" << trace.numRecords() << "\n";
+        os << "DISTINCT LINES:\t" << trace.numLines() << "\n";
+        return os;
+    }
+}
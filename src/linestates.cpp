@@ -0,0 +1,53 @@
+#include "cache.hpp"
+#include <cassert>
+
+namespace csim
+{
+    namespace
+    {
+        const uint32_t NO_RECORD = static_cast<uint32_t>(-1);
+        const size_t NO_ADDRESS = static_cast<size_t>(-1);
+    }
+
+    LineStates::LineStates(size_t num_procs) : num_procs_(num_procs), records_(NO_RECORD), last_address_(NO_ADDRESS), last_record_(NO_RECORD)
+    {
+    }
+
+    void LineStates::makeDense(size_t num_lines)
+    {
+        records_.makeDense(num_lines);
+        states_.clear();
+        last_address_ = NO_ADDRESS;
+        last_record_ = NO_RECORD;
+    }
+
+    uint32_t LineStates::findRecord(size_t address)
+    {
+        if (address != last_address_)
+        {
+            last_address_ = address;
+            last_record_ = records_.get(address);
+        }
+        return last_record_;
+    }
+
+    CoherenceState LineStates::get(size_t address, size_t proc)
+    {
+        uint32_t record = findRecord(address);
+        return record == NO_RECORD ? CoherenceState::INVALID : states_[record * num_procs_ + proc];
+    }
+
+    CoherenceState &LineStates::at(size_t address, size_t proc)
+    {
+        uint32_t record = findRecord(address);
+        if (record == NO_RECORD)
+        {
+            assert(states_.size() / num_procs_ < NO_RECORD);
+            record = static_cast<uint32_t>(states_.size() / num_procs_);
+            states_.resize(states_.size() + num_procs_, CoherenceState::INVALID);
+            records_[address] = record;
+            last_record_ = record;
+        }
+        return states_[record * num_procs_ + proc];
+    }
+}
@@ -9,9 +9,288 @@
 #include "directory.hpp"
 #include "globals.hpp"
 #include "argparser.hpp"
+#include "tracepipe.hpp"
+#include "synthetic.hpp"
+#include "tracestream.hpp"
+#include "lineremap.hpp"
+#include "hierarchy.hpp"
+#include <memory>
+#include <type_traits>
+#include <cassert>
 
 using namespace csim;
 
+namespace
+{
+    // sets derive from the cache and line size, a zero size means the level is unbounded or absent.
+    CacheGeometry makeGeometry(const std::string &name, size_t size, size_t assoc, size_t line_size, ReplacementPolicy replacement)
+    {
+        CacheGeometry geometry = CacheGeometry{.num_sets = 0, .assoc = 0, .line_size = line_size, .replacement = replacement};
+        if (size == 0)
+        {
+            return geometry;
+        }
+
+        size_t num_lines = size / line_size;
+        geometry.assoc = assoc ? assoc : num_lines;
+        if (num_lines == 0 || size % line_size != 0 || num_lines % geometry.assoc != 0)
+        {
+            std::cerr << name << "_size must be a multiple of cache_line_size * " << name << "_assoc" << std::endl;
+            exit(1);
+        }
+        geometry.num_sets = num_lines / geometry.assoc;
+        if (geometry.replacement == ReplacementPolicy::PLRU && (geometry.assoc > 64 || (geometry.assoc & (geometry.assoc - 1)) != 0))
+        {
+            std::cerr << "PLRU needs a power of two " << name << "_assoc of at most 64" << std::endl;
+            exit(1);
+        }
+        return geometry;
+    }
+
+    // What every engine is built around, set up before the protocol is known.
+    struct Simulation
+    {
+        const Config &config;
+        TraceSource *trace_source;
+        RemappedTrace *remapped;
+        const HierarchyConfig *hierarchy; // nullptr = no levels around the private caches
+        HierarchyStats *hierarchy_stats;
+        CacheGeometry geometry;
+        Stats *stats;
+    };
+
+    // Steps every cycle until the processors run out of work. With a scheduler only the
+    // components with something due in a cycle are stepped, the caches add the per cycle
+    // statistics of the cycles they sat out when next stepped and at the end.
+    template <typename Interconnect>
+    void run(CPUS<Interconnect> &cpus, Interconnect &caches, EventScheduler *events, size_t num_procs)
+    {
+        if (!events)
+        {
+            bool running = false;
+            do
+            {
+                running = cpus.cycle();
+            } while (running);
+            return;
+        }
+
+        size_t running = num_procs;
+        while (running > 0)
+        {
+            std::optional<size_t> next = events->advance();
+            assert(next);
+            cycles = *next;
+            for (size_t proc : events->take(Component::CPU))
+            {
+                if (!cpus.step(proc))
+                {
+                    running--;
+                }
+            }
+            for (size_t proc : events->take(Component::CACHE))
+            {
+                caches.step(proc);
+            }
+            if (!events->take(Component::INTERCONNECT).empty())
+            {
+                caches.stepInterconnect();
+            }
+        }
+        cycles++;
+        caches.sampleSkipped();
+    }
+
+    // A stream counts reader stalls in every cycle, so it keeps to the cycle loop.
+    bool eventDriven(const Config &config)
+    {
+        return config.scheduler == SchedulerType::EVENT && config.stream.empty();
+    }
+
+    // Builds the levels around the private caches for an engine's Policy, if asked for.
+    template <typename Policy>
+    void buildHierarchy(const Simulation &sim, std::optional<Hierarchy<Policy>> &hierarchy)
+    {
+        if (!sim.hierarchy)
+        {
+            return;
+        }
+        hierarchy.emplace(*sim.hierarchy, sim.config.num_procs, sim.hierarchy_stats);
+        if (sim.remapped)
+        {
+            hierarchy->setLineAddresses(sim.remapped->addresses());
+        }
+    }
+
+    // Runs the snooping engine instantiated for Protocol and Policy. Returns its snoop
+    // filter, if any.
+    template <typename Protocol, typename Policy>
+    std::optional<SnoopFilter> simulateSnoop(const Simulation &sim, Protocol protocol)
+    {
+        const Config &config = sim.config;
+        CPUS<SnoopCaches<Protocol, Policy>> cpus(sim.trace_source, config.num_procs, nullptr);
+        // by default every MSHR can hold a different processor request, a larger window
+        // lets hits and merged misses run ahead of a full set of MSHRs.
+        cpus.setMaxOutstanding(config.max_outstanding ? config.max_outstanding : config.mshrs);
+
+        SnoopCaches<Protocol, Policy> snoopcaches(config.num_procs, nullptr, &cpus, protocol, sim.stats, sim.geometry);
+        SnoopBus<Protocol, Policy> bus(config.num_procs, &snoopcaches, sim.stats);
+        snoopcaches.setBus(&bus);
+        cpus.setCaches(&snoopcaches);
+        std::optional<Hierarchy<Policy>> hierarchy;
+        buildHierarchy(sim, hierarchy);
+        if (hierarchy)
+        {
+            hierarchy->setCaches(&snoopcaches);
+            snoopcaches.setHierarchy(&*hierarchy);
+            bus.setHierarchy(&*hierarchy);
+        }
+        if (config.line_states)
+        {
+            snoopcaches.useLineStates();
+        }
+        if (config.snoop_filter != SnoopFilterType::NONE)
+        {
+            snoopcaches.useSnoopFilter(config.snoop_filter, config.snoop_filter_entries / config.snoop_filter_assoc, config.snoop_filter_assoc, config.cache_line_size);
+        }
+        if (sim.remapped)
+        {
+            snoopcaches.setLineAddresses(sim.remapped->addresses());
+        }
+        if (config.victim_entries > 0)
+        {
+            snoopcaches.useVictimCache(config.victim_entries);
+        }
+        if (config.wb_buffer_entries > 0)
+        {
+            snoopcaches.useWritebackBuffer(config.wb_buffer_entries);
+        }
+        if (config.mshrs > 1 || config.miss_latency > 0)
+        {
+            snoopcaches.useMSHRs(config.mshrs, config.miss_latency);
+        }
+        if (config.prefetcher != PrefetcherType::NONE)
+        {
+            snoopcaches.usePrefetcher(config.prefetcher, config.prefetch_degree, config.cache_line_size);
+        }
+        EventScheduler events(config.num_procs);
+        if (eventDriven(config))
+        {
+            cpus.useScheduler(&events);
+            snoopcaches.useScheduler(&events);
+        }
+
+        run(cpus, snoopcaches, eventDriven(config) ? &events : nullptr, config.num_procs);
+        snoopcaches.flushWritebacks();
+
+        if (snoopcaches.snoopFilter())
+        {
+            return *snoopcaches.snoopFilter();
+        }
+        return std::nullopt;
+    }
+
+    // Runs the directory engine instantiated for Protocol and Policy.
+    template <typename Protocol, typename Policy>
+    void simulateDirectory(const Simulation &sim, Protocol protocol)
+    {
+        const Config &config = sim.config;
+        CPUS<DirectoryCaches<Protocol, Policy>> cpus(sim.trace_source, config.num_procs, nullptr);
+        cpus.setMaxOutstanding(config.max_outstanding ? config.max_outstanding : config.mshrs);
+
+        DirectoryCaches<Protocol, Policy> dircaches(config.num_procs, nullptr, &cpus, protocol, sim.stats, sim.geometry);
+        SharerEncoding encoding(config.dir_encoding, config.num_procs, config.dir_pointers, config.dir_group);
+        Directory<Protocol, Policy> dir(config.num_procs, &dircaches, encoding, sim.stats, config.diropt);
+        if (config.dir_banks > 1 || config.dir_bank_cycles > 0)
+        {
+            dir.useBanks(config.dir_banks, config.dir_interleave ? config.dir_interleave : config.cache_line_size, config.cache_line_size, config.dir_bank_cycles);
+        }
+        if (config.dir_entries > 0)
+        {
+            dir.useSparse(config.dir_entries, config.dir_assoc, config.cache_line_size, config.dir_replacement);
+        }
+        if (config.hop_latency > 0)
+        {
+            dir.useHopLatency(config.hop_latency);
+        }
+        dircaches.setDirectory(&dir);
+        cpus.setCaches(&dircaches);
+        std::optional<Hierarchy<Policy>> hierarchy;
+        buildHierarchy(sim, hierarchy);
+        if (hierarchy)
+        {
+            hierarchy->setCaches(&dircaches);
+            dircaches.setHierarchy(&*hierarchy);
+            dir.setHierarchy(&*hierarchy);
+        }
+        if (sim.remapped)
+        {
+            dircaches.setLineAddresses(sim.remapped->addresses());
+            dir.setLineAddresses(sim.remapped->addresses());
+        }
+        if (config.victim_entries > 0)
+        {
+            dircaches.useVictimCache(config.victim_entries);
+        }
+        if (config.mshrs > 1 || config.miss_latency > 0)
+        {
+            dircaches.useMSHRs(config.mshrs, config.miss_latency);
+        }
+        if (config.prefetcher != PrefetcherType::NONE)
+        {
+            dircaches.usePrefetcher(config.prefetcher, config.prefetch_degree, config.cache_line_size);
+        }
+        EventScheduler events(config.num_procs);
+        if (eventDriven(config))
+        {
+            cpus.useScheduler(&events);
+            dircaches.useScheduler(&events);
+        }
+
+        run(cpus, dircaches, eventDriven(config) ? &events : nullptr, config.num_procs);
+    }
+
+    // Runs the engine of the configured coherence type for Protocol and Policy. Returns
+    // its snoop filter, if any.
+    template <typename Protocol, typename Policy>
+    std::optional<SnoopFilter> simulateEngine(const Simulation &sim, Protocol protocol)
+    {
+        // directories only run the built-in protocols.
+        if constexpr (!std::is_same_v<Protocol, SpecProtocol>)
+        {
+            if (sim.config.cohertype == CoherenceType::DIRECTORY)
+            {
+                simulateDirectory<Protocol, Policy>(sim, protocol);
+                return std::nullopt;
+            }
+        }
+        return simulateSnoop<Protocol, Policy>(sim, protocol);
+    }
+
+    // Runs the engine of Protocol that replaces lines by the configured policy, each
+    // policy is its own instantiation. Returns its snoop filter, if any.
+    template <typename Protocol>
+    std::optional<SnoopFilter> simulate(const Simulation &sim, Protocol protocol)
+    {
+        switch (sim.config.replacement)
+        {
+        case ReplacementPolicy::LRU:
+            return simulateEngine<Protocol, LRUPolicy>(sim, protocol);
+        case ReplacementPolicy::PLRU:
+            return simulateEngine<Protocol, PLRUPolicy>(sim, protocol);
+        case ReplacementPolicy::SRRIP:
+            return simulateEngine<Protocol, SRRIPPolicy>(sim, protocol);
+        case ReplacementPolicy::BRRIP:
+            return simulateEngine<Protocol, BRRIPPolicy>(sim, protocol);
+        case ReplacementPolicy::RANDOM:
+            return simulateEngine<Protocol, RandomPolicy>(sim, protocol);
+        case ReplacementPolicy::FIFO:
+            return simulateEngine<Protocol, FIFOPolicy>(sim, protocol);
+        }
+        return std::nullopt;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     (void)argc;
@@ -28,6 +307,7 @@ int main(int argc, char *argv[])
     size_t cache_line_size = config.cache_line_size;
     size_t cache_size = config.cache_size;
     bool dir_opt = config.diropt;
+    TraceFormat trace_format = config.trace_format;
 
     std::cout << "No of Processors: " << num_procs << std::endl;
     std::cout << "Directory: " << directory << std::endl;
@@ -35,39 +315,222 @@ int main(int argc, char *argv[])
     std::cout << "Coherence Protocol: " << coherproto << std::endl;
     std::cout << "Cache Line Size: " << cache_line_size << std::endl;
     std::cout << "Cache Size: " << cache_size << std::endl;
+    std::cout << "Cache Associativity: " << config.cache_assoc << std::endl;
+    std::cout << "Replacement Policy: " << config.replacement << std::endl;
     std::cout << "Directory Optimization " << ((dir_opt == true || dir_opt == 1) ? "True" : "False") << std::endl;
+    std::cout << "Trace Format: " << trace_format << std::endl;
+    std::cout << "Workload: " << config.workload << std::endl;
 
 
-    TraceReader tr(directory, num_procs, cache_line_size);
-    Stats stats(num_procs);
-    CPUS cpus(&tr, num_procs, nullptr);
-
-    if (cohertype == CoherenceType::SNOOP)
+    std::unique_ptr<TraceSource> source;
+    StreamTraceSource *stream = nullptr;
+    if (!config.stream.empty())
     {
-        SnoopCaches snoopcaches(num_procs, nullptr, &cpus, coherproto, &stats);
-        SnoopBus bus(num_procs, &snoopcaches, &stats);
-        snoopcaches.setBus(&bus);
-        cpus.setCaches(&snoopcaches);
-
-        bool running = false;
-        do
+        // the stream is consumed in simulation order, decoding it ahead on other threads
+        // would need unbounded buffering.
+        if (config.trace_threads > 0 || config.remap_lines)
         {
-            running = cpus.cycle();
-        } while (running);
+            std::cerr << "--stream does not support --trace_threads or --remap_lines" << std::endl;
+            exit(1);
+        }
+        auto stream_source = std::make_unique<StreamTraceSource>(config.stream, num_procs, cache_line_size, config.stream_depth);
+        stream = stream_source.get();
+        source = std::move(stream_source);
+    }
+    else if (config.workload != Workload::NONE)
+    {
+        source = std::make_unique<SyntheticTrace>(config.workload, num_procs, config.num_accesses, cache_line_size, config.seed);
     }
     else
     {
-        DirectoryCaches dircaches(num_procs, nullptr, &cpus, &stats);
-        Directory dir(num_procs, &dircaches, &stats, dir_opt);
-        dircaches.setDirectory(&dir);
-        cpus.setCaches(&dircaches);
+        source = std::make_unique<TraceReader>(directory, num_procs, cache_line_size, trace_format, config.trace_offset, config.trace_limit);
+    }
+
+    std::unique_ptr<TracePipeline> pipeline;
+    if (config.trace_threads > 0)
+    {
+        pipeline = std::make_unique<TracePipeline>(source.get(), num_procs, config.trace_threads, config.trace_depth, config.trace_batch);
+    }
+
+    TraceSource *trace_source = pipeline ? pipeline.get() : source.get();
+
+    std::unique_ptr<RemappedTrace> remapped;
+    if (config.remap_lines)
+    {
+        remapped = std::make_unique<RemappedTrace>(trace_source, num_procs);
+        trace_source = remapped.get();
+    }
+
+    CacheGeometry geometry = makeGeometry("cache", cache_size, config.cache_assoc, cache_line_size, config.replacement);
+    std::cout << "Cache Sets: " << geometry.num_sets << std::endl;
+
+    // private L1s and a shared LLC around the coherent caches, only built when asked for.
+    std::optional<HierarchyConfig> hierarchy;
+    HierarchyStats hierarchy_stats{};
+    if (config.l1_size > 0 || config.llc_size > 0)
+    {
+        hierarchy = HierarchyConfig{
+            .l1 = makeGeometry("l1", config.l1_size, config.l1_assoc, cache_line_size, config.replacement),
+            .llc = makeGeometry("llc", config.llc_size, config.llc_assoc, cache_line_size, config.replacement),
+            .llc_inclusion = config.llc_inclusion,
+            .l1_latency = config.l1_latency,
+            .l2_latency = config.cache_latency,
+            .llc_latency = config.llc_latency,
+            .mem_latency = config.mem_latency};
+    }
+
+    // the line-major table replaces the per-cache tables of unbounded caches, which only
+    // snooping reads across processors.
+    if (config.line_states && (cohertype != CoherenceType::SNOOP || geometry.num_sets > 0))
+    {
+        std::cerr << "--line_states needs --cohertype=snoop and --cache_size=0" << std::endl;
+        exit(1);
+    }
+
+    if (config.snoop_filter != SnoopFilterType::NONE && cohertype != CoherenceType::SNOOP)
+    {
+        std::cerr << "--snoop_filter needs --cohertype=snoop" << std::endl;
+        exit(1);
+    }
+    if (config.snoop_filter == SnoopFilterType::BOUNDED && (config.snoop_filter_assoc == 0 || config.snoop_filter_entries == 0 || config.snoop_filter_entries % config.snoop_filter_assoc != 0))
+    {
+        std::cerr << "snoop_filter_entries must be a non-zero multiple of snoop_filter_assoc" << std::endl;
+        exit(1);
+    }
+
+    if (config.victim_entries > 0 && geometry.num_sets == 0)
+    {
+        std::cerr << "--victim_entries needs --cache_size" << std::endl;
+        exit(1);
+    }
+    // directory writebacks update the owner synchronously, there is nothing to buffer.
+    if (config.wb_buffer_entries > 0 && (cohertype != CoherenceType::SNOOP || geometry.num_sets == 0))
+    {
+        std::cerr << "--wb_buffer_entries needs --cohertype=snoop and --cache_size" << std::endl;
+        exit(1);
+    }
+
+    // predicted lines are real addresses, which dense line IDs cannot name.
+    if (config.prefetcher != PrefetcherType::NONE && (config.remap_lines || config.prefetch_degree == 0))
+    {
+        std::cerr << "--prefetcher needs --prefetch_degree > 0 and does not support --remap_lines" << std::endl;
+        exit(1);
+    }
+
+    if (!config.protocol_spec.empty() && cohertype != CoherenceType::SNOOP)
+    {
+        std::cerr << "--protocol_spec needs --cohertype=snoop" << std::endl;
+        exit(1);
+    }
+
+    if (cohertype == CoherenceType::DIRECTORY && !SharerEncoding::fits(config.dir_encoding, num_procs, config.dir_pointers, config.dir_group))
+    {
+        std::cerr << "the sharers of " << num_procs << " processors do not fit a " << config.dir_encoding << " directory entry, check --dir_pointers and --dir_group" << std::endl;
+        exit(1);
+    }
+
+    if ((config.dir_banks != 1 || config.dir_bank_cycles > 0) && cohertype != CoherenceType::DIRECTORY)
+    {
+        std::cerr << "--dir_banks and --dir_bank_cycles need --cohertype=directory" << std::endl;
+        exit(1);
+    }
+    if (config.dir_banks == 0 || config.dir_interleave % config.cache_line_size != 0)
+    {
+        std::cerr << "--dir_banks must be at least 1 and --dir_interleave a multiple of cache_line_size" << std::endl;
+        exit(1);
+    }
+
+    if (config.dir_entries > 0 && (cohertype != CoherenceType::DIRECTORY || config.dir_assoc == 0 || config.dir_entries % (config.dir_assoc * config.dir_banks) != 0))
+    {
+        std::cerr << "--dir_entries needs --cohertype=directory and a multiple of --dir_assoc times --dir_banks" << std::endl;
+        exit(1);
+    }
+    if (config.dir_entries > 0 && config.dir_replacement == ReplacementPolicy::PLRU && (config.dir_assoc > 64 || (config.dir_assoc & (config.dir_assoc - 1)) != 0))
+    {
+        std::cerr << "PLRU needs a power of two dir_assoc of at most 64" << std::endl;
+        exit(1);
+    }
 
-        bool running = false;
-        do
+    if (config.hop_latency > 0 && cohertype != CoherenceType::DIRECTORY)
+    {
+        std::cerr << "--hop_latency needs --cohertype=directory" << std::endl;
+        exit(1);
+    }
+
+    if (config.mshrs == 0)
+    {
+        std::cerr << "--mshrs must be at least 1" << std::endl;
+        exit(1);
+    }
+
+    Stats stats(num_procs);
+    Simulation sim = Simulation{.config = config, .trace_source = trace_source, .remapped = remapped.get(), .hierarchy = hierarchy ? &*hierarchy : nullptr, .hierarchy_stats = &hierarchy_stats, .geometry = geometry, .stats = &stats};
+    std::optional<SnoopFilter> snoop_filter;
+    if (!config.protocol_spec.empty())
+    {
+        ProtocolTable protocol = ProtocolTable::load(config.protocol_spec);
+        std::cout << "Protocol Spec: " << protocol << std::endl;
+        snoop_filter = simulate(sim, SpecProtocol{.loaded = protocol});
+    }
+    else
+    {
+        // one snooping and one directory engine per built-in protocol and replacement
+        // policy, picked once here.
+        switch (coherproto)
         {
-            running = cpus.cycle();
-        } while (running);
+        case CoherenceProtocol::MI:
+            snoop_filter = simulate(sim, BuiltinProtocol<CoherenceProtocol::MI>());
+            break;
+        case CoherenceProtocol::MSI:
+            snoop_filter = simulate(sim, BuiltinProtocol<CoherenceProtocol::MSI>());
+            break;
+        case CoherenceProtocol::MESI:
+            snoop_filter = simulate(sim, BuiltinProtocol<CoherenceProtocol::MESI>());
+            break;
+        case CoherenceProtocol::MOESI:
+            snoop_filter = simulate(sim, BuiltinProtocol<CoherenceProtocol::MOESI>());
+            break;
+        case CoherenceProtocol::MESIF:
+            snoop_filter = simulate(sim, BuiltinProtocol<CoherenceProtocol::MESIF>());
+            break;
+        }
     }
 
     std::cout << stats << std::endl;
+    if (pipeline)
+    {
+        std::cout << *pipeline << std::endl;
+    }
+    if (stream)
+    {
+        std::cout << *stream << std::endl;
+    }
+    if (remapped)
+    {
+        std::cout << *remapped << std::endl;
+    }
+    if (snoop_filter)
+    {
+        std::cout << *snoop_filter << std::endl;
+    }
+    if (hierarchy)
+    {
+        std::cout << hierarchy_stats << std::endl;
+    }
+    if (config.victim_entries > 0 || config.wb_buffer_entries > 0)
+    {
+        std::cout << stats.bufferstats << std::endl;
+    }
+    if (config.prefetcher != PrefetcherType::NONE)
+    {
+        std::cout << stats.prefetchstats << std::endl;
+    }
+    if (config.mshrs > 1 || config.miss_latency > 0)
+    {
+        std::cout << stats.mshrstats << std::endl;
+    }
+    if (cohertype == CoherenceType::DIRECTORY)
+    {
+        std::cout << stats.dirstats << std::endl;
+    }
 }
@@ -0,0 +1,79 @@
+#include "mappedfile.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace csim
+{
+    MappedFile::MappedFile(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return;
+        }
+
+        size_ = static_cast<size_t>(st.st_size);
+        open_ = true;
+
+        // mmap of an empty file fails, an empty trace is still a valid trace.
+        if (size_ > 0)
+        {
+            void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED)
+            {
+                open_ = false;
+                size_ = 0;
+            }
+            else
+            {
+                data_ = static_cast<const char *>(addr);
+                ::madvise(addr, size_, MADV_SEQUENTIAL);
+            }
+        }
+
+        ::close(fd);
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)), open_(std::exchange(other.open_, false))
+    {
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            open_ = std::exchange(other.open_, false);
+        }
+        return *this;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        release();
+    }
+
+    void MappedFile::release()
+    {
+        if (data_)
+        {
+            ::munmap(const_cast<char *>(data_), size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+        open_ = false;
+    }
+}
@@ -0,0 +1,190 @@
+#include "prefetcher.hpp"
+#include "globals.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace csim
+{
+    namespace
+    {
+        const size_t QUEUE_ENTRIES = 16;
+        const size_t STREAM_ENTRIES = 16;
+        const size_t PAGE_SHIFT = 12;
+        // strides seen twice in a row before STRIDE prefetches.
+        const size_t STRIDE_CONFIDENCE = 1;
+        const size_t MAX_CONFIDENCE = 3;
+    }
+
+    Prefetcher::Prefetcher(PrefetcherType type, size_t degree, size_t line_size, PrefetchStats *stats)
+        : type_(type), degree_(degree), line_size_(line_size), stats_(stats)
+    {
+        assert(type_ != PrefetcherType::NONE);
+        assert(degree_ > 0);
+    }
+
+    void Prefetcher::access(size_t address, bool miss)
+    {
+        accesses_++;
+        auto it = unused_.find(address);
+        if (it != unused_.end())
+        {
+            stats_->useful++;
+            stats_->lead_cycles += cycles - it->second;
+            unused_.erase(it);
+            train(address);
+            return;
+        }
+        if (!miss)
+        {
+            return;
+        }
+
+        stats_->demand_misses++;
+        auto queued = std::find(queue_.begin(), queue_.end(), address);
+        if (queued != queue_.end())
+        {
+            // predicted, but no idle slot came in time.
+            stats_->late++;
+            queue_.erase(queued);
+        }
+        train(address);
+    }
+
+    std::optional<size_t> Prefetcher::next()
+    {
+        if (queue_.empty())
+        {
+            return std::nullopt;
+        }
+        size_t address = queue_.front();
+        queue_.pop_front();
+        return address;
+    }
+
+    void Prefetcher::filled(size_t address)
+    {
+        stats_->issued++;
+        unused_[address] = cycles;
+    }
+
+    void Prefetcher::lost(size_t address, bool invalidated)
+    {
+        if (unused_.erase(address) == 0)
+        {
+            return;
+        }
+        if (invalidated)
+        {
+            stats_->invalidated++;
+        }
+        else
+        {
+            stats_->evicted++;
+        }
+    }
+
+    void Prefetcher::train(size_t address)
+    {
+        size_t line = address / line_size_;
+        switch (type_)
+        {
+        case PrefetcherType::NONE:
+            break;
+        case PrefetcherType::NEXT_LINE:
+            for (size_t i = 1; i <= degree_; i++)
+            {
+                enqueue((line + i) * line_size_);
+            }
+            break;
+        case PrefetcherType::ADJACENT:
+            enqueue((line ^ 1) * line_size_);
+            break;
+        case PrefetcherType::STRIDE:
+        {
+            Stream &entry = stream(address >> PAGE_SHIFT);
+            long delta = static_cast<long>(line) - static_cast<long>(entry.last_line);
+            if (delta != 0 && delta == entry.stride)
+            {
+                entry.confidence = std::min(entry.confidence + 1, MAX_CONFIDENCE);
+            }
+            else if (delta != 0)
+            {
+                entry.stride = delta;
+                entry.confidence = 0;
+            }
+            entry.last_line = line;
+            if (entry.confidence < STRIDE_CONFIDENCE)
+            {
+                break;
+            }
+            for (size_t i = 1; i <= degree_; i++)
+            {
+                long target = static_cast<long>(line) + entry.stride * static_cast<long>(i);
+                if (target >= 0)
+                {
+                    enqueue(static_cast<size_t>(target) * line_size_);
+                }
+            }
+            break;
+        }
+        }
+    }
+
+    void Prefetcher::enqueue(size_t address)
+    {
+        if (unused_.count(address) || std::find(queue_.begin(), queue_.end(), address) != queue_.end())
+        {
+            return;
+        }
+        // stale predictions make room for new ones.
+        if (queue_.size() == QUEUE_ENTRIES)
+        {
+            queue_.pop_front();
+        }
+        queue_.push_back(address);
+    }
+
+    Prefetcher::Stream &Prefetcher::stream(size_t page)
+    {
+        for (Stream &entry : streams_)
+        {
+            if (entry.page == page)
+            {
+                entry.last_use = accesses_;
+                return entry;
+            }
+        }
+
+        Stream fresh = Stream{.page = page, .last_line = (page << PAGE_SHIFT) / line_size_, .stride = 0, .confidence = 0, .last_use = accesses_};
+        if (streams_.size() < STREAM_ENTRIES)
+        {
+            streams_.push_back(fresh);
+            return streams_.back();
+        }
+        // replace the least recently used page.
+        Stream &victim = *std::min_element(streams_.begin(), streams_.end(), [](const Stream &a, const Stream &b)
+                                           { return a.last_use < b.last_use; });
+        victim = fresh;
+        return victim;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const PrefetcherType &type)
+    {
+        switch (type)
+        {
+        case PrefetcherType::NONE:
+            os << "NONE";
+            break;
+        case PrefetcherType::NEXT_LINE:
+            os << "NEXT_LINE";
+            break;
+        case PrefetcherType::STRIDE:
+            os << "STRIDE";
+            break;
+        case PrefetcherType::ADJACENT:
+            os << "ADJACENT";
+            break;
+        }
+        return os;
+    }
+}
@@ -0,0 +1,87 @@
+#include "protocol.hpp"
+#include <fstream>
+#include <sstream>
+
+namespace csim
+{
+    void specError(std::string_view source, size_t line, std::string_view message, std::string_view word)
+    {
+        std::cerr << "protocol spec " << source << ":" << line << ": " << message << word << std::endl;
+        exit(1);
+    }
+
+    ProtocolTable ProtocolTable::load(const std::string &path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "cannot open protocol spec " << path << std::endl;
+            exit(1);
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+        return parse(text.str(), path);
+    }
+
+    std::ostream &operator<<(std::ostream &os, const ProtocolTable &protocol)
+    {
+        os << protocol.name() << " (";
+        for (CoherenceState state : {CoherenceState::MODIFIED, CoherenceState::OWNED, CoherenceState::EXCLUSIVE, CoherenceState::SHARED, CoherenceState::INVALID, CoherenceState::FORWARDER})
+        {
+            if (protocol.has(state))
+            {
+                os << state;
+            }
+        }
+        os << ")";
+        return os;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const CoherenceState &state)
+    {
+        switch (state)
+        {
+        case CoherenceState::MODIFIED:
+            os << "M";
+            break;
+        case CoherenceState::INVALID:
+            os << "I";
+            break;
+        case CoherenceState::SHARED:
+            os << "S";
+            break;
+        case CoherenceState::EXCLUSIVE:
+            os << "E";
+            break;
+        case CoherenceState::OWNED:
+            os << "O";
+            break;
+        case CoherenceState::FORWARDER:
+            os << "F";
+            break;
+        }
+        return os;
+    }
+    std::ostream &operator<<(std::ostream &os, const CoherenceProtocol &protocol)
+    {
+        switch (protocol)
+        {
+        case CoherenceProtocol::MI:
+            os << "MI";
+            break;
+        case CoherenceProtocol::MSI:
+            os << "MSI";
+            break;
+        case CoherenceProtocol::MESI:
+            os << "MESI";
+            break;
+        case CoherenceProtocol::MOESI:
+            os << "MOESI";
+            break;
+        case CoherenceProtocol::MESIF:
+            os << "MESIF";
+            break;
+        }
+        return os;
+    }
+}
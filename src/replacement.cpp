@@ -0,0 +1,30 @@
+#include "replacement.hpp"
+
+namespace csim
+{
+    std::ostream &operator<<(std::ostream &os, const ReplacementPolicy &policy)
+    {
+        switch (policy)
+        {
+        case ReplacementPolicy::LRU:
+            os << "LRU";
+            break;
+        case ReplacementPolicy::PLRU:
+            os << "PLRU";
+            break;
+        case ReplacementPolicy::SRRIP:
+            os << "SRRIP";
+            break;
+        case ReplacementPolicy::BRRIP:
+            os << "BRRIP";
+            break;
+        case ReplacementPolicy::RANDOM:
+            os << "RANDOM";
+            break;
+        case ReplacementPolicy::FIFO:
+            os << "FIFO";
+            break;
+        }
+        return os;
+    }
+}
@@ -0,0 +1,145 @@
+#include "scheduler.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace csim
+{
+    TimingWheel::TimingWheel(size_t num_slots) : slots_(num_slots), mask_(num_slots - 1)
+    {
+        assert(num_slots > 0 && (num_slots & mask_) == 0);
+    }
+
+    void TimingWheel::schedule(size_t cycle, size_t id)
+    {
+        assert(cycle >= now_);
+        if (cycle - now_ < slots_.size())
+        {
+            slots_[cycle & mask_].push_back(id);
+            count_++;
+        }
+        else
+        {
+            later_.emplace(cycle, id);
+        }
+    }
+
+    std::optional<size_t> TimingWheel::next()
+    {
+        if (count_ == 0)
+        {
+            if (later_.empty())
+            {
+                return std::nullopt;
+            }
+            // every slot is empty, the wheel jumps straight to the heap's first event.
+            now_ = later_.top().first;
+            refill();
+        }
+        while (slots_[now_ & mask_].empty())
+        {
+            now_++;
+            refill();
+        }
+        return now_;
+    }
+
+    void TimingWheel::take(std::vector<size_t> &ids)
+    {
+        std::vector<size_t> &slot = slots_[now_ & mask_];
+        ids.insert(ids.end(), slot.begin(), slot.end());
+        count_ -= slot.size();
+        slot.clear();
+    }
+
+    // Moves the events the wheel now covers out of the heap.
+    void TimingWheel::refill()
+    {
+        while (!later_.empty() && later_.top().first < now_ + slots_.size())
+        {
+            auto [cycle, id] = later_.top();
+            later_.pop();
+            schedule(cycle, id);
+        }
+    }
+
+    EventScheduler::EventScheduler(size_t num_procs) : num_procs_(num_procs), due_(NUM_KINDS * num_procs, NONE)
+    {
+    }
+
+    void EventScheduler::wake(Component component, size_t proc, size_t cycle)
+    {
+        size_t kind = static_cast<size_t>(component);
+        assert(!started_ || cycle >= now_);
+        if (started_ && cycle == now_ && kind < taken_)
+        {
+            cycle++;
+        }
+        size_t id = kind * num_procs_ + proc;
+        if (due_[id] <= cycle)
+        {
+            return;
+        }
+        due_[id] = cycle;
+        if (started_ && cycle == now_)
+        {
+            current_[kind].push_back(proc);
+        }
+        else
+        {
+            wheel_.schedule(cycle, id);
+        }
+    }
+
+    std::optional<size_t> EventScheduler::advance()
+    {
+        std::optional<size_t> cycle = wheel_.next();
+        if (!cycle)
+        {
+            return std::nullopt;
+        }
+        started_ = true;
+        now_ = *cycle;
+        taken_ = 0;
+        ids_.clear();
+        wheel_.take(ids_);
+        for (size_t id : ids_)
+        {
+            // a component woken earlier since left a stale event behind.
+            if (due_[id] == now_)
+            {
+                current_[id / num_procs_].push_back(id % num_procs_);
+            }
+        }
+        return now_;
+    }
+
+    const std::vector<size_t> &EventScheduler::take(Component component)
+    {
+        size_t kind = static_cast<size_t>(component);
+        assert(kind == taken_);
+        taken_++;
+        stepping_.swap(current_[kind]);
+        current_[kind].clear();
+        std::sort(stepping_.begin(), stepping_.end());
+        stepping_.erase(std::unique(stepping_.begin(), stepping_.end()), stepping_.end());
+        for (size_t proc : stepping_)
+        {
+            due_[kind * num_procs_ + proc] = NONE;
+        }
+        return stepping_;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const SchedulerType &type)
+    {
+        switch (type)
+        {
+        case SchedulerType::CYCLE:
+            os << "CYCLE";
+            break;
+        case SchedulerType::EVENT:
+            os << "EVENT";
+            break;
+        }
+        return os;
+    }
+}
@@ -0,0 +1,253 @@
+#include "sharers.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace csim
+{
+    namespace
+    {
+        // bits to tell num_procs processors apart.
+        size_t pointerBits(size_t num_procs)
+        {
+            size_t bits = 1;
+            while ((1ULL << bits) < num_procs)
+            {
+                bits++;
+            }
+            return bits;
+        }
+    }
+
+    SharerEncoding::SharerEncoding(DirEncoding type, size_t num_procs, size_t pointers, size_t group)
+        : type_(type), num_procs_(num_procs), pointers_(pointers), pointer_bits_(pointerBits(num_procs)), group_(type == DirEncoding::COARSE ? group : 1),
+          words_(type == DirEncoding::FULL && num_procs > 64 ? (num_procs + 63) / 64 : 0)
+    {
+        assert(fits(type, num_procs, pointers, group));
+    }
+
+    bool SharerEncoding::fits(DirEncoding type, size_t num_procs, size_t pointers, size_t group)
+    {
+        switch (type)
+        {
+        case DirEncoding::FULL:
+            return true;
+        case DirEncoding::LIMITED_B:
+        case DirEncoding::LIMITED_NB:
+            return pointers > 0 && pointers < (1ULL << COUNT_BITS) && POINTERS_SHIFT + pointers * pointerBits(num_procs) <= 64;
+        case DirEncoding::COARSE:
+            return group > 0 && (num_procs + group - 1) / group <= 64;
+        }
+        return false;
+    }
+
+    bool SharerEncoding::contains(uint64_t sharers, size_t proc) const
+    {
+        switch (type_)
+        {
+        case DirEncoding::FULL:
+            if (words_ > 0)
+            {
+                return sharers && (pool_[set(sharers) + proc / 64] & (1ULL << (proc % 64)));
+            }
+            [[fallthrough]];
+        case DirEncoding::COARSE:
+            return sharers & (1ULL << (proc / group_));
+        case DirEncoding::LIMITED_B:
+        case DirEncoding::LIMITED_NB:
+            if (overflowed(sharers))
+            {
+                return true;
+            }
+            for (size_t i = 0; i < count(sharers); i++)
+            {
+                if (pointer(sharers, i) == proc)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        return false;
+    }
+
+    bool SharerEncoding::overflowed(uint64_t sharers) const
+    {
+        return type_ == DirEncoding::LIMITED_B && (sharers & (1ULL << OVERFLOW_BIT));
+    }
+
+    std::optional<size_t> SharerEncoding::add(uint64_t &sharers, size_t proc)
+    {
+        assert(proc < num_procs_);
+        if (words_ > 0)
+        {
+            if (!sharers)
+            {
+                // the first sharer takes a set from the pool.
+                if (free_.empty())
+                {
+                    free_.push_back(pool_.size() / words_);
+                    pool_.resize(pool_.size() + words_, 0);
+                }
+                sharers = free_.back() + 1;
+                free_.pop_back();
+            }
+            pool_[set(sharers) + proc / 64] |= 1ULL << (proc % 64);
+            return std::nullopt;
+        }
+        if (type_ == DirEncoding::FULL || type_ == DirEncoding::COARSE)
+        {
+            sharers |= 1ULL << (proc / group_);
+            return std::nullopt;
+        }
+        if (contains(sharers, proc))
+        {
+            return std::nullopt;
+        }
+
+        size_t used = count(sharers);
+        if (used < pointers_)
+        {
+            setPointer(sharers, used, proc);
+            sharers += 1;
+            return std::nullopt;
+        }
+        if (type_ == DirEncoding::LIMITED_B)
+        {
+            sharers |= 1ULL << OVERFLOW_BIT;
+            return std::nullopt;
+        }
+
+        // the oldest sharer gives up its pointer.
+        size_t victim = pointer(sharers, 0);
+        for (size_t i = 0; i + 1 < used; i++)
+        {
+            setPointer(sharers, i, pointer(sharers, i + 1));
+        }
+        setPointer(sharers, used - 1, proc);
+        return victim;
+    }
+
+    void SharerEncoding::remove(uint64_t &sharers, size_t proc)
+    {
+        switch (type_)
+        {
+        case DirEncoding::FULL:
+            if (words_ > 0)
+            {
+                if (!sharers)
+                {
+                    break;
+                }
+                pool_[set(sharers) + proc / 64] &= ~(1ULL << (proc % 64));
+                for (size_t i = 0; i < words_; i++)
+                {
+                    if (pool_[set(sharers) + i])
+                    {
+                        return;
+                    }
+                }
+                clear(sharers);
+                break;
+            }
+            sharers &= ~(1ULL << proc);
+            break;
+        case DirEncoding::COARSE:
+            // the rest of the group may still share the line.
+            break;
+        case DirEncoding::LIMITED_B:
+        case DirEncoding::LIMITED_NB:
+        {
+            if (overflowed(sharers))
+            {
+                break;
+            }
+            // the last pointer fills the gap, free pointers stay zero.
+            size_t used = count(sharers);
+            for (size_t i = 0; i < used; i++)
+            {
+                if (pointer(sharers, i) == proc)
+                {
+                    setPointer(sharers, i, pointer(sharers, used - 1));
+                    setPointer(sharers, used - 1, 0);
+                    sharers -= 1;
+                    break;
+                }
+            }
+            break;
+        }
+        }
+    }
+
+    std::pair<size_t, size_t> SharerEncoding::aliases(uint64_t sharers, size_t proc) const
+    {
+        if (type_ == DirEncoding::COARSE)
+        {
+            size_t first = proc / group_ * group_;
+            return {first, std::min(first + group_, num_procs_)};
+        }
+        if (overflowed(sharers))
+        {
+            return {0, num_procs_};
+        }
+        return {proc, proc};
+    }
+
+    void SharerEncoding::drop(uint64_t &sharers, size_t proc)
+    {
+        if (type_ == DirEncoding::COARSE)
+        {
+            sharers &= ~(1ULL << (proc / group_));
+        }
+        else if (overflowed(sharers))
+        {
+            // no processor holds a copy, the pointers and the overflow bit go together.
+            sharers = 0;
+        }
+        else
+        {
+            remove(sharers, proc);
+        }
+    }
+
+    void SharerEncoding::clear(uint64_t &sharers)
+    {
+        if (words_ > 0 && sharers)
+        {
+            std::fill_n(pool_.begin() + set(sharers), words_, 0);
+            free_.push_back(sharers - 1);
+        }
+        sharers = 0;
+    }
+
+    size_t SharerEncoding::pointer(uint64_t sharers, size_t i) const
+    {
+        return (sharers >> (POINTERS_SHIFT + i * pointer_bits_)) & ((1ULL << pointer_bits_) - 1);
+    }
+
+    void SharerEncoding::setPointer(uint64_t &sharers, size_t i, size_t proc) const
+    {
+        size_t shift = POINTERS_SHIFT + i * pointer_bits_;
+        sharers &= ~(((1ULL << pointer_bits_) - 1) << shift);
+        sharers |= static_cast<uint64_t>(proc) << shift;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const DirEncoding &encoding)
+    {
+        switch (encoding)
+        {
+        case DirEncoding::FULL:
+            os << "FULL";
+            break;
+        case DirEncoding::LIMITED_B:
+            os << "LIMITED_B";
+            break;
+        case DirEncoding::LIMITED_NB:
+            os << "LIMITED_NB";
+            break;
+        case DirEncoding::COARSE:
+            os << "COARSE";
+            break;
+        }
+        return os;
+    }
+}
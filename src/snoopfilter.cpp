@@ -0,0 +1,196 @@
+#include "snoopfilter.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace csim
+{
+    namespace
+    {
+        const size_t NO_ENTRY = static_cast<size_t>(-1);
+        const uint32_t NO_EXACT_ENTRY = static_cast<uint32_t>(-1);
+        const size_t NO_ADDRESS = static_cast<size_t>(-1);
+    }
+
+    SnoopFilter::SnoopFilter(SnoopFilterType type, size_t num_procs, size_t num_sets, size_t assoc, size_t line_size)
+        : type_(type), num_procs_(num_procs), num_words_((num_procs + 63) / 64), num_sets_(num_sets), assoc_(assoc), line_size_(line_size),
+          entries_(NO_EXACT_ENTRY), policy_(type == SnoopFilterType::BOUNDED ? num_sets : 0, type == SnoopFilterType::BOUNDED ? assoc : 0)
+    {
+        assert(type_ != SnoopFilterType::NONE);
+        if (type_ == SnoopFilterType::BOUNDED)
+        {
+            assert(num_sets_ > 0 && assoc_ > 0);
+            tags_ = std::vector<size_t>(num_sets_ * assoc_, NO_ADDRESS);
+            presence_ = std::vector<uint64_t>(num_sets_ * assoc_ * num_words_, 0);
+        }
+    }
+
+    size_t SnoopFilter::find(size_t address) const
+    {
+        if (type_ == SnoopFilterType::EXACT)
+        {
+            uint32_t entry = entries_.get(address);
+            return entry == NO_EXACT_ENTRY ? NO_ENTRY : entry;
+        }
+
+        size_t line = line_addresses_ ? (*line_addresses_)[address] : address;
+        size_t base = (line / line_size_) % num_sets_ * assoc_;
+        for (size_t entry = base; entry < base + assoc_; entry++)
+        {
+            if (tags_[entry] == address)
+            {
+                return entry;
+            }
+        }
+        return NO_ENTRY;
+    }
+
+    bool SnoopFilter::empty(size_t entry) const
+    {
+        for (size_t word = 0; word < num_words_; word++)
+        {
+            if (presence_[entry * num_words_ + word] != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool SnoopFilter::holds(size_t address, size_t proc) const
+    {
+        size_t entry = find(address);
+        return entry != NO_ENTRY && (presence_[entry * num_words_ + proc / 64] >> (proc % 64) & 1);
+    }
+
+    bool SnoopFilter::heldByOther(size_t address, size_t except_proc) const
+    {
+        size_t entry = find(address);
+        if (entry == NO_ENTRY)
+        {
+            return false;
+        }
+        for (size_t word = 0; word < num_words_; word++)
+        {
+            uint64_t bits = presence_[entry * num_words_ + word];
+            if (except_proc / 64 == word)
+            {
+                bits &= ~(uint64_t(1) << (except_proc % 64));
+            }
+            if (bits != 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool SnoopFilter::deliver(size_t address, size_t proc)
+    {
+        if (holds(address, proc))
+        {
+            delivered_++;
+            return true;
+        }
+        filtered_++;
+        return false;
+    }
+
+    std::optional<size_t> SnoopFilter::add(size_t address, size_t proc)
+    {
+        assert(proc < num_procs_);
+        std::optional<size_t> victim;
+        size_t entry = find(address);
+        if (entry == NO_ENTRY && type_ == SnoopFilterType::EXACT)
+        {
+            entry = presence_.size() / num_words_;
+            assert(entry < NO_EXACT_ENTRY);
+            entries_[address] = static_cast<uint32_t>(entry);
+            presence_.resize(presence_.size() + num_words_, 0);
+        }
+        else if (entry == NO_ENTRY)
+        {
+            // take a free entry, otherwise drop the least recently added line.
+            size_t line = line_addresses_ ? (*line_addresses_)[address] : address;
+            size_t set = (line / line_size_) % num_sets_;
+            size_t way = NO_ENTRY;
+            for (size_t w = 0; w < assoc_; w++)
+            {
+                if (tags_[set * assoc_ + w] == NO_ADDRESS)
+                {
+                    way = w;
+                    break;
+                }
+            }
+            if (way == NO_ENTRY)
+            {
+                way = policy_.victim(set);
+                victim = tags_[set * assoc_ + way];
+            }
+            entry = set * assoc_ + way;
+            tags_[entry] = address;
+            std::fill_n(presence_.begin() + entry * num_words_, num_words_, 0);
+            policy_.onFill(set, way);
+        }
+        else if (type_ == SnoopFilterType::BOUNDED)
+        {
+            policy_.onHit(entry / assoc_, entry % assoc_);
+        }
+
+        presence_[entry * num_words_ + proc / 64] |= uint64_t(1) << (proc % 64);
+        return victim;
+    }
+
+    void SnoopFilter::remove(size_t address, size_t proc)
+    {
+        size_t entry = find(address);
+        if (entry == NO_ENTRY)
+        {
+            return;
+        }
+        presence_[entry * num_words_ + proc / 64] &= ~(uint64_t(1) << (proc % 64));
+        if (type_ == SnoopFilterType::BOUNDED && empty(entry))
+        {
+            tags_[entry] = NO_ADDRESS;
+        }
+    }
+
+    void SnoopFilter::setLineAddresses(const std::vector<size_t> *addresses)
+    {
+        if (type_ == SnoopFilterType::EXACT)
+        {
+            entries_.makeDense(addresses->size());
+            presence_.clear();
+        }
+        else
+        {
+            line_addresses_ = addresses;
+        }
+    }
+
+    std::ostream &operator<<(std::ostream &os, const SnoopFilterType &type)
+    {
+        switch (type)
+        {
+        case SnoopFilterType::NONE:
+            os << "NONE";
+            break;
+        case SnoopFilterType::EXACT:
+            os << "EXACT";
+            break;
+        case SnoopFilterType::BOUNDED:
+            os << "BOUNDED";
+            break;
+        }
+        return os;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const SnoopFilter &filter)
+    {
+        os << "SNOOP FILTER" << "\n";
+        os << "TYPE:\t" << filter.type() << "\n";
+        os << "SNOOPS DELIVERED:\t" << filter.delivered() << "\n";
+        os << "SNOOPS FILTERED:\t" << filter.filtered() << "\n";
+        os << "BACK INVALIDATIONS:\t" << filter.backInvalidations() << "\n";
+        return os;
+    }
+}
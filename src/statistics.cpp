@@ -1,4 +1,7 @@
 #include "statistics.hpp"
+#include "globals.hpp"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 namespace csim
@@ -12,21 +15,29 @@ namespace csim
             os << "HITS:\t\t" << cachestat.hits << "\n";
             os << "MISSES:\t\t" << cachestat.misses << "\n";
             os << "COHERENCE:\t" << cachestat.evictions << "\n";
+            os << "CAPACITY:\t" << cachestat.capacity_evictions << "\n";
+            os << "WRITEBACKS:\t" << cachestat.writebacks << "\n";
             os << "----------------------------------\n";
         }
 
         size_t hits = 0;
         size_t misses = 0;
         size_t evictions = 0;
+        size_t capacity_evictions = 0;
+        size_t writebacks = 0;
         for(size_t proc = 0; proc < stats.num_procs_; proc++) {
             hits += stats.cachestats[proc].hits;
             misses += stats.cachestats[proc].misses;
             evictions += stats.cachestats[proc].evictions;
+            capacity_evictions += stats.cachestats[proc].capacity_evictions;
+            writebacks += stats.cachestats[proc].writebacks;
         }
 
         os << "TOTAL HITS: \t" << hits << "\n";
         os << "TOTAL MISSES: \t" << misses << "\n";
-        os << "TOTAL EVICTIONS: \t" << evictions << "\n\n";
+        os << "TOTAL EVICTIONS: \t" << evictions << "\n";
+        os << "TOTAL CAPACITY EVICTIONS: \t" << capacity_evictions << "\n";
+        os << "TOTAL WRITEBACKS: \t" << writebacks << "\n\n";
 
         os << "INTERCONNECT" << "\n";
         os << "TRAFFIC:\t" << stats.interconstats.traffic << "\n";
@@ -39,9 +50,93 @@ namespace csim
     Stats::Stats(size_t num_procs) : num_procs_(num_procs)
     {
         cachestats = std::vector<CacheStats>(num_procs, CacheStats{
-                                                            .evictions = 0,
                                                             .hits = 0,
-                                                            .misses = 0});
+                                                            .misses = 0,
+                                                            .evictions = 0,
+                                                            .capacity_evictions = 0,
+                                                            .writebacks = 0});
         interconstats = InterconnectStats{.traffic = 0};
+        bufferstats = BufferStats{.victim_hits = 0, .wb_snoop_hits = 0, .wb_forced_flushes = 0, .wb_drained = 0};
+        prefetchstats = PrefetchStats{.issued = 0, .useful = 0, .late = 0, .evicted = 0, .invalidated = 0, .demand_misses = 0, .lead_cycles = 0};
+        mshrstats = MSHRStats{.merges = 0, .full_stalls = 0, .occupancy = 0, .samples = 0, .max_occupancy = 0};
+        dirstats = DirectoryStats{.invalidations = 0, .extra_invalidations = 0, .pointer_overflows = 0, .sharer_queries = 0, .peak_entries = 0, .entry_evictions = 0, .recall_invalidations = 0, .recall_misses = 0, .requests = 0, .forwards = 0, .hops = 0, .banks = {}};
+    }
+
+    std::ostream &operator<<(std::ostream &os, const BufferStats &stats)
+    {
+        os << "BUFFERS" << "\n";
+        os << "VICTIM HITS:\t" << stats.victim_hits << "\n";
+        os << "WRITEBACK BUFFER SNOOP HITS:\t" << stats.wb_snoop_hits << "\n";
+        os << "WRITEBACK BUFFER FORCED FLUSHES:\t" << stats.wb_forced_flushes << "\n";
+        os << "WRITEBACK BUFFER DRAINED:\t" << stats.wb_drained << "\n";
+        return os;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const PrefetchStats &stats)
+    {
+        os << "PREFETCH" << "\n";
+        os << "ISSUED:\t" << stats.issued << "\n";
+        os << "USEFUL:\t" << stats.useful << "\n";
+        os << "LATE:\t" << stats.late << "\n";
+        os << "EVICTED UNUSED:\t" << stats.evicted << "\n";
+        os << "INVALIDATED UNUSED:\t" << stats.invalidated << "\n";
+        os << "ACCURACY:\t" << (stats.issued ? (double)stats.useful / stats.issued : 0.0) << "\n";
+        os << "COVERAGE:\t" << (stats.useful + stats.demand_misses ? (double)stats.useful / (stats.useful + stats.demand_misses) : 0.0) << "\n";
+        os << "AVERAGE LEAD CYCLES:\t" << (stats.useful ? (double)stats.lead_cycles / stats.useful : 0.0) << "\n";
+        return os;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const MSHRStats &stats)
+    {
+        os << "MSHR" << "\n";
+        os << "MERGED MISSES:\t" << stats.merges << "\n";
+        os << "FULL STALLS:\t" << stats.full_stalls << "\n";
+        os << "AVERAGE OCCUPANCY:\t" << (stats.samples ? (double)stats.occupancy / stats.samples : 0.0) << "\n";
+        os << "MAX OCCUPANCY:\t" << stats.max_occupancy << "\n";
+        os << "CYCLES:\t" << cycles << "\n";
+        return os;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const DirectoryStats &stats)
+    {
+        os << "DIRECTORY" << "\n";
+        os << "INVALIDATIONS:\t" << stats.invalidations << "\n";
+        os << "EXTRA INVALIDATIONS:\t" << stats.extra_invalidations << "\n";
+        os << "POINTER OVERFLOWS:\t" << stats.pointer_overflows << "\n";
+        os << "SHARER QUERIES:\t" << stats.sharer_queries << "\n";
+        os << "PEAK ENTRIES:\t" << stats.peak_entries << "\n";
+        os << "ENTRY EVICTIONS:\t" << stats.entry_evictions << "\n";
+        os << "RECALL INVALIDATIONS:\t" << stats.recall_invalidations << "\n";
+        os << "RECALL MISSES:\t" << stats.recall_misses << "\n";
+        os << "FORWARDED REQUESTS:\t" << stats.forwards << "\n";
+        os << "AVERAGE HOPS:\t" << (stats.requests ? (double)stats.hops / stats.requests : 0.0) << "\n";
+        if (stats.banks.size() < 2 && (stats.banks.empty() || stats.banks[0].max_queue == 0))
+        {
+            return os;
+        }
+
+        // the busiest bank bounds the directory's throughput.
+        size_t total = 0;
+        size_t busiest = 0;
+        for (size_t i = 0; i < stats.banks.size(); i++)
+        {
+            const DirBankStats &bank = stats.banks[i];
+            os << "BANK " << i << "\n";
+            os << "REQUESTS:\t" << bank.requests << "\n";
+            os << "QUEUE CYCLES:\t" << bank.queue_cycles << "\n";
+            os << "MAX QUEUE:\t" << bank.max_queue << "\n";
+            os << "PEAK ENTRIES:\t" << bank.peak_entries << "\n";
+            total += bank.requests;
+            busiest = std::max(busiest, bank.requests);
+        }
+        double mean = (double)total / stats.banks.size();
+        double variance = 0;
+        for (const DirBankStats &bank : stats.banks)
+        {
+            variance += (bank.requests - mean) * (bank.requests - mean) / stats.banks.size();
+        }
+        os << "LOAD IMBALANCE:\t" << (mean > 0 ? busiest / mean : 0.0) << "\n";
+        os << "REQUEST CV:\t" << (mean > 0 ? std::sqrt(variance) / mean : 0.0) << "\n";
+        return os;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,187 @@
+#include "synthetic.hpp"
+#include <algorithm>
+
+namespace csim
+{
+    SyntheticTrace::SyntheticTrace(Workload workload, size_t num_procs, size_t num_accesses, size_t cache_line_size, uint64_t seed) : workload_(workload), num_procs_(num_procs), num_accesses_(num_accesses), cache_line_size_(cache_line_size)
+    {
+        procs_ = std::vector<ProcState>(num_procs_);
+        for (size_t proc = 0; proc < num_procs_; proc++)
+        {
+            std::seed_seq seq{seed, static_cast<uint64_t>(proc)};
+            procs_[proc].rng.seed(seq);
+        }
+
+        size_t line = cache_line_size_;
+        for (size_t proc = 0; proc < num_procs_; proc++)
+        {
+            std::vector<size_t> &pool = procs_[proc].pool;
+            switch (workload_)
+            {
+            case Workload::NO_SHARING:
+                for (size_t i = 0; i < 10; i++)
+                {
+                    pool.push_back(proc * 1000 + i * line);
+                }
+                break;
+            case Workload::PRODUCER_CONSUMER:
+                for (size_t i = 0; i < 10; i++)
+                {
+                    pool.push_back(100 + i * line);
+                }
+                break;
+            case Workload::MULTIPLE_WRITERS:
+                for (size_t i = 0; i < 3; i++)
+                {
+                    pool.push_back(150 + i * 4);
+                }
+                break;
+            case Workload::MULTIPLE_READERS:
+                for (size_t i = 0; i < 5; i++)
+                {
+                    pool.push_back(200 + i * line);
+                }
+                break;
+            case Workload::PARTIAL_PROC_USE:
+                for (size_t i = 0; i < 5; i++)
+                {
+                    pool.push_back(1000 + i * line);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (workload_ == Workload::PARTIAL_PROC_USE)
+        {
+            // a quarter of the processors (at least one) run, the rest have empty traces.
+            size_t active = std::max<size_t>(1, num_procs_ / 4);
+            std::vector<size_t> order(num_procs_);
+            for (size_t proc = 0; proc < num_procs_; proc++)
+            {
+                order[proc] = proc;
+            }
+            std::mt19937_64 rng(seed);
+            std::shuffle(order.begin(), order.end(), rng);
+            for (size_t i = 0; i < num_procs_; i++)
+            {
+                procs_[order[i]].active = i < active;
+            }
+        }
+    }
+
+    bool SyntheticTrace::chance(ProcState &state, double probability)
+    {
+        return std::uniform_real_distribution<double>(0.0, 1.0)(state.rng) < probability;
+    }
+
+    size_t SyntheticTrace::pick(ProcState &state, const std::vector<size_t> &addresses)
+    {
+        return addresses[std::uniform_int_distribution<size_t>(0, addresses.size() - 1)(state.rng)];
+    }
+
+    bool SyntheticTrace::reuse(ProcState &state, double probability)
+    {
+        return !state.recent.empty() && chance(state, probability);
+    }
+
+    void SyntheticTrace::remember(ProcState &state, size_t window, size_t address)
+    {
+        if (state.recent.size() >= window)
+        {
+            state.recent.erase(state.recent.begin());
+        }
+        state.recent.push_back(address);
+    }
+
+    std::optional<Instruction> SyntheticTrace::readNextLine(size_t proc)
+    {
+        ProcState &state = procs_[proc];
+        if (!state.active || state.issued == num_accesses_)
+        {
+            return std::nullopt;
+        }
+
+        size_t i = state.issued++;
+        Instruction ins;
+
+        switch (workload_)
+        {
+        case Workload::FALSE_SHARING:
+            ins.address = reuse(state, 0.7) ? pick(state, state.recent) : proc * 8;
+            ins.command = (i % 2 == 0) ? OperationType::MEM_LOAD : OperationType::MEM_STORE;
+            remember(state, 3, ins.address);
+            break;
+        case Workload::NO_SHARING:
+            ins.address = reuse(state, 0.7) ? pick(state, state.recent) : pick(state, state.pool);
+            ins.command = (i % 3 != 1) ? OperationType::MEM_LOAD : OperationType::MEM_STORE;
+            remember(state, 3, ins.address);
+            break;
+        case Workload::PRODUCER_CONSUMER:
+            // processor 0 produces, everyone else consumes.
+            ins.address = reuse(state, proc == 0 ? 0.6 : 0.7) ? pick(state, state.recent) : state.pool[i % state.pool.size()];
+            ins.command = (proc == 0) ? OperationType::MEM_STORE : OperationType::MEM_LOAD;
+            remember(state, 3, ins.address);
+            break;
+        case Workload::MULTIPLE_WRITERS:
+            ins.address = reuse(state, 0.8) ? pick(state, state.recent) : pick(state, state.pool);
+            ins.command = (i % 2 == 0) ? OperationType::MEM_LOAD : OperationType::MEM_STORE;
+            remember(state, 3, ins.address);
+            break;
+        case Workload::MULTIPLE_READERS:
+            ins.address = reuse(state, 0.75) ? pick(state, state.recent) : pick(state, state.pool);
+            ins.command = OperationType::MEM_LOAD;
+            remember(state, 3, ins.address);
+            break;
+        case Workload::RANDOM:
+            // any word aligned address below 512
+            ins.address = reuse(state, 0.65) ? pick(state, state.recent) : std::uniform_int_distribution<size_t>(0, 127)(state.rng) * 4;
+            ins.command = chance(state, 0.5) ? OperationType::MEM_LOAD : OperationType::MEM_STORE;
+            remember(state, 5, ins.address);
+            break;
+        case Workload::PARTIAL_PROC_USE:
+            ins.address = reuse(state, 0.7) ? pick(state, state.recent) : pick(state, state.pool);
+            ins.command = (i % 2 == 0) ? OperationType::MEM_LOAD : OperationType::MEM_STORE;
+            remember(state, 3, ins.address);
+            break;
+        case Workload::NONE:
+            return std::nullopt;
+        }
+
+        ins.address &= ~(cache_line_size_ - 1);
+        return ins;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const Workload &workload)
+    {
+        switch (workload)
+        {
+        case Workload::NONE:
+            os << "NONE";
+            break;
+        case Workload::FALSE_SHARING:
+            os << "FALSE_SHARING";
+            break;
+        case Workload::NO_SHARING:
+            os << "NO_SHARING";
+            break;
+        case Workload::PRODUCER_CONSUMER:
+            os << "PRODUCER_CONSUMER";
+            break;
+        case Workload::MULTIPLE_READERS:
+            os << "MULTIPLE_READERS";
+            break;
+        case Workload::MULTIPLE_WRITERS:
+            os << "MULTIPLE_WRITERS";
+            break;
+        case Workload::RANDOM:
+            os << "RANDOM";
+            break;
+        case Workload::PARTIAL_PROC_USE:
+            os << "PARTIAL_PROC_USE";
+            break;
+        }
+        return os;
+    }
+}
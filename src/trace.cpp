@@ -1,8 +1,13 @@
 #include "trace.hpp"
+#include "tracecodec.hpp"
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <bit>
+#include <charconv>
+#include <algorithm>
 
 namespace csim
 {
@@ -11,7 +16,159 @@ namespace csim
         return this->address == other.address && this->command == other.command;
     }
 
+    static_assert(std::endian::native == std::endian::little, "binary traces are stored little-endian");
+
+    void encodeBinaryRecord(char *out, const Instruction &ins)
+    {
+        out[0] = (ins.command == OperationType::MEM_STORE) ? 1 : 0;
+        uint64_t address = ins.address;
+        std::memcpy(out + 1, &address, sizeof(address));
+    }
+
+    const char *parseTraceLine(const char *first, const char *last, Instruction &ins)
+    {
+        const char *p = first;
+        while (p < last && (*p == ' ' || *p == '\t'))
+        {
+            p++;
+        }
+        if (p == last)
+        {
+            return nullptr;
+        }
+
+        if (*p == 'L')
+        {
+            ins.command = OperationType::MEM_LOAD;
+        }
+        else if (*p == 'S')
+        {
+            ins.command = OperationType::MEM_STORE;
+        }
+        else
+        {
+            return nullptr;
+        }
+        p++;
+
+        if (p == last || (*p != ' ' && *p != '\t'))
+        {
+            return nullptr;
+        }
+        while (p < last && (*p == ' ' || *p == '\t'))
+        {
+            p++;
+        }
+
+        // addresses are unsigned 64-bit, either decimal or 0x prefixed hex.
+        int base = 10;
+        if (last - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        {
+            base = 16;
+            p += 2;
+        }
+
+        uint64_t address;
+        std::from_chars_result res = std::from_chars(p, last, address, base);
+        if (res.ec != std::errc())
+        {
+            return nullptr;
+        }
+        ins.address = address;
+        p = res.ptr;
+
+        // only trailing whitespace may follow the address.
+        while (p < last && *p != '\n')
+        {
+            if (*p != ' ' && *p != '\t' && *p != '\r')
+            {
+                return nullptr;
+            }
+            p++;
+        }
+        return (p < last) ? p + 1 : p;
+    }
+
     std::optional<Instruction> TraceReader::readNextLine(size_t proc)
+    {
+        if (limit_ && consumed_[proc] == limit_)
+        {
+            return std::nullopt;
+        }
+
+        std::optional<Instruction> ins = readNextRecord(proc);
+        if (ins)
+        {
+            consumed_[proc]++;
+        }
+        return ins;
+    }
+
+    std::optional<Instruction> TraceReader::readNextRecord(size_t proc)
+    {
+        switch (format_)
+        {
+        case TraceFormat::TEXT:
+            return readNextText(proc);
+        case TraceFormat::TEXT_STREAM:
+            return readNextTextStream(proc);
+        case TraceFormat::BINARY:
+            return readNextBinary(proc);
+        case TraceFormat::COMPRESSED:
+            return readNextCompressed(proc);
+        case TraceFormat::CONTAINER:
+            return readNextContainer(proc);
+        }
+        return std::nullopt;
+    }
+
+    void TraceReader::skip(size_t proc, size_t count)
+    {
+        switch (format_)
+        {
+        case TraceFormat::BINARY:
+            // fixed-width records, jump straight to the offset.
+            cursors_[proc] += std::min(count, (maps_[proc].size() - cursors_[proc]) / BINARY_RECORD_SIZE) * BINARY_RECORD_SIZE;
+            break;
+        case TraceFormat::CONTAINER:
+            container_->seek(proc, count);
+            break;
+        default:
+            // variable length records have to be scanned.
+            for (size_t i = 0; i < count && readNextRecord(proc); i++)
+            {
+            }
+            break;
+        }
+    }
+
+    std::optional<Instruction> TraceReader::readNextText(size_t proc)
+    {
+        const MappedFile &map = maps_[proc];
+        size_t &cursor = cursors_[proc];
+        if (cursor >= map.size())
+        {
+            return std::nullopt;
+        }
+
+        const char *first = map.data() + cursor;
+        const char *last = map.data() + map.size();
+
+        Instruction ins;
+        const char *next = parseTraceLine(first, last, ins);
+        if (!next)
+        {
+            std::cerr << proc << " Error reading instruction" << std::endl;
+            cursor = map.size();
+            return std::nullopt;
+        }
+
+        cursor = next - map.data();
+        ins.address &= ~(cache_line_size_ - 1);
+        return ins;
+    }
+
+    std::optional<Instruction> TraceReader::readNextTextStream(size_t proc)
     {
         std::string line;
         std::ifstream &file = files[proc];
@@ -50,10 +207,151 @@ namespace csim
         return std::nullopt;
     }
 
-    TraceReader::TraceReader(std::string directory, size_t num_procs, size_t cache_line_size) : num_procs_(num_procs), directory_(directory), cache_line_size_(cache_line_size)
+    std::optional<Instruction> TraceReader::readNextBinary(size_t proc)
     {
+        const MappedFile &map = maps_[proc];
+        size_t &cursor = cursors_[proc];
+        if (cursor + BINARY_RECORD_SIZE > map.size())
+        {
+            return std::nullopt;
+        }
+
+        const char *record = map.data() + cursor;
+        cursor += BINARY_RECORD_SIZE;
+
+        uint64_t address;
+        std::memcpy(&address, record + 1, sizeof(address));
+
+        Instruction ins;
+        ins.command = (record[0] == 0) ? OperationType::MEM_LOAD : OperationType::MEM_STORE;
+        ins.address = address & ~(cache_line_size_ - 1);
+        return ins;
+    }
+
+    std::optional<Instruction> TraceReader::readNextCompressed(size_t proc)
+    {
+        std::optional<Instruction> ins = streams_[proc]->next();
+        if (ins)
+        {
+            ins->address &= ~(cache_line_size_ - 1);
+        }
+        return ins;
+    }
+
+    std::optional<Instruction> TraceReader::readNextContainer(size_t proc)
+    {
+        std::optional<Instruction> ins = container_->next(proc);
+        if (ins)
+        {
+            ins->address &= ~(cache_line_size_ - 1);
+        }
+        return ins;
+    }
+
+    TraceReader::TraceReader(std::string directory, size_t num_procs, size_t cache_line_size, TraceFormat format, size_t offset, size_t limit) : num_procs_(num_procs), directory_(directory), cache_line_size_(cache_line_size), format_(format), offset_(offset), limit_(limit)
+    {
+        open();
+
+        consumed_ = std::vector<size_t>(num_procs_, 0);
+        if (offset_ > 0)
+        {
+            for (size_t proc = 0; proc < num_procs_; proc++)
+            {
+                skip(proc, offset_);
+            }
+        }
+    }
+
+    void TraceReader::open()
+    {
+        size_t num_procs = num_procs_;
         std::filesystem::path base = ".";
-        std::filesystem::path folder = directory;
+        std::filesystem::path folder = directory_;
+
+        if (format_ == TraceFormat::TEXT)
+        {
+            for (size_t proc = 0; proc < num_procs; proc++)
+            {
+                std::filesystem::path file = std::to_string(proc) + ".txt";
+                std::filesystem::path fullpath = base / folder / file;
+                MappedFile map(fullpath.string());
+                if (!map.isOpen())
+                {
+                    std::cerr << "no file provided for processor " << proc << " filepath:" << fullpath << std::endl;
+                    exit(255);
+                }
+                maps_.push_back(std::move(map));
+                cursors_.push_back(0);
+            }
+            return;
+        }
+
+        if (format_ == TraceFormat::BINARY)
+        {
+            for (size_t proc = 0; proc < num_procs; proc++)
+            {
+                std::filesystem::path file = std::to_string(proc) + ".bin";
+                std::filesystem::path fullpath = base / folder / file;
+                MappedFile map(fullpath.string());
+                if (!map.isOpen())
+                {
+                    std::cerr << "no file provided for processor " << proc << " filepath:" << fullpath << std::endl;
+                    exit(255);
+                }
+                if (map.size() < BINARY_TRACE_HEADER_SIZE || std::memcmp(map.data(), BINARY_TRACE_MAGIC, BINARY_TRACE_HEADER_SIZE) != 0 || (map.size() - BINARY_TRACE_HEADER_SIZE) % BINARY_RECORD_SIZE != 0)
+                {
+                    std::cerr << "malformed binary trace for processor " << proc << " filepath:" << fullpath << std::endl;
+                    exit(255);
+                }
+                maps_.push_back(std::move(map));
+                cursors_.push_back(BINARY_TRACE_HEADER_SIZE);
+            }
+            return;
+        }
+
+        if (format_ == TraceFormat::CONTAINER)
+        {
+            std::filesystem::path fullpath = base / folder / CONTAINER_TRACE_FILE;
+            container_ = std::make_unique<ContainerTrace>();
+            if (!container_->open(fullpath.string()))
+            {
+                std::cerr << "no valid container trace filepath:" << fullpath << std::endl;
+                exit(255);
+            }
+            if (container_->numProcs() < num_procs)
+            {
+                std::cerr << "container trace " << fullpath << " only holds " << container_->numProcs() << " processors" << std::endl;
+                exit(255);
+            }
+            if ((size_t(1) << container_->lineShift()) > cache_line_size_)
+            {
+                std::cerr << "container trace " << fullpath << " was encoded with " << (size_t(1) << container_->lineShift()) << " byte lines, larger than the cache line size" << std::endl;
+                exit(255);
+            }
+            return;
+        }
+
+        if (format_ == TraceFormat::COMPRESSED)
+        {
+            for (size_t proc = 0; proc < num_procs; proc++)
+            {
+                std::filesystem::path file = std::to_string(proc) + ".ctr";
+                std::filesystem::path fullpath = base / folder / file;
+                std::unique_ptr<CompressedTraceStream> stream = std::make_unique<CompressedTraceStream>();
+                if (!stream->open(fullpath.string()))
+                {
+                    std::cerr << "no valid compressed trace for processor " << proc << " filepath:" << fullpath << std::endl;
+                    exit(255);
+                }
+                if ((size_t(1) << stream->lineShift()) > cache_line_size_)
+                {
+                    std::cerr << "compressed trace for processor " << proc << " was encoded with " << (size_t(1) << stream->lineShift()) << " byte lines, larger than the cache line size" << std::endl;
+                    exit(255);
+                }
+                streams_.push_back(std::move(stream));
+            }
+            return;
+        }
 
         for (size_t proc = 0; proc < num_procs; proc++)
         {
@@ -69,6 +367,8 @@ namespace csim
         }
     }
 
+    TraceReader::~TraceReader() = default;
+
     std::vector<std::string> TraceReader::split(const std::string &line, char delim)
     {
         std::stringstream ss(line);
@@ -97,6 +397,29 @@ namespace csim
         return os;
     }
 
+    std::ostream &operator<<(std::ostream &os, const TraceFormat &format)
+    {
+        switch (format)
+        {
+        case TraceFormat::TEXT:
+            os << "TEXT";
+            break;
+        case TraceFormat::TEXT_STREAM:
+            os << "TEXT_STREAM";
+            break;
+        case TraceFormat::BINARY:
+            os << "BINARY";
+            break;
+        case TraceFormat::COMPRESSED:
+            os << "COMPRESSED";
+            break;
+        case TraceFormat::CONTAINER:
+            os << "CONTAINER";
+            break;
+        }
+        return os;
+    }
+
     std::ostream &operator<<(std::ostream &os, const Instruction &ins)
     {
         os << "INS: [";
@@ -0,0 +1,285 @@
+#include "tracecodec.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace csim
+{
+    void encodeCompressedBlock(const std::vector<Instruction> &records, uint32_t line_shift, std::vector<uint8_t> &payload)
+    {
+        payload.clear();
+        uint64_t prev = 0;
+        for (const Instruction &ins : records)
+        {
+            uint64_t line = ins.address >> line_shift;
+            uint64_t delta = zigzagEncode(static_cast<int64_t>(line - prev));
+            putVarint(payload, (delta << 1) | (ins.command == OperationType::MEM_STORE ? 1 : 0));
+            prev = line;
+        }
+    }
+
+    bool decodeCompressedBlock(const uint8_t *payload, size_t bytes, size_t count, uint32_t line_shift, Instruction *out)
+    {
+        const uint8_t *p = payload;
+        const uint8_t *last = payload + bytes;
+        uint64_t prev = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t value;
+            p = getVarint(p, last, value);
+            if (!p)
+            {
+                return false;
+            }
+            prev += static_cast<uint64_t>(zigzagDecode(value >> 1));
+            out[i].command = (value & 1) ? OperationType::MEM_STORE : OperationType::MEM_LOAD;
+            out[i].address = prev << line_shift;
+        }
+        return p == last;
+    }
+
+    CompressedTraceWriter::CompressedTraceWriter(const std::string &path, uint32_t line_shift, uint32_t block_records) : out_(path, std::ios::binary), line_shift_(line_shift), block_records_(block_records)
+    {
+        if (!out_)
+        {
+            return;
+        }
+        out_.write(COMPRESSED_TRACE_MAGIC, sizeof(COMPRESSED_TRACE_MAGIC));
+        out_.write(reinterpret_cast<const char *>(&line_shift_), sizeof(line_shift_));
+        out_.write(reinterpret_cast<const char *>(&block_records_), sizeof(block_records_));
+        block_.reserve(block_records_);
+    }
+
+    void CompressedTraceWriter::write(const Instruction &ins)
+    {
+        block_.push_back(ins);
+        if (block_.size() == block_records_)
+        {
+            flush();
+        }
+    }
+
+    void CompressedTraceWriter::close()
+    {
+        flush();
+        out_.close();
+    }
+
+    void CompressedTraceWriter::flush()
+    {
+        if (block_.empty())
+        {
+            return;
+        }
+        encodeCompressedBlock(block_, line_shift_, payload_);
+        uint32_t header[2] = {static_cast<uint32_t>(block_.size()), static_cast<uint32_t>(payload_.size())};
+        out_.write(reinterpret_cast<const char *>(header), sizeof(header));
+        out_.write(reinterpret_cast<const char *>(payload_.data()), payload_.size());
+        block_.clear();
+    }
+
+    bool CompressedTraceStream::open(const std::string &path)
+    {
+        in_.open(path, std::ios::binary);
+        if (!in_)
+        {
+            return false;
+        }
+
+        char magic[sizeof(COMPRESSED_TRACE_MAGIC)];
+        in_.read(magic, sizeof(magic));
+        in_.read(reinterpret_cast<char *>(&line_shift_), sizeof(line_shift_));
+        in_.read(reinterpret_cast<char *>(&block_records_), sizeof(block_records_));
+        if (!in_ || std::memcmp(magic, COMPRESSED_TRACE_MAGIC, sizeof(magic)) != 0 || line_shift_ < MIN_COMPRESSED_LINE_SHIFT || line_shift_ >= 64 || block_records_ == 0)
+        {
+            return false;
+        }
+
+        block_.reserve(block_records_);
+        return true;
+    }
+
+    std::optional<Instruction> CompressedTraceStream::next()
+    {
+        if (pos_ == block_.size() && !refill())
+        {
+            return std::nullopt;
+        }
+        return block_[pos_++];
+    }
+
+    bool CompressedTraceStream::refill()
+    {
+        if (failed_)
+        {
+            return false;
+        }
+
+        uint32_t header[2];
+        if (!in_.read(reinterpret_cast<char *>(header), sizeof(header)))
+        {
+            // clean end of trace
+            return false;
+        }
+
+        uint32_t count = header[0];
+        uint32_t bytes = header[1];
+        payload_.resize(bytes);
+        block_.resize(count);
+        pos_ = 0;
+
+        if (count == 0 || count > block_records_ || !in_.read(reinterpret_cast<char *>(payload_.data()), bytes) || !decodeCompressedBlock(payload_.data(), bytes, count, line_shift_, block_.data()))
+        {
+            std::cerr << "malformed compressed trace block" << std::endl;
+            failed_ = true;
+            block_.clear();
+            return false;
+        }
+        return true;
+    }
+
+    ContainerTraceWriter::ContainerTraceWriter(const std::string &path, uint32_t num_procs, uint32_t line_shift, uint32_t chunk_records) : out_(path, std::ios::binary), num_procs_(num_procs), line_shift_(line_shift), chunk_records_(chunk_records), offset_(CONTAINER_TRACE_HEADER_SIZE), written_(num_procs, 0)
+    {
+        if (!out_)
+        {
+            return;
+        }
+        // the header is rewritten with the index offset on close.
+        char header[CONTAINER_TRACE_HEADER_SIZE] = {};
+        out_.write(header, sizeof(header));
+    }
+
+    void ContainerTraceWriter::writeChunk(uint32_t proc, const std::vector<Instruction> &records)
+    {
+        if (records.empty())
+        {
+            return;
+        }
+        encodeCompressedBlock(records, line_shift_, payload_);
+        out_.write(reinterpret_cast<const char *>(payload_.data()), payload_.size());
+
+        index_.push_back(ContainerChunk{.proc = proc,
+                                        .count = static_cast<uint32_t>(records.size()),
+                                        .first = written_[proc],
+                                        .offset = offset_,
+                                        .bytes = payload_.size()});
+        written_[proc] += records.size();
+        offset_ += payload_.size();
+    }
+
+    void ContainerTraceWriter::close()
+    {
+        uint64_t chunks = index_.size();
+        out_.write(reinterpret_cast<const char *>(&chunks), sizeof(chunks));
+        out_.write(reinterpret_cast<const char *>(index_.data()), index_.size() * sizeof(ContainerChunk));
+
+        uint32_t reserved = 0;
+        out_.seekp(0);
+        out_.write(CONTAINER_TRACE_MAGIC, sizeof(CONTAINER_TRACE_MAGIC));
+        out_.write(reinterpret_cast<const char *>(&num_procs_), sizeof(num_procs_));
+        out_.write(reinterpret_cast<const char *>(&line_shift_), sizeof(line_shift_));
+        out_.write(reinterpret_cast<const char *>(&chunk_records_), sizeof(chunk_records_));
+        out_.write(reinterpret_cast<const char *>(&reserved), sizeof(reserved));
+        out_.write(reinterpret_cast<const char *>(&offset_), sizeof(offset_));
+        out_.close();
+    }
+
+    bool ContainerTrace::open(const std::string &path)
+    {
+        map_ = MappedFile(path);
+        if (!map_.isOpen() || map_.size() < CONTAINER_TRACE_HEADER_SIZE || std::memcmp(map_.data(), CONTAINER_TRACE_MAGIC, sizeof(CONTAINER_TRACE_MAGIC)) != 0)
+        {
+            return false;
+        }
+
+        const char *header = map_.data() + sizeof(CONTAINER_TRACE_MAGIC);
+        uint64_t index_offset;
+        std::memcpy(&num_procs_, header, sizeof(num_procs_));
+        std::memcpy(&line_shift_, header + 4, sizeof(line_shift_));
+        std::memcpy(&chunk_records_, header + 8, sizeof(chunk_records_));
+        std::memcpy(&index_offset, header + 16, sizeof(index_offset));
+
+        uint64_t chunks;
+        if (line_shift_ < MIN_COMPRESSED_LINE_SHIFT || line_shift_ >= 64 || index_offset + sizeof(chunks) > map_.size())
+        {
+            return false;
+        }
+        std::memcpy(&chunks, map_.data() + index_offset, sizeof(chunks));
+        if (chunks > (map_.size() - index_offset - sizeof(chunks)) / sizeof(ContainerChunk))
+        {
+            return false;
+        }
+        index_.resize(chunks);
+        std::memcpy(index_.data(), map_.data() + index_offset + sizeof(chunks), chunks * sizeof(ContainerChunk));
+
+        cursors_ = std::vector<Cursor>(num_procs_);
+        for (uint32_t chunk = 0; chunk < chunks; chunk++)
+        {
+            const ContainerChunk &entry = index_[chunk];
+            if (entry.proc >= num_procs_ || entry.count > chunk_records_ || entry.offset + entry.bytes > index_offset)
+            {
+                return false;
+            }
+            cursors_[entry.proc].chunks.push_back(chunk);
+        }
+        for (Cursor &cursor : cursors_)
+        {
+            cursor.block.reserve(chunk_records_);
+        }
+        return true;
+    }
+
+    bool ContainerTrace::decodeChunk(Cursor &cursor, uint32_t chunk)
+    {
+        const ContainerChunk &entry = index_[chunk];
+        cursor.block.resize(entry.count);
+        cursor.pos = 0;
+        const uint8_t *payload = reinterpret_cast<const uint8_t *>(map_.data() + entry.offset);
+        if (!decodeCompressedBlock(payload, entry.bytes, entry.count, line_shift_, cursor.block.data()))
+        {
+            std::cerr << "malformed container trace chunk" << std::endl;
+            cursor.block.clear();
+            cursor.chunk = cursor.chunks.size();
+            return false;
+        }
+        return true;
+    }
+
+    bool ContainerTrace::seek(size_t proc, uint64_t offset)
+    {
+        Cursor &cursor = cursors_[proc];
+        cursor.block.clear();
+        cursor.pos = 0;
+
+        // first chunk whose records end past offset
+        auto it = std::partition_point(cursor.chunks.begin(), cursor.chunks.end(), [&](uint32_t chunk)
+                                       { return index_[chunk].first + index_[chunk].count <= offset; });
+        cursor.chunk = it - cursor.chunks.begin();
+        if (it == cursor.chunks.end())
+        {
+            return false;
+        }
+
+        if (!decodeChunk(cursor, *it))
+        {
+            return false;
+        }
+        cursor.chunk++;
+        cursor.pos = offset - index_[*it].first;
+        return true;
+    }
+
+    std::optional<Instruction> ContainerTrace::next(size_t proc)
+    {
+        Cursor &cursor = cursors_[proc];
+        if (cursor.pos == cursor.block.size())
+        {
+            if (cursor.chunk == cursor.chunks.size() || !decodeChunk(cursor, cursor.chunks[cursor.chunk]))
+            {
+                return std::nullopt;
+            }
+            cursor.chunk++;
+        }
+        return cursor.block[cursor.pos++];
+    }
+}
@@ -0,0 +1,246 @@
+#include "trace.hpp"
+#include "tracecodec.hpp"
+#include <bit>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Converts a directory of text traces (<proc>.txt) into another trace format.
+// Usage: tracecvt --input=our_traces/random --output=bin_traces/random [--num_procs=8]
+//                 [--format=binary|compressed|container] [--line_size=64] [--block_records=4096]
+// Compressed and container traces only keep line addresses, so --line_size must not exceed
+// the cache line size they are later simulated with.
+
+using namespace csim;
+
+namespace
+{
+    struct CvtConfig
+    {
+        std::string input;
+        std::string output;
+        size_t num_procs = 0; // 0 = every consecutive <proc>.txt found in input
+        TraceFormat format = TraceFormat::BINARY;
+        size_t line_size = 64;
+        uint32_t block_records = DEFAULT_BLOCK_RECORDS;
+    };
+
+    void parseCvtArgs(int argc, char *argv[], CvtConfig &config)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg(argv[i]);
+            size_t equal_pos = arg.find('=');
+            if (arg.substr(0, 2) != "--" || equal_pos == std::string::npos)
+            {
+                std::cerr << "Invalid argument format: " << arg << std::endl;
+                exit(1);
+            }
+
+            std::string key = arg.substr(2, equal_pos - 2);
+            std::string value = arg.substr(equal_pos + 1);
+
+            if (key == "input")
+            {
+                config.input = value;
+            }
+            else if (key == "output")
+            {
+                config.output = value;
+            }
+            else if (key == "num_procs")
+            {
+                config.num_procs = std::stoi(value);
+            }
+            else if (key == "format")
+            {
+                if (value == "BINARY" || value == "binary")
+                {
+                    config.format = TraceFormat::BINARY;
+                }
+                else if (value == "COMPRESSED" || value == "compressed")
+                {
+                    config.format = TraceFormat::COMPRESSED;
+                }
+                else if (value == "CONTAINER" || value == "container")
+                {
+                    config.format = TraceFormat::CONTAINER;
+                }
+                else
+                {
+                    std::cerr << "Invalid output format" << std::endl;
+                    exit(1);
+                }
+            }
+            else if (key == "line_size")
+            {
+                config.line_size = std::stoul(value);
+            }
+            else if (key == "block_records")
+            {
+                config.block_records = std::stoul(value);
+            }
+            else
+            {
+                std::cerr << "Unknown key: " << key << std::endl;
+                exit(1);
+            }
+        }
+
+        if (config.input.empty() || config.output.empty())
+        {
+            std::cerr << "usage: tracecvt --input=<dir> --output=<dir> [--num_procs=<n>] [--format=binary|compressed|container] [--line_size=<bytes>] [--block_records=<n>]" << std::endl;
+            exit(1);
+        }
+        if ((config.format == TraceFormat::COMPRESSED || config.format == TraceFormat::CONTAINER) && (!std::has_single_bit(config.line_size) || std::countr_zero(config.line_size) < static_cast<int>(MIN_COMPRESSED_LINE_SHIFT)))
+        {
+            std::cerr << "line_size must be a power of two of at least " << (1 << MIN_COMPRESSED_LINE_SHIFT) << std::endl;
+            exit(1);
+        }
+        if (config.block_records == 0)
+        {
+            std::cerr << "block_records must be positive" << std::endl;
+            exit(1);
+        }
+    }
+
+    size_t countProcs(const std::filesystem::path &dir)
+    {
+        size_t procs = 0;
+        while (std::filesystem::exists(dir / (std::to_string(procs) + ".txt")))
+        {
+            procs++;
+        }
+        return procs;
+    }
+
+    size_t convertBinary(TraceReader &reader, size_t proc, const std::filesystem::path &outpath)
+    {
+        std::ofstream out(outpath, std::ios::binary);
+        if (!out)
+        {
+            std::cerr << "cannot write " << outpath << std::endl;
+            exit(255);
+        }
+        out.write(BINARY_TRACE_MAGIC, BINARY_TRACE_HEADER_SIZE);
+
+        size_t records = 0;
+        char record[BINARY_RECORD_SIZE];
+        while (std::optional<Instruction> ins = reader.readNextLine(proc))
+        {
+            encodeBinaryRecord(record, *ins);
+            out.write(record, BINARY_RECORD_SIZE);
+            records++;
+        }
+        return records;
+    }
+
+    size_t convertCompressed(TraceReader &reader, size_t proc, const std::filesystem::path &outpath, const CvtConfig &config)
+    {
+        CompressedTraceWriter writer(outpath.string(), std::countr_zero(config.line_size), config.block_records);
+        if (!writer.isOpen())
+        {
+            std::cerr << "cannot write " << outpath << std::endl;
+            exit(255);
+        }
+
+        size_t records = 0;
+        while (std::optional<Instruction> ins = reader.readNextLine(proc))
+        {
+            writer.write(*ins);
+            records++;
+        }
+        writer.close();
+        return records;
+    }
+
+    // Writes every processor into one container, interleaving their chunks round-robin
+    // so processors at similar offsets sit close together in the file.
+    size_t convertContainer(TraceReader &reader, size_t num_procs, const std::filesystem::path &outpath, const CvtConfig &config)
+    {
+        ContainerTraceWriter writer(outpath.string(), num_procs, std::countr_zero(config.line_size), config.block_records);
+        if (!writer.isOpen())
+        {
+            std::cerr << "cannot write " << outpath << std::endl;
+            exit(255);
+        }
+
+        size_t records = 0;
+        std::vector<bool> finished(num_procs, false);
+        size_t remaining = num_procs;
+        std::vector<Instruction> chunk;
+        chunk.reserve(config.block_records);
+        while (remaining > 0)
+        {
+            for (size_t proc = 0; proc < num_procs; proc++)
+            {
+                if (finished[proc])
+                {
+                    continue;
+                }
+
+                chunk.clear();
+                while (chunk.size() < config.block_records)
+                {
+                    std::optional<Instruction> ins = reader.readNextLine(proc);
+                    if (!ins)
+                    {
+                        finished[proc] = true;
+                        remaining--;
+                        break;
+                    }
+                    chunk.push_back(*ins);
+                }
+                writer.writeChunk(proc, chunk);
+                records += chunk.size();
+            }
+        }
+        writer.close();
+        return records;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    CvtConfig config;
+    parseCvtArgs(argc, argv, config);
+
+    std::filesystem::path input = config.input;
+    std::filesystem::path output = config.output;
+    size_t num_procs = config.num_procs ? config.num_procs : countProcs(input);
+    if (num_procs == 0)
+    {
+        std::cerr << "no traces found in " << input << std::endl;
+        return 255;
+    }
+    std::filesystem::create_directories(output);
+
+    // a line size of 1 keeps the raw addresses, masking happens when simulating.
+    TraceReader reader(config.input, num_procs, 1, TraceFormat::TEXT);
+
+    if (config.format == TraceFormat::CONTAINER)
+    {
+        std::filesystem::path outpath = output / CONTAINER_TRACE_FILE;
+        size_t records = convertContainer(reader, num_procs, outpath, config);
+        std::cout << outpath.string() << ": " << num_procs << " processors, " << records << " records" << std::endl;
+        return 0;
+    }
+
+    for (size_t proc = 0; proc < num_procs; proc++)
+    {
+        std::filesystem::path outpath;
+        size_t records;
+        if (config.format == TraceFormat::COMPRESSED)
+        {
+            outpath = output / (std::to_string(proc) + ".ctr");
+            records = convertCompressed(reader, proc, outpath, config);
+        }
+        else
+        {
+            outpath = output / (std::to_string(proc) + ".bin");
+            records = convertBinary(reader, proc, outpath);
+        }
+        std::cout << outpath.string() << ": " << records << " records" << std::endl;
+    }
+}
@@ -0,0 +1,193 @@
+#include "tracepipe.hpp"
+#include <chrono>
+
+namespace csim
+{
+    BatchRing::BatchRing(size_t depth, size_t batch_size) : slots_(depth)
+    {
+        for (InstructionBatch &slot : slots_)
+        {
+            slot.instructions.resize(batch_size);
+        }
+    }
+
+    InstructionBatch *BatchRing::producerSlot()
+    {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == slots_.size())
+        {
+            return nullptr;
+        }
+        return &slots_[tail % slots_.size()];
+    }
+
+    void BatchRing::publish()
+    {
+        tail_.fetch_add(1, std::memory_order_release);
+        tail_.notify_one();
+    }
+
+    InstructionBatch *BatchRing::front()
+    {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (tail_.load(std::memory_order_acquire) == head)
+        {
+            return nullptr;
+        }
+        return &slots_[head % slots_.size()];
+    }
+
+    void BatchRing::pop()
+    {
+        head_.fetch_add(1, std::memory_order_release);
+    }
+
+    void BatchRing::waitNonEmpty()
+    {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        tail_.wait(head, std::memory_order_acquire);
+    }
+
+    TracePipeline::TracePipeline(TraceSource *trace_source, size_t num_procs, size_t num_threads, size_t depth, size_t batch_size) : trace_source_(trace_source), num_procs_(num_procs), batch_size_(batch_size)
+    {
+        for (size_t proc = 0; proc < num_procs_; proc++)
+        {
+            rings_.push_back(std::make_unique<BatchRing>(depth, batch_size));
+        }
+        consumers_ = std::vector<Consumer>(num_procs_);
+        stats_ = std::vector<TracePipelineStats>(num_procs_);
+
+        num_threads = std::min(num_threads, num_procs_);
+        for (size_t thread = 0; thread < num_threads; thread++)
+        {
+            threads_.emplace_back(&TracePipeline::decode, this, thread, num_threads);
+        }
+    }
+
+    TracePipeline::~TracePipeline()
+    {
+        stop_.store(true);
+        pops_.fetch_add(1);
+        pops_.notify_all();
+        for (std::thread &thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    std::optional<Instruction> TracePipeline::readNextLine(size_t proc)
+    {
+        Consumer &consumer = consumers_[proc];
+        BatchRing &ring = *rings_[proc];
+
+        while (!consumer.done)
+        {
+            if (consumer.batch)
+            {
+                if (consumer.pos < consumer.batch->count)
+                {
+                    return consumer.batch->instructions[consumer.pos++];
+                }
+
+                // batch fully consumed, hand the slot back to the decoder.
+                consumer.done = consumer.batch->last;
+                consumer.batch = nullptr;
+                ring.pop();
+                pops_.fetch_add(1, std::memory_order_release);
+                pops_.notify_all();
+                continue;
+            }
+
+            consumer.batch = ring.front();
+            consumer.pos = 0;
+            if (!consumer.batch)
+            {
+                // decoder fell behind, the simulation has to wait for it.
+                TracePipelineStats &stats = stats_[proc];
+                stats.starved++;
+                auto start = std::chrono::steady_clock::now();
+                while (!(consumer.batch = ring.front()))
+                {
+                    ring.waitNonEmpty();
+                }
+                stats.starved_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    void TracePipeline::decode(size_t thread, size_t num_threads)
+    {
+        std::vector<bool> finished(num_procs_, false);
+        size_t remaining = 0;
+        for (size_t proc = thread; proc < num_procs_; proc += num_threads)
+        {
+            remaining++;
+        }
+
+        while (remaining > 0 && !stop_.load(std::memory_order_relaxed))
+        {
+            uint64_t seen = pops_.load(std::memory_order_acquire);
+            bool progress = false;
+
+            for (size_t proc = thread; proc < num_procs_; proc += num_threads)
+            {
+                if (finished[proc])
+                {
+                    continue;
+                }
+
+                BatchRing &ring = *rings_[proc];
+                InstructionBatch *slot;
+                while ((slot = ring.producerSlot()))
+                {
+                    slot->count = 0;
+                    slot->last = false;
+                    while (slot->count < batch_size_)
+                    {
+                        std::optional<Instruction> ins = trace_source_->readNextLine(proc);
+                        if (!ins)
+                        {
+                            slot->last = true;
+                            break;
+                        }
+                        slot->instructions[slot->count++] = *ins;
+                    }
+                    bool last = slot->last;
+                    ring.publish();
+                    progress = true;
+
+                    if (last)
+                    {
+                        finished[proc] = true;
+                        remaining--;
+                        break;
+                    }
+                }
+            }
+
+            if (!progress)
+            {
+                // every ring of this thread is full, sleep until the simulation consumes a batch.
+                pops_.wait(seen, std::memory_order_acquire);
+            }
+        }
+    }
+
+    std::ostream &operator<<(std::ostream &os, const TracePipeline &pipeline)
+    {
+        size_t starved = 0;
+        uint64_t starved_ns = 0;
+        for (const TracePipelineStats &stats : pipeline.stats())
+        {
+            starved += stats.starved;
+            starved_ns += stats.starved_ns;
+        }
+
+        os << "TRACE PIPELINE" << "\n";
+        os << "STARVED READS:\t" << starved << "\n";
+        os << "STARVED TIME (ms):\t" << starved_ns / 1000000.0 << "\n";
+        return os;
+    }
+}
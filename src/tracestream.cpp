@@ -0,0 +1,177 @@
+#include "tracestream.hpp"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace csim
+{
+    namespace
+    {
+        const size_t STREAM_READ_SIZE = 1 << 16;
+    }
+
+    StreamTraceSource::StreamTraceSource(const std::string &path, size_t num_procs, size_t cache_line_size, size_t depth) : num_procs_(num_procs), cache_line_size_(cache_line_size)
+    {
+        if (path == "-")
+        {
+            fd_ = STDIN_FILENO;
+        }
+        else
+        {
+            // opening a FIFO blocks until the writer opens its end.
+            fd_ = ::open(path.c_str(), O_RDONLY);
+            if (fd_ < 0)
+            {
+                std::cerr << "cannot open trace stream " << path << ": " << std::strerror(errno) << std::endl;
+                exit(255);
+            }
+        }
+
+        queues_ = std::vector<Queue>(num_procs_);
+        for (Queue &queue : queues_)
+        {
+            queue.ring.resize(depth);
+        }
+        buffer_.resize(STREAM_READ_SIZE);
+    }
+
+    StreamTraceSource::~StreamTraceSource()
+    {
+        if (fd_ > STDIN_FILENO)
+        {
+            ::close(fd_);
+        }
+    }
+
+    std::optional<Instruction> StreamTraceSource::readNextLine(size_t proc)
+    {
+        Queue &queue = queues_[proc];
+        while (queue.size == 0)
+        {
+            if (!pending_)
+            {
+                PendingLine line;
+                if (stream_done_ || !readLine(line))
+                {
+                    return std::nullopt;
+                }
+                pending_ = line;
+            }
+
+            // the line belongs to a processor that is still behind, so stop reading
+            // until it catches up. proc gets nothing this cycle.
+            Queue &target = queues_[pending_->proc];
+            if (target.size == target.ring.size())
+            {
+                stalls_++;
+                return std::nullopt;
+            }
+            target.ring[(target.head + target.size) % target.ring.size()] = pending_->ins;
+            target.size++;
+            pending_.reset();
+        }
+
+        Instruction ins = queue.ring[queue.head];
+        queue.head = (queue.head + 1) % queue.ring.size();
+        queue.size--;
+        return ins;
+    }
+
+    bool StreamTraceSource::finished(size_t proc)
+    {
+        return stream_done_ && queues_[proc].size == 0 && !(pending_ && pending_->proc == proc);
+    }
+
+    // Moves the unparsed bytes to the front of buffer_ and reads more after them.
+    // Returns false once the writer has closed the stream.
+    bool StreamTraceSource::fill()
+    {
+        if (begin_ > 0)
+        {
+            std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (end_ == buffer_.size())
+        {
+            buffer_.resize(buffer_.size() * 2);
+        }
+
+        while (true)
+        {
+            ssize_t n = ::read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+            if (n > 0)
+            {
+                end_ += n;
+                return true;
+            }
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n < 0)
+            {
+                std::cerr << "error reading trace stream: " << std::strerror(errno) << std::endl;
+            }
+            input_done_ = true;
+            return false;
+        }
+    }
+
+    // Parses the next non empty line. Returns false at the end of the stream, or on
+    // a malformed line, which ends the stream like a malformed trace file ends a processor.
+    bool StreamTraceSource::readLine(PendingLine &line)
+    {
+        while (true)
+        {
+            const char *first = buffer_.data() + begin_;
+            const char *last = buffer_.data() + end_;
+            const char *newline = static_cast<const char *>(std::memchr(first, '\n', last - first));
+            if (!newline && !input_done_)
+            {
+                fill();
+                continue;
+            }
+            if (first == last)
+            {
+                stream_done_ = true;
+                return false;
+            }
+
+            const char *line_end = newline ? newline : last;
+            begin_ = (newline ? newline + 1 : last) - buffer_.data();
+
+            const char *p = first;
+            while (p < line_end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            {
+                p++;
+            }
+            if (p == line_end)
+            {
+                continue;
+            }
+
+            std::from_chars_result res = std::from_chars(p, line_end, line.proc);
+            if (res.ec != std::errc() || line.proc >= num_procs_ || res.ptr == line_end || (*res.ptr != ' ' && *res.ptr != '\t') || !parseTraceLine(res.ptr, line_end, line.ins))
+            {
+                std::cerr << "Error reading stream line " << lines_ + 1 << ": " << std::string(first, line_end) << std::endl;
+                stream_done_ = true;
+                return false;
+            }
+
+            line.ins.address &= ~(cache_line_size_ - 1);
+            lines_++;
+            return true;
+        }
+    }
+
+    std::ostream &operator<<(std::ostream &os, const StreamTraceSource &stream)
+    {
+        os << "TRACE STREAM" << "\n";
+        os << "LINES:\t" << stream.lines() << "\n";
+        os << "BACKPRESSURE STALLS:\t" << stream.stalls() << "\n";
+        return os;
+    }
+}